@@ -0,0 +1,300 @@
+// Host benchmarks for the hardware-independent core (see [env:native] in
+// platformio.ini). Host numbers are not target numbers, but a change that
+// makes a host figure noticeably worse almost always costs on the RA4M1 too.
+//
+//   pio run -e native -t exec                  print the results
+//   .pio/build/native/program baseline.txt     also compare against a baseline
+//
+// Results are printed one per line as "name value unit", so the output of a
+// run on a good build is a baseline. With one, any result more than
+// BENCH_TOLERANCE percent worse than the baseline fails the run.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "dmx_universe.h"
+#include "dmx_merge.h"
+#include "dmx_fade.h"
+#include "dmx_effects.h"
+#include "dmx_cues.h"
+#include "dmx_patch.h"
+#include "dmx_demo.h"
+#include "http_parser.h"
+
+#define BENCH_TOLERANCE 25      // Percent
+#define BENCH_RUNS 5            // Best of, to keep scheduler noise out
+#define BENCH_MAX_RESULTS 16
+#define LOOP_PASSES 100000      // Synthetic loop() passes for the latency figures
+
+struct BenchResult {
+    const char* name;
+    double value;
+    const char* unit;
+};
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int resultCount = 0;
+static volatile uint32_t sink; // Keeps results observable to the optimizer
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, double value, const char* unit) {
+    if (resultCount < BENCH_MAX_RESULTS) results[resultCount++] = { name, value, unit };
+    printf("%-20s %12.1f %s\n", name, value, unit);
+}
+
+// ns per call of fn, best of BENCH_RUNS runs of iterations calls
+template <typename F>
+static double nsPerCall(uint32_t iterations, F fn) {
+    double best = 1e30;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        uint64_t start = nowNs();
+        for (uint32_t i = 0; i < iterations; i++) fn(i);
+        double ns = (double)(nowNs() - start) / iterations;
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+// The firmware's sources on universe 1 plus three extra HTP inputs, so the
+// merge runs with a full house of DMX_MERGE_SOURCES
+struct Rig {
+    uint8_t outputStorage[DMX_UNIVERSE_STORAGE];
+    uint8_t layerStorage[DMX_MERGE_SOURCES][DMX_LAYER_STORAGE];
+    DmxUniverse output;
+    DmxUniverse layers[DMX_MERGE_SOURCES];
+    DmxMerge merge;
+    DmxFadeEngine fades;
+    DmxEffectEngine effects;
+    DmxPatch patch;
+    CueList show;
+    CuePlayer player;
+};
+
+enum { LAYER_MANUAL, LAYER_NETWORK, LAYER_SHOW };
+
+static Rig rig;
+
+static void rigBegin() {
+    dmxUniverseInit(rig.output, rig.outputStorage);
+    dmxMergeInit(rig.merge);
+    for (uint8_t i = 0; i < DMX_MERGE_SOURCES; i++) {
+        dmxUniverseInit(rig.layers[i], rig.layerStorage[i], true);
+        dmxMergeAddSource(rig.merge, rig.layers[i], i <= LAYER_SHOW ? MERGE_LTP : MERGE_HTP, 100,
+                          i == LAYER_NETWORK ? 2500 : 0);
+    }
+    dmxFadeInit(rig.fades);
+    dmxEffectsInit(rig.effects);
+    dmxCueBegin(rig.player, rig.show, rig.fades, rig.output);
+
+    // The firmware's default moving head, sixteen of them
+    dmxPatchInit(rig.patch);
+    int head = dmxPatchAddType(rig.patch, "head", 11);
+    dmxPatchAddAttribute(rig.patch, head, "pan", 0, true, 0x8000);
+    dmxPatchAddAttribute(rig.patch, head, "tilt", 2, true, 0x8000);
+    static const char* const names[7] = { "speed", "dimmer", "strobe", "red", "green", "blue", "white" };
+    for (int i = 0; i < 7; i++) dmxPatchAddAttribute(rig.patch, head, names[i], 4 + i, false, 0);
+    for (int i = 0; i < PATCH_MAX_FIXTURES; i++) {
+        char name[PATCH_NAME_MAX];
+        snprintf(name, sizeof(name), "head%d", i + 1);
+        dmxPatchAddFixture(rig.patch, name, head, 0, 1 + i * 11);
+    }
+
+    // Eight effects over the whole rig
+    for (uint8_t i = 0; i < DMX_EFFECT_SLOTS; i++) {
+        DmxEffectParams params = {};
+        params.type = i % 2 ? EFFECT_SINE : EFFECT_RAINBOW;
+        params.channel = 8 + i;
+        params.count = 16;
+        params.stride = 11;
+        params.rate = 50 + i * 10;
+        params.spread = 16;
+        params.amplitude = 255;
+        params.duty = 128;
+        dmxEffectStart(rig.effects, params);
+    }
+}
+
+static void fillLayer(DmxUniverse& layer, uint32_t seed) {
+    uint8_t* slots = dmxUniverseReserve(layer, 1, DMX_CHANNELS);
+    for (uint16_t i = 0; i < DMX_CHANNELS; i++) slots[i] = (uint8_t)(seed * 31 + i * 7);
+    dmxUniverseCommit(layer);
+}
+
+// Everything loop() does for a frame: show, merge, flip
+static void frame(uint32_t now) {
+    dmxCueTick(rig.player, now);
+    dmxFadeTick(rig.fades, rig.layers[LAYER_SHOW], now);
+    dmxEffectsTick(rig.effects, rig.layers[LAYER_SHOW], now);
+    dmxMergeTick(rig.merge, rig.output, now);
+    sink += dmxUniverseFlip(rig.output)[0];
+}
+
+static void benchFrame() {
+    rigBegin();
+    for (uint8_t i = 0; i < DMX_MERGE_SOURCES; i++) fillLayer(rig.layers[i], i);
+    report("frame", nsPerCall(20000, [](uint32_t i) {
+        fillLayer(rig.layers[LAYER_NETWORK], i); // A full universe arrives every frame
+        frame(i);
+    }), "ns");
+
+    report("merge", nsPerCall(20000, [](uint32_t i) {
+        for (uint8_t s = 0; s < DMX_MERGE_SOURCES; s++) dmxUniverseCommit(rig.layers[s]);
+        dmxMergeTick(rig.merge, rig.output, i);
+    }), "ns");
+}
+
+static void benchFades() {
+    rigBegin();
+    report("fadeStep", nsPerCall(20000, [](uint32_t i) {
+        if (i % 1000 == 0) {
+            for (uint16_t c = 0; c < DMX_FADE_SLOTS; c++) {
+                dmxFadeStart(rig.fades, rig.output, 1 + c * 2, 0xFFFF, 60000, FADE_EASE_IN_OUT, true, i);
+            }
+        }
+        dmxFadeTick(rig.fades, rig.layers[LAYER_SHOW], i);
+    }) / DMX_FADE_SLOTS, "ns");
+
+    report("effects", nsPerCall(20000, [](uint32_t i) {
+        dmxEffectsTick(rig.effects, rig.layers[LAYER_SHOW], i);
+    }), "ns");
+}
+
+static void benchDemo() {
+    rigBegin();
+    static DemoPreset presets[DEMO_MAX_PRESETS];
+    for (int p = 0; p < DEMO_MAX_PRESETS; p++) {
+        for (int v = 0; v < DEMO_PRESET_VALUES; v++) presets[p].values[v] = (uint8_t)(p * 25 + v);
+    }
+    report("demoBuild", nsPerCall(2000, [](uint32_t) {
+        sink += dmxDemoBuild(rig.show, rig.patch, presets, DEMO_MAX_PRESETS, 1000, 5000);
+    }), "ns");
+
+    // Playback at one tick per ms runs through every cue, fades included
+    dmxCuePlay(rig.player, 0, 0);
+    report("demoTick", nsPerCall(200000, [](uint32_t i) {
+        dmxCueTick(rig.player, i);
+        dmxFadeTick(rig.fades, rig.layers[LAYER_SHOW], i);
+    }), "ns");
+}
+
+static const char batchRequest[] =
+    "POST /api/channels/batch HTTP/1.1\r\n"
+    "Host: 192.168.1.50\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 102\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "{\"universe\":1,\"updates\":[{\"channel\":1,\"value\":255},{\"channel\":2,\"value\":128},{\"channel\":3,\"value\":1}]}";
+
+// Feed the request in segments of at most chunk bytes, like the socket does
+static bool parseRequest(HttpRequest& request, size_t chunk) {
+    httpRequestReset(request);
+    const uint8_t* data = (const uint8_t*)batchRequest;
+    size_t left = sizeof(batchRequest) - 1;
+    while (left > 0 && !httpDone(request)) {
+        size_t n = httpParse(request, data, std::min(left, chunk));
+        data += n;
+        left -= n;
+    }
+    return request.state == HTTP_COMPLETE;
+}
+
+static void benchParser() {
+    static HttpRequest request;
+    if (!parseRequest(request, 64) || request.bodyLength != 102) {
+        fprintf(stderr, "parser: test request did not parse\n");
+        exit(1);
+    }
+    double ns = nsPerCall(100000, [](uint32_t) {
+        parseRequest(request, 1460);
+        sink += request.bodyLength;
+    });
+    report("parser", 1e9 / ns, "req/s");
+    ns = nsPerCall(100000, [](uint32_t i) {
+        parseRequest(request, 1 + i % 48);
+        sink += request.bodyLength;
+    });
+    report("parserSegmented", 1e9 / ns, "req/s");
+}
+
+// loop() passes under a random mix of requests, network frames, fades and
+// the show; every pass ends in a frame. The same sequence runs BENCH_RUNS
+// times and the lowest figures count, so a preempted pass does not.
+static void loopRun(double& p99, double& max) {
+    rigBegin();
+    static HttpRequest request;
+    static uint32_t passNs[LOOP_PASSES];
+    static DemoPreset presets[DEMO_MAX_PRESETS];
+    dmxDemoBuild(rig.show, rig.patch, presets, DEMO_MAX_PRESETS, 1000, 5000);
+    dmxCuePlay(rig.player, 0, 0);
+
+    srand(1);
+    for (uint32_t pass = 0; pass < LOOP_PASSES; pass++) {
+        uint64_t start = nowNs();
+        int load = rand();
+        if (load & 1) {
+            parseRequest(request, 1 + load % 1460);
+            dmxUniverseSet(rig.layers[LAYER_MANUAL], 1 + load % DMX_CHANNELS, load >> 8);
+            dmxUniverseCommit(rig.layers[LAYER_MANUAL]);
+        }
+        if (load & 2) fillLayer(rig.layers[LAYER_NETWORK], pass);
+        if ((load & 0x3C) == 0) {
+            dmxFadeStart(rig.fades, rig.output, 1 + load % 500, load >> 4, 2000, FADE_LINEAR, false, pass);
+        }
+        frame(pass);
+        passNs[pass] = nowNs() - start;
+    }
+
+    std::sort(passNs, passNs + LOOP_PASSES);
+    p99 = std::min(p99, passNs[LOOP_PASSES * 99 / 100] / 1000.0);
+    max = std::min(max, passNs[LOOP_PASSES - 1] / 1000.0);
+}
+
+static void benchLoop() {
+    double p99 = 1e30, max = 1e30;
+    for (int run = 0; run < BENCH_RUNS; run++) loopRun(p99, max);
+    report("loopP99", p99, "us");
+    report("loopMax", max, "us");
+}
+
+// Rates (req/s) are better when higher, everything else when lower
+static int compareBaseline(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "cannot open baseline %s\n", path);
+        return 1;
+    }
+
+    int regressions = 0;
+    char name[32], unit[16];
+    double baseline;
+    while (fscanf(file, "%31s %lf %15s", name, &baseline, unit) == 3) {
+        for (int i = 0; i < resultCount; i++) {
+            const BenchResult& result = results[i];
+            if (strcmp(result.name, name) != 0 || baseline <= 0) continue;
+            bool rate = strcmp(result.unit, "req/s") == 0;
+            double change = rate ? baseline / result.value : result.value / baseline;
+            if (change > 1 + BENCH_TOLERANCE / 100.0) {
+                printf("REGRESSION %s: %.1f %s, baseline %.1f\n", name, result.value, result.unit, baseline);
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    benchFrame();
+    benchFades();
+    benchDemo();
+    benchParser();
+    benchLoop();
+    return argc > 1 ? compareBaseline(argv[1]) : 0;
+}
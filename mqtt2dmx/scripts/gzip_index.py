@@ -0,0 +1,60 @@
+"""
+Pre-build step: gzip the web UI from src/index.h into a PROGMEM byte array.
+
+The page is still edited in src/index.h (the INDEX_HTML raw string); this
+writes src/index_html_gz.h with the compressed bytes and an ETag derived
+from them, so the firmware can serve it with Content-Encoding: gzip and
+answer revalidation with 304.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+
+RAW_STRING = re.compile(r'R"=====\((.*)\)====="', re.DOTALL)
+
+
+def generate(src_dir):
+    source = os.path.join(src_dir, "index.h")
+    target = os.path.join(src_dir, "index_html_gz.h")
+
+    with open(source, "r", encoding="utf-8") as f:
+        match = RAW_STRING.search(f.read())
+    if match is None:
+        raise RuntimeError("INDEX_HTML raw string not found in " + source)
+
+    # mtime=0 keeps the output (and the ETag) stable between builds
+    data = gzip.compress(match.group(1).encode("utf-8"), compresslevel=9, mtime=0)
+    etag = hashlib.sha1(data).hexdigest()[:16]
+
+    lines = [
+        "// Generated by scripts/gzip_index.py from index.h, do not edit",
+        "#pragma once",
+        "",
+        "#include <Arduino.h>",
+        "",
+        '#define INDEX_HTML_GZ_ETAG "\\"%s\\""' % etag,
+        "",
+        "const uint8_t INDEX_HTML_GZ[] PROGMEM = {",
+    ]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines += ["};", "const size_t INDEX_HTML_GZ_LEN = sizeof(INDEX_HTML_GZ);", ""]
+    output = "\n".join(lines)
+
+    # Only touch the file when the page changed, to avoid needless rebuilds
+    if os.path.exists(target):
+        with open(target, "r", encoding="utf-8") as f:
+            if f.read() == output:
+                return
+    with open(target, "w", encoding="utf-8") as f:
+        f.write(output)
+    print("gzip_index: %d bytes -> %d bytes, ETag %s" % (len(match.group(1)), len(data), etag))
+
+
+try:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+    generate(env.subst("$PROJECT_SRC_DIR"))  # noqa: F821
+except NameError:
+    generate(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src"))
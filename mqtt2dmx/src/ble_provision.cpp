@@ -0,0 +1,130 @@
+#include "ble_provision.h"
+#include <ArduinoBLE.h>
+#include "log.h"
+
+static BLEService configService("1820");  // Using a standard service UUID for better visibility
+static BLEStringCharacteristic ssidCharacteristic("2ABE", BLERead | BLEWrite, 64);
+static BLEStringCharacteristic passwordCharacteristic("2AC4", BLERead | BLEWrite, 64);
+static BLECharacteristic quickCharacteristic("2AC5", BLEWrite | BLEWriteWithoutResponse, BLE_QUICK_MAX);
+
+static DmxUniverse* bleUniverse = nullptr;
+static BleCredentialsHandler credentialsHandler = nullptr;
+static bool started = false;
+static bool advertising = false;
+static uint8_t centrals = 0;
+static unsigned long startTime = 0;
+static unsigned long lastPoll = 0;
+
+// Track if both characteristics have been written
+static bool ssidWritten = false;
+static bool passwordWritten = false;
+
+static void credentialWritten() {
+    // If both have been written, hand them over
+    if (ssidWritten && passwordWritten && credentialsHandler != nullptr) {
+        LOG_INFO("Both credentials received, saving...");
+        credentialsHandler(ssidCharacteristic.value().c_str(), passwordCharacteristic.value().c_str());
+    }
+}
+
+static void onSsidWritten(BLEDevice central, BLECharacteristic characteristic) {
+    LOG_INFO("SSID Characteristic Written: %s", ssidCharacteristic.value().c_str());
+    ssidWritten = true;
+    credentialWritten();
+}
+
+static void onPasswordWritten(BLEDevice central, BLECharacteristic characteristic) {
+    LOG_INFO("Password Characteristic Written");
+    passwordWritten = true;
+    credentialWritten();
+}
+
+static void onQuickWritten(BLEDevice central, BLECharacteristic characteristic) {
+    const uint8_t* data = quickCharacteristic.value();
+    int length = quickCharacteristic.valueLength();
+    if (length < 3) return;
+
+    for (int i = 0; i + 3 <= length; i += 3) {
+        dmxUniverseSet(*bleUniverse, (data[i] << 8) | data[i + 1], data[i + 2]);
+    }
+    dmxUniverseCommit(*bleUniverse);
+}
+
+static void onConnected(BLEDevice central) {
+    LOG_INFO("BLE central connected: %s", central.address().c_str());
+    centrals++;
+}
+
+static void onDisconnected(BLEDevice central) {
+    LOG_INFO("BLE central disconnected");
+    if (centrals > 0) centrals--;
+}
+
+bool bleBegin(DmxUniverse& target, BleCredentialsHandler handler) {
+    bleUniverse = &target;
+    credentialsHandler = handler;
+
+    if (!BLE.begin()) {
+        LOG_ERROR("Starting BLE failed!");
+        return false;
+    }
+
+    // Set a more visible device name
+    BLE.setDeviceName("DMX Config");
+    BLE.setLocalName("DMX Config");
+
+    configService.addCharacteristic(ssidCharacteristic);
+    configService.addCharacteristic(passwordCharacteristic);
+    configService.addCharacteristic(quickCharacteristic);
+
+    ssidCharacteristic.setEventHandler(BLEWritten, onSsidWritten);
+    passwordCharacteristic.setEventHandler(BLEWritten, onPasswordWritten);
+    quickCharacteristic.setEventHandler(BLEWritten, onQuickWritten);
+    BLE.setEventHandler(BLEConnected, onConnected);
+    BLE.setEventHandler(BLEDisconnected, onDisconnected);
+
+    BLE.addService(configService);
+
+    // Set initial values
+    ssidCharacteristic.writeValue("Enter SSID");
+    passwordCharacteristic.writeValue("Enter Password");
+    ssidWritten = false;
+    passwordWritten = false;
+
+    BLE.setAdvertisedService(configService);
+    BLE.setConnectable(true);
+    BLE.setAdvertisingInterval(100);
+    BLE.advertise();
+    advertising = true;
+    started = true;
+    startTime = millis();
+
+    LOG_INFO("=== BLE Configuration ===");
+    LOG_INFO("Device MAC: %s", BLE.address().c_str());
+    LOG_INFO("Service UUID: 1820, SSID: 2ABE, password: 2AC4, quick control: 2AC5");
+    LOG_INFO("BLE advertising started. Look for 'DMX Config' device.");
+    return true;
+}
+
+void bleLoop(bool needed) {
+    if (!started) return;
+
+    unsigned long now = millis();
+    if (now - lastPoll < BLE_POLL_INTERVAL) return;
+    lastPoll = now;
+
+    // Advertising only while someone may want to connect
+    bool wanted = needed || now - startTime < BLE_BOOT_WINDOW;
+    if (wanted != advertising) {
+        if (wanted) {
+            BLE.advertise();
+        } else {
+            BLE.stopAdvertise();
+        }
+        advertising = wanted;
+        LOG_INFO("BLE advertising %s", wanted ? "resumed" : "stopped");
+    }
+
+    // Connection events arrive through the poll, so it goes on while advertising
+    if (advertising || centrals > 0) BLE.poll();
+}
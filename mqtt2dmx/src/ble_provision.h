@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+
+// BLE service for WiFi provisioning and quick channel control. Advertises as
+// "DMX Config" and exposes three characteristics:
+//   2ABE  SSID (string), 2AC4  password (string); once both are written the
+//         credentials handler is called
+//   2AC5  quick control, repeated [channel hi][channel lo][value] triplets,
+//         applied as one commit. Works without WiFi.
+//
+// The radio is shared with WiFi, so the service only advertises while it is
+// needed: during the first BLE_BOOT_WINDOW ms, whenever the caller asks for
+// it (no credentials, WiFi down) and while a central is connected.
+
+#define BLE_BOOT_WINDOW 60000
+#define BLE_POLL_INTERVAL 10   // ms between HCI polls
+#define BLE_QUICK_MAX 60       // Quick control bytes per write, 20 channels
+
+typedef void (*BleCredentialsHandler)(const char* ssid, const char* password);
+
+// Returns false if the BLE module did not start; bleLoop() is then a no-op
+bool bleBegin(DmxUniverse& target, BleCredentialsHandler handler);
+
+// One time slice: polls the HCI transport at most every BLE_POLL_INTERVAL.
+// Call it where a short stall cannot delay a frame, i.e. right after a frame
+// has been started. needed keeps advertising on past the boot window.
+void bleLoop(bool needed);
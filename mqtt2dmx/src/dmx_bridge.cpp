@@ -0,0 +1,76 @@
+#include "dmx_bridge.h"
+#include <string.h>
+
+int dmxDiffEncode(const uint8_t* values, const uint8_t* previous, uint16_t slots, uint8_t* out, uint16_t size) {
+    uint16_t n = 0;
+    uint16_t i = 0;
+    while (i < slots) {
+        if (values[i] == previous[i]) {
+            i++;
+            continue;
+        }
+
+        uint16_t last = i;
+        for (uint16_t end = i + 1; end < slots && end - i < 255; end++) {
+            if (values[end] != previous[end]) last = end;
+            else if (end - last > DMX_DIFF_GAP) break;
+        }
+        uint16_t count = last - i + 1;
+        if (n + 3 + count > size) return -1;
+        out[n++] = (i + 1) >> 8;
+        out[n++] = (i + 1) & 0xFF;
+        out[n++] = count;
+        memcpy(out + n, values + i, count);
+        n += count;
+        i = last + 1;
+    }
+    return n;
+}
+
+bool dmxDiffApply(DmxUniverse& universe, const uint8_t* data, uint16_t length) {
+    // Check every run first so a bad one leaves the universe alone
+    uint16_t n = 0;
+    while (n < length) {
+        if (length - n < 3) return false;
+        uint16_t start = (data[n] << 8) | data[n + 1];
+        uint8_t count = data[n + 2];
+        if (start < 1 || count == 0 || start + count - 1 > DMX_CHANNELS || length - n - 3 < count) return false;
+        n += 3 + count;
+    }
+
+    for (n = 0; n < length; n += 3 + data[n + 2]) {
+        dmxUniverseWrite(universe, (data[n] << 8) | data[n + 1], data + n + 3, data[n + 2]);
+    }
+    return true;
+}
+
+void dmxBridgeInit(DmxBridge& bridge, uint32_t interval) {
+    memset(&bridge, 0, sizeof(bridge));
+    bridge.interval = interval < DMX_BRIDGE_MIN_INTERVAL ? DMX_BRIDGE_MIN_INTERVAL : interval;
+}
+
+DmxBridgeUpdate dmxBridgeUpdate(DmxBridge& bridge, const uint8_t* values, uint16_t slots, uint32_t now,
+                                uint8_t* out, uint16_t size, uint16_t& length) {
+    length = 0;
+    if (slots == 0 || slots > DMX_CHANNELS) return BRIDGE_NONE;
+    if (bridge.slots != 0 && now - bridge.lastUpdate < bridge.interval) return BRIDGE_NONE;
+
+    int n = -1;
+    if (slots == bridge.slots && now - bridge.lastFull < DMX_BRIDGE_KEYFRAME) {
+        n = dmxDiffEncode(values, bridge.sent, slots, out, size);
+        if (n == 0) return BRIDGE_NONE;
+    }
+
+    memcpy(bridge.sent, values, slots);
+    bridge.lastUpdate = now;
+    if (n > 0) {
+        length = n;
+        bridge.deltas++;
+        return BRIDGE_DELTA;
+    }
+    bridge.slots = slots;
+    bridge.lastFull = now;
+    bridge.fulls++;
+    length = slots;
+    return BRIDGE_FULL;
+}
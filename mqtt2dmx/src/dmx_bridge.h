@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+
+// Changed-slot runs, used wherever a universe goes out as changes (WebSocket
+// push, the DMX input bridge, UDP_OP_DELTA and <base>/<u>/delta):
+//   [start channel hi] [start channel lo] [count] [value] ... repeated
+// A run carries up to DMX_DIFF_GAP unchanged slots rather than end and start
+// a new one, which would cost more than the values.
+
+#define DMX_DIFF_GAP 3
+
+// Runs of the slots in values that differ from previous into out. Returns
+// the length, 0 if nothing changed, -1 if the runs do not fit in size.
+int dmxDiffEncode(const uint8_t* values, const uint8_t* previous, uint16_t slots, uint8_t* out, uint16_t size);
+
+// Write runs into universe (not committed). False, with nothing written, if
+// a run is truncated or out of range.
+bool dmxDiffApply(DmxUniverse& universe, const uint8_t* data, uint16_t length);
+
+// Publishing a received universe: the bridge keeps what it sent last and
+// each update is the runs that changed since. Updates go out at most every
+// interval, with the changes in between coalesced, and every
+// DMX_BRIDGE_KEYFRAME (or when the frame length changes) the full universe
+// goes instead so late listeners and lost datagrams catch up.
+
+#define DMX_BRIDGE_INTERVAL 50     // ms, default
+#define DMX_BRIDGE_MIN_INTERVAL 20
+#define DMX_BRIDGE_KEYFRAME 5000   // ms
+
+enum DmxBridgeUpdate : uint8_t {
+    BRIDGE_NONE,
+    BRIDGE_DELTA,   // Runs, in the caller's buffer
+    BRIDGE_FULL     // All slots, in sent
+};
+
+struct DmxBridge {
+    uint8_t sent[DMX_CHANNELS];   // What listeners have now
+    uint16_t slots;               // Frame length of the last full update, 0 before the first
+    uint32_t interval;
+    uint32_t lastUpdate;
+    uint32_t lastFull;
+    unsigned long deltas;
+    unsigned long fulls;
+};
+
+void dmxBridgeInit(DmxBridge& bridge, uint32_t interval);
+
+// Compare a received frame with what was sent and decide what to send now.
+// BRIDGE_DELTA leaves length bytes of runs in out (size bytes; longer diffs
+// become a full update), BRIDGE_FULL length slots in bridge.sent. Either one
+// counts as sent.
+DmxBridgeUpdate dmxBridgeUpdate(DmxBridge& bridge, const uint8_t* values, uint16_t slots, uint32_t now,
+                                uint8_t* out, uint16_t size, uint16_t& length);
@@ -0,0 +1,196 @@
+#include "dmx_cues.h"
+#include <string.h>
+
+static inline uint16_t readU16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline void writeU16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static inline uint16_t toUnits(uint32_t ms) {
+    uint32_t units = (ms + CUE_TIME_UNIT / 2) / CUE_TIME_UNIT;
+    return units > 0xFFFF ? 0xFFFF : units;
+}
+
+static inline const uint8_t* cueRecord(const CueList& list, uint8_t cue) {
+    return list.data + list.offsets[cue];
+}
+
+static void clearList(CueList& list) {
+    list.length = 0;
+    list.count = 0;
+}
+
+bool dmxCueLoad(CueList& list, const uint8_t* data, uint16_t length) {
+    clearList(list);
+    if (length < CUE_HEADER_SIZE || length > CUE_LIST_MAX) return false;
+    if (data[0] != CUE_FORMAT_VERSION || data[2] > CUE_MAX) return false;
+
+    uint16_t pos = CUE_HEADER_SIZE;
+    for (uint8_t i = 0; i < data[2]; i++) {
+        if (pos + CUE_RECORD_SIZE > length) return false;
+        if (data[pos + 3] > FADE_EASE_IN_OUT) return false;
+        list.offsets[i] = pos;
+
+        uint8_t entries = data[pos + 8];
+        pos += CUE_RECORD_SIZE;
+        for (uint8_t e = 0; e < entries; e++) {
+            if (pos + 3 > length) return false;
+            uint16_t word = readU16(data + pos);
+            uint16_t channel = word & CUE_ENTRY_CHANNEL;
+            bool fine = word & CUE_ENTRY_FINE;
+            if (channel < 1 || channel + (fine ? 1 : 0) > DMX_CHANNELS) return false;
+            pos += fine ? 4 : 3;
+        }
+        if (pos > length) return false;
+    }
+    if (pos != length) return false;
+
+    if (data != list.data) {
+        memcpy(list.data, data, length);
+    }
+    list.length = length;
+    list.count = data[2];
+    return true;
+}
+
+void dmxCueListBegin(CueList& list, uint8_t listFlags) {
+    list.data[0] = CUE_FORMAT_VERSION;
+    list.data[1] = listFlags;
+    list.data[2] = 0;
+    list.length = CUE_HEADER_SIZE;
+    list.count = 0;
+}
+
+bool dmxCueAppend(CueList& list, uint8_t flags, uint8_t next, uint8_t repeat, DmxFadeCurve curve,
+                  uint32_t fadeMs, uint32_t holdMs) {
+    if (list.count >= CUE_MAX || list.length + CUE_RECORD_SIZE > CUE_LIST_MAX) return false;
+
+    uint8_t* p = list.data + list.length;
+    p[0] = flags;
+    p[1] = next;
+    p[2] = repeat;
+    p[3] = curve;
+    writeU16(p + 4, toUnits(fadeMs));
+    writeU16(p + 6, toUnits(holdMs));
+    p[8] = 0;
+
+    list.offsets[list.count++] = list.length;
+    list.length += CUE_RECORD_SIZE;
+    list.data[2] = list.count;
+    return true;
+}
+
+bool dmxCueAppendEntry(CueList& list, uint16_t channel, uint16_t value, bool fine, bool snap) {
+    uint16_t size = fine ? 4 : 3;
+    if (list.count == 0 || list.length + size > CUE_LIST_MAX) return false;
+    if (channel < 1 || channel + (fine ? 1 : 0) > DMX_CHANNELS) return false;
+
+    uint8_t* record = list.data + list.offsets[list.count - 1];
+    if (record[8] == 0xFF) return false;
+
+    uint8_t* p = list.data + list.length;
+    writeU16(p, channel | (fine ? CUE_ENTRY_FINE : 0) | (snap ? CUE_ENTRY_SNAP : 0));
+    if (fine) {
+        p[2] = value >> 8;
+        p[3] = value & 0xFF;
+    } else {
+        p[2] = value > 255 ? 255 : value;
+    }
+
+    record[8]++;
+    list.length += size;
+    return true;
+}
+
+static void startCue(CuePlayer& player, uint8_t cue, uint32_t now) {
+    const uint8_t* record = cueRecord(*player.list, cue);
+    DmxFadeCurve curve = (DmxFadeCurve)record[3];
+    uint32_t fadeMs = (uint32_t)readU16(record + 4) * CUE_TIME_UNIT;
+    uint32_t holdMs = (uint32_t)readU16(record + 6) * CUE_TIME_UNIT;
+
+    player.current = cue;
+    player.cueStart = now;
+    player.cueLength = fadeMs + holdMs;
+    player.waiting = false;
+
+    const uint8_t* p = record + CUE_RECORD_SIZE;
+    for (uint8_t e = 0; e < record[8]; e++) {
+        uint16_t word = readU16(p);
+        bool fine = word & CUE_ENTRY_FINE;
+        uint16_t value = fine ? (p[2] << 8) | p[3] : p[2];
+        dmxFadeStart(*player.fades, *player.universe, word & CUE_ENTRY_CHANNEL, value,
+                     (word & CUE_ENTRY_SNAP) ? 0 : fadeMs, curve, fine, now);
+        p += fine ? 4 : 3;
+    }
+}
+
+// Cue to play after the current one, -1 at the end of the show
+static int nextCue(CuePlayer& player) {
+    const CueList& list = *player.list;
+    const uint8_t* record = cueRecord(list, player.current);
+    uint8_t next = record[1];
+    uint8_t repeat = record[2];
+
+    if (next != CUE_NEXT_FOLLOWING && next < list.count) {
+        if (repeat == 0) return next;
+        if (player.repeats[player.current] < repeat) {
+            player.repeats[player.current]++;
+            return next;
+        }
+        // Loop done, rearm it in case an outer loop comes back here
+        player.repeats[player.current] = 0;
+    }
+
+    if (player.current + 1 < list.count) return player.current + 1;
+    return (list.data[1] & CUE_LIST_LOOP) ? 0 : -1;
+}
+
+static void advance(CuePlayer& player, uint32_t now) {
+    int next = nextCue(player);
+    if (next < 0) {
+        player.running = false;
+        return;
+    }
+    startCue(player, next, now);
+}
+
+void dmxCueBegin(CuePlayer& player, const CueList& list, DmxFadeEngine& fades, const DmxUniverse& universe) {
+    player.list = &list;
+    player.fades = &fades;
+    player.universe = &universe;
+    player.running = false;
+    player.waiting = false;
+}
+
+void dmxCuePlay(CuePlayer& player, uint8_t cue, uint32_t now) {
+    if (player.list == nullptr || cue >= player.list->count) return;
+
+    memset(player.repeats, 0, sizeof(player.repeats));
+    player.running = true;
+    startCue(player, cue, now);
+}
+
+void dmxCueStop(CuePlayer& player) {
+    player.running = false;
+    player.waiting = false;
+}
+
+void dmxCueGo(CuePlayer& player, uint32_t now) {
+    if (!player.running) return;
+    advance(player, now);
+}
+
+void dmxCueTick(CuePlayer& player, uint32_t now) {
+    if (!player.running || player.waiting) return;
+    if (now - player.cueStart < player.cueLength) return;
+
+    if (cueRecord(*player.list, player.current)[0] & CUE_WAIT_GO) {
+        player.waiting = true;
+        return;
+    }
+    advance(player, now);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+#include "dmx_fade.h"
+
+// Cue list sequencer. A show is a compact binary cue list played back on the
+// device from the frame tick, so timing does not depend on the network.
+//
+// Format, little endian:
+//   header  [version = CUE_FORMAT_VERSION] [list flags] [cue count]
+//   cue     [flags] [next] [repeat] [curve] [fade u16] [hold u16] [entry count]
+//           followed by entry count entries
+//   entry   [channel u16] [value], or [channel u16] [value hi] [value lo] when
+//           CUE_ENTRY_FINE is set in the channel word
+//
+// A cue fades only the channels it lists (its channel mask) over the fade
+// time, then holds. Times are in units of CUE_TIME_UNIT ms. After the hold the
+// player goes to cue "next" (CUE_NEXT_FOLLOWING for the one after it); with a
+// non-zero repeat the jump is taken that many times before falling through, so
+// loops are expressed as a jump back. Cues flagged CUE_WAIT_GO stop after the
+// hold until dmxCueGo() is called.
+
+#define CUE_FORMAT_VERSION 1
+#define CUE_LIST_MAX 1024       // Bytes of cue data
+#define CUE_MAX 64
+#define CUE_TIME_UNIT 10        // ms per stored time unit
+
+#define CUE_LIST_LOOP 0x01      // Wrap to cue 0 after the last cue
+
+#define CUE_WAIT_GO 0x01        // Wait for a trigger after the hold
+#define CUE_NEXT_FOLLOWING 0xFF
+
+#define CUE_ENTRY_FINE 0x8000   // 16-bit value over channel and channel + 1
+#define CUE_ENTRY_SNAP 0x4000   // Jump at the start of the cue instead of fading
+#define CUE_ENTRY_CHANNEL 0x03FF
+
+#define CUE_HEADER_SIZE 3
+#define CUE_RECORD_SIZE 9
+
+struct CueList {
+    uint8_t data[CUE_LIST_MAX];
+    uint16_t length;
+    uint8_t count;
+    uint16_t offsets[CUE_MAX]; // Start of every cue record in data
+};
+
+struct CuePlayer {
+    const CueList* list;
+    DmxFadeEngine* fades;
+    const DmxUniverse* universe;
+    bool running;
+    bool waiting;        // Held on a CUE_WAIT_GO cue
+    uint8_t current;
+    uint32_t cueStart;   // ms
+    uint32_t cueLength;  // Fade plus hold, ms
+    uint8_t repeats[CUE_MAX]; // Jumps taken per cue
+};
+
+// Validate a cue list and index it. Returns false, leaving list empty, if the
+// data is malformed.
+bool dmxCueLoad(CueList& list, const uint8_t* data, uint16_t length);
+
+// Build a list in place: start it, append cues and their entries in order.
+// The appends return false once CUE_LIST_MAX or CUE_MAX is reached.
+void dmxCueListBegin(CueList& list, uint8_t listFlags);
+bool dmxCueAppend(CueList& list, uint8_t flags, uint8_t next, uint8_t repeat, DmxFadeCurve curve,
+                  uint32_t fadeMs, uint32_t holdMs);
+bool dmxCueAppendEntry(CueList& list, uint16_t channel, uint16_t value, bool fine, bool snap);
+
+void dmxCueBegin(CuePlayer& player, const CueList& list, DmxFadeEngine& fades, const DmxUniverse& universe);
+
+// Start playback at cue; ignored if the list has no such cue
+void dmxCuePlay(CuePlayer& player, uint8_t cue, uint32_t now);
+void dmxCueStop(CuePlayer& player);
+
+// Trigger: move on to the next cue now, even mid-fade or mid-hold
+void dmxCueGo(CuePlayer& player, uint32_t now);
+
+// Call once per frame, before dmxFadeTick()
+void dmxCueTick(CuePlayer& player, uint32_t now);
@@ -0,0 +1,74 @@
+#include "dmx_demo.h"
+
+static const char* const lightAttributes[6] = { "dimmer", "strobe", "red", "green", "blue", "white" };
+
+struct DemoTargets {
+    PatchTarget pan, tilt, speed, lights[6];
+};
+
+static bool resolveTargets(const DmxPatch& patch, DemoTargets& t) {
+    bool patched = dmxPatchResolveAttribute(patch, 0, "pan", t.pan) &&
+                   dmxPatchResolveAttribute(patch, 0, "tilt", t.tilt) &&
+                   dmxPatchResolveAttribute(patch, 0, "speed", t.speed);
+    for (int i = 0; i < 6; i++) {
+        patched = patched && dmxPatchResolveAttribute(patch, 0, lightAttributes[i], t.lights[i]);
+    }
+    return patched && t.pan.universe == 0;
+}
+
+static inline uint16_t entrySize(const PatchTarget& target) {
+    return target.fine ? 4 : 3;
+}
+
+// Three cues per preset: lights out, move, lights in
+static int checkTargets(const DemoTargets& t, uint8_t count) {
+    uint16_t lights = 0;
+    for (int i = 0; i < 6; i++) lights += entrySize(t.lights[i]);
+    uint16_t perPreset = 3 * CUE_RECORD_SIZE + 2 * lights + entrySize(t.pan) + entrySize(t.tilt) + 3;
+    if (3 * count > CUE_MAX || CUE_HEADER_SIZE + (uint32_t)count * perPreset > CUE_LIST_MAX) return DEMO_TOO_LONG;
+    return count;
+}
+
+int dmxDemoCheck(const DmxPatch& patch, uint8_t count) {
+    DemoTargets targets;
+    if (!resolveTargets(patch, targets)) return DEMO_NOT_PATCHED;
+    return checkTargets(targets, count);
+}
+
+int dmxDemoBuild(CueList& show, const DmxPatch& patch, const DemoPreset* presets, uint8_t count,
+                 uint32_t moveDelay, uint32_t holdTime) {
+    DemoTargets targets;
+    if (!resolveTargets(patch, targets)) return DEMO_NOT_PATCHED;
+    int checked = checkTargets(targets, count);
+    if (checked < 0) return checked;
+    const PatchTarget& pan = targets.pan;
+    const PatchTarget& tilt = targets.tilt;
+    const PatchTarget& speed = targets.speed;
+    const PatchTarget* lights = targets.lights;
+
+    dmxCueListBegin(show, CUE_LIST_LOOP);
+
+    for (uint8_t p = 0; p < count; p++) {
+        const uint8_t* values = presets[p].values;
+
+        bool ok = dmxCueAppend(show, 0, CUE_NEXT_FOLLOWING, 0, FADE_LINEAR, DEMO_FADE_TIME, 0);
+        for (int i = 0; i < 6; i++) {
+            ok = ok && dmxCueAppendEntry(show, lights[i].channel, 0, lights[i].fine, false);
+        }
+
+        uint16_t panValue = (values[0] << 8) | values[1];
+        uint16_t tiltValue = (values[2] << 8) | values[3];
+        ok = ok && dmxCueAppend(show, 0, CUE_NEXT_FOLLOWING, 0, FADE_EASE_IN_OUT, moveDelay, 0);
+        ok = ok && dmxCueAppendEntry(show, pan.channel, pan.fine ? panValue : panValue >> 8, pan.fine, false);
+        ok = ok && dmxCueAppendEntry(show, tilt.channel, tilt.fine ? tiltValue : tiltValue >> 8, tilt.fine, false);
+        ok = ok && dmxCueAppendEntry(show, speed.channel, values[4], false, true);
+
+        ok = ok && dmxCueAppend(show, 0, CUE_NEXT_FOLLOWING, 0, FADE_LINEAR, DEMO_FADE_TIME, holdTime);
+        for (int i = 0; i < 6; i++) {
+            ok = ok && dmxCueAppendEntry(show, lights[i].channel, values[5 + i], lights[i].fine, false);
+        }
+
+        if (!ok) return DEMO_TOO_LONG;
+    }
+    return count;
+}
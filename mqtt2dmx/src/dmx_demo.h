@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_cues.h"
+#include "dmx_patch.h"
+
+// The web UI's demo mode, compiled into a looping cue list for the first
+// fixture in the patch. For every preset: fade the colors out, move pan and
+// tilt, fade the preset colors in and hold.
+
+#define DEMO_MAX_PRESETS 10
+#define DEMO_PRESET_VALUES 11
+#define DEMO_FADE_TIME 5000 // Color fades, ms
+
+// Values in the web UI's slider order: pan, pan fine, tilt, tilt fine, speed,
+// dimmer, strobe, red, green, blue, white
+struct DemoPreset {
+    uint8_t values[DEMO_PRESET_VALUES];
+};
+
+#define DEMO_NOT_PATCHED -1 // The first fixture is not a moving head on universe 1
+#define DEMO_TOO_LONG -2    // The cues do not fit the list
+
+// What dmxDemoBuild() would return, without touching a show
+int dmxDemoCheck(const DmxPatch& patch, uint8_t count);
+
+// Replace show with the demo. Returns the number of presets compiled or one
+// of the errors above, in which case show is left as it was.
+int dmxDemoBuild(CueList& show, const DmxPatch& patch, const DemoPreset* presets, uint8_t count,
+                 uint32_t moveDelay, uint32_t holdTime);
@@ -0,0 +1,150 @@
+#include "dmx_effects.h"
+#include <string.h>
+
+// 128 + 127.5 * sin(2 * pi * i / 256)
+static const uint8_t sineTable[256] = {
+    128, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162, 165, 167, 170, 173,
+    176, 179, 182, 185, 188, 190, 193, 196, 198, 201, 203, 206, 208, 211, 213, 215,
+    218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+    245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+    255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+    245, 244, 243, 241, 240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+    218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190, 188, 185, 182, 179,
+    176, 173, 170, 167, 165, 162, 158, 155, 152, 149, 146, 143, 140, 137, 134, 131,
+    128, 124, 121, 118, 115, 112, 109, 106, 103, 100,  97,  93,  90,  88,  85,  82,
+     79,  76,  73,  70,  67,  65,  62,  59,  57,  54,  52,  49,  47,  44,  42,  40,
+     37,  35,  33,  31,  29,  27,  25,  23,  21,  20,  18,  17,  15,  14,  12,  11,
+     10,   9,   7,   6,   5,   5,   4,   3,   2,   2,   1,   1,   1,   0,   0,   0,
+      0,   0,   0,   0,   1,   1,   1,   2,   2,   3,   4,   5,   5,   6,   7,   9,
+     10,  11,  12,  14,  15,  17,  18,  20,  21,  23,  25,  27,  29,  31,  33,  35,
+     37,  40,  42,  44,  47,  49,  52,  54,  57,  59,  62,  65,  67,  70,  73,  76,
+     79,  82,  85,  88,  90,  93,  97, 100, 103, 106, 109, 112, 115, 118, 121, 124,
+};
+
+// One color component over the hue circle at full saturation and value: up
+// over the first sixth, full for two sixths, down for one. Green reads it at
+// the hue, red a third ahead and blue a third behind.
+static const uint8_t hueTable[256] = {
+      0,   6,  12,  18,  24,  30,  36,  42,  48,  54,  60,  66,  72,  78,  84,  90,
+     96, 102, 108, 114, 120, 126, 131, 137, 143, 149, 155, 161, 167, 173, 179, 185,
+    191, 197, 203, 209, 215, 221, 227, 233, 239, 245, 251, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 249, 243, 237, 231, 225, 219, 213, 207, 201, 195, 189, 183, 177, 171, 165,
+    159, 153, 147, 141, 135, 129, 124, 118, 112, 106, 100,  94,  88,  82,  76,  70,
+     64,  58,  52,  46,  40,  34,  28,  22,  16,  10,   4,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+// base + amplitude * wave / 255, without the division
+static inline uint8_t scale(const DmxEffectParams& params, uint8_t wave) {
+    uint32_t value = params.base + ((params.amplitude * wave * 257 + 0x8000) >> 16);
+    return value > 255 ? 255 : value;
+}
+
+static void renderEffect(const DmxEffect& effect, DmxUniverse& universe) {
+    const DmxEffectParams& params = effect.params;
+    uint8_t phase = (effect.phase >> 24) + params.offset;
+    uint16_t width = params.type == EFFECT_RAINBOW ? 3 : 1;
+
+    for (uint8_t i = 0; i < params.count; i++) {
+        uint16_t channel = params.channel + i * params.stride;
+        if (channel + width - 1 > DMX_CHANNELS) break;
+
+        // Later elements lag behind, so waves and chases travel up the range
+        uint8_t p = params.type == EFFECT_STROBE ? phase : phase - i * params.spread;
+        switch (params.type) {
+            case EFFECT_SINE:
+                dmxUniverseSet(universe, channel, scale(params, sineTable[p]));
+                break;
+            case EFFECT_CHASE:
+            case EFFECT_STROBE:
+                dmxUniverseSet(universe, channel, scale(params, p < params.duty ? 255 : 0));
+                break;
+            case EFFECT_RAINBOW:
+                dmxUniverseSet(universe, channel, scale(params, hueTable[(uint8_t)(p + 85)]));
+                dmxUniverseSet(universe, channel + 1, scale(params, hueTable[p]));
+                dmxUniverseSet(universe, channel + 2, scale(params, hueTable[(uint8_t)(p - 85)]));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void dmxEffectsInit(DmxEffectEngine& engine) {
+    memset(engine.effects, 0, sizeof(engine.effects));
+    engine.lastTick = 0;
+    engine.active = 0;
+}
+
+int dmxEffectStart(DmxEffectEngine& engine, const DmxEffectParams& params) {
+    if (params.type == EFFECT_NONE || params.type > EFFECT_RAINBOW) return -1;
+    if (params.channel < 1 || params.channel > DMX_CHANNELS || params.count == 0) return -1;
+
+    int slot = -1;
+    for (int i = 0; i < DMX_EFFECT_SLOTS; i++) {
+        const DmxEffectParams& running = engine.effects[i].params;
+        if (running.type != EFFECT_NONE && running.channel == params.channel) {
+            slot = i;
+            break;
+        }
+        if (running.type == EFFECT_NONE && slot < 0) slot = i;
+    }
+    if (slot < 0) return -1;
+
+    DmxEffect& effect = engine.effects[slot];
+    if (effect.params.type == EFFECT_NONE) engine.active++;
+    effect.params = params;
+    if (effect.params.stride == 0) effect.params.stride = params.type == EFFECT_RAINBOW ? 3 : 1;
+    effect.phase = 0;
+    // 2^32 per cycle, rate is in 1/100 Hz: 2^32 / 100000 per ms and cHz
+    effect.phaseRate = (uint32_t)(((uint64_t)params.rate << 32) / 100000);
+    return slot;
+}
+
+void dmxEffectStop(DmxEffectEngine& engine, int slot) {
+    if (slot < 0 || slot >= DMX_EFFECT_SLOTS) return;
+    if (engine.effects[slot].params.type == EFFECT_NONE) return;
+    engine.effects[slot].params.type = EFFECT_NONE;
+    engine.active--;
+}
+
+void dmxEffectStopAll(DmxEffectEngine& engine) {
+    for (int i = 0; i < DMX_EFFECT_SLOTS; i++) {
+        engine.effects[i].params.type = EFFECT_NONE;
+    }
+    engine.active = 0;
+}
+
+bool dmxEffectsTick(DmxEffectEngine& engine, DmxUniverse& universe, uint32_t now) {
+    uint32_t elapsed = now - engine.lastTick;
+    engine.lastTick = now;
+    if (engine.active == 0) return false;
+
+    for (int i = 0; i < DMX_EFFECT_SLOTS; i++) {
+        DmxEffect& effect = engine.effects[i];
+        if (effect.params.type == EFFECT_NONE) continue;
+        effect.phase += elapsed * effect.phaseRate;
+        renderEffect(effect, universe);
+    }
+
+    dmxUniverseCommit(universe);
+    return true;
+}
+
+DmxEffectType dmxEffectTypeFromName(const char* name) {
+    if (name == nullptr) return EFFECT_NONE;
+    if (strcmp(name, "sine") == 0) return EFFECT_SINE;
+    if (strcmp(name, "chase") == 0) return EFFECT_CHASE;
+    if (strcmp(name, "strobe") == 0) return EFFECT_STROBE;
+    if (strcmp(name, "rainbow") == 0) return EFFECT_RAINBOW;
+    return EFFECT_NONE;
+}
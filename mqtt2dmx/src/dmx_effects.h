@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+
+// On-device effect generators. An effect drives count elements starting at
+// channel, stride channels apart, and is evaluated every frame from a 32-bit
+// phase accumulator and lookup tables (sine, hue ramp), so a running chase or
+// rainbow costs no network traffic at all.
+//
+// Every element sees the phase offset - i * spread (1/256 of a cycle each) and
+// outputs base + amplitude * wave:
+//   sine     smooth 0-255 sine wave
+//   chase    on for the first duty/256 of the cycle; spread 256/count runs
+//            one lit element along the range
+//   strobe   the same square wave, every element in step
+//   rainbow  hue sweep; each element is an RGB triple at its channel
+
+#define DMX_EFFECT_SLOTS 8
+
+enum DmxEffectType : uint8_t {
+    EFFECT_NONE,
+    EFFECT_SINE,
+    EFFECT_CHASE,
+    EFFECT_STROBE,
+    EFFECT_RAINBOW
+};
+
+struct DmxEffectParams {
+    DmxEffectType type;
+    uint16_t channel;     // First channel of the first element
+    uint8_t count;        // Number of elements
+    uint8_t stride;       // Channels from one element to the next
+    uint16_t rate;        // Cycles per second, in 1/100 Hz
+    uint8_t offset;       // Phase of the first element, 1/256 cycle
+    uint8_t spread;       // Phase step between elements, 1/256 cycle
+    uint8_t base;
+    uint8_t amplitude;
+    uint8_t duty;         // On time of chase/strobe, 1/256 cycle
+};
+
+struct DmxEffect {
+    DmxEffectParams params;
+    uint32_t phase;       // Full 32 bits = one cycle
+    uint32_t phaseRate;   // Phase advance per ms
+};
+
+struct DmxEffectEngine {
+    DmxEffect effects[DMX_EFFECT_SLOTS];
+    uint32_t lastTick;
+    uint8_t active;
+};
+
+void dmxEffectsInit(DmxEffectEngine& engine);
+
+// Returns the slot the effect runs in, or -1 if the parameters are invalid or
+// every slot is busy. An effect on the same first channel is replaced.
+int dmxEffectStart(DmxEffectEngine& engine, const DmxEffectParams& params);
+void dmxEffectStop(DmxEffectEngine& engine, int slot);
+void dmxEffectStopAll(DmxEffectEngine& engine);
+
+// Call once per frame, after the fades. Writes every running effect into the
+// universe and commits; returns true if anything was written.
+bool dmxEffectsTick(DmxEffectEngine& engine, DmxUniverse& universe, uint32_t now);
+
+// "sine", "chase", "strobe", "rainbow"; EFFECT_NONE for anything else
+DmxEffectType dmxEffectTypeFromName(const char* name);
@@ -0,0 +1,116 @@
+#include "dmx_fade.h"
+#include <string.h>
+
+// Shape a Q16 progress value (0-65535), all products fit in 32 bits
+static uint32_t applyCurve(DmxFadeCurve curve, uint32_t p) {
+    switch (curve) {
+        case FADE_EASE_IN:
+            return (p * p) >> 16;
+        case FADE_EASE_OUT: {
+            uint32_t inv = 65535 - p;
+            return 65535 - ((inv * inv) >> 16);
+        }
+        case FADE_EASE_IN_OUT: {
+            uint32_t p2 = (p * p) >> 16;
+            return (p2 * ((3 * 65536 - 2 * p) >> 2)) >> 14;
+        }
+        default:
+            return p;
+    }
+}
+
+static uint16_t currentValue(const DmxUniverse& universe, uint16_t channel, bool fine) {
+    uint16_t coarse = dmxUniverseGet(universe, channel);
+    return fine ? (coarse << 8) | dmxUniverseGet(universe, channel + 1) : coarse << 8;
+}
+
+static void writeValue(DmxUniverse& universe, const DmxFade& fade, uint16_t value) {
+    if (fade.fine) {
+        dmxUniverseSet(universe, fade.channel, value >> 8);
+        dmxUniverseSet(universe, fade.channel + 1, value & 0xFF);
+    } else {
+        // 8-bit fades never exceed 0xFF00, so rounding cannot overflow
+        dmxUniverseSet(universe, fade.channel, (value + 0x80) >> 8);
+    }
+}
+
+static DmxFade* findFade(DmxFadeEngine& engine, uint16_t channel) {
+    for (int i = 0; i < DMX_FADE_SLOTS; i++) {
+        if (engine.fades[i].channel == channel) return &engine.fades[i];
+    }
+    return nullptr;
+}
+
+void dmxFadeInit(DmxFadeEngine& engine) {
+    memset(engine.fades, 0, sizeof(engine.fades));
+    engine.active = 0;
+}
+
+bool dmxFadeStart(DmxFadeEngine& engine, const DmxUniverse& universe, uint16_t channel, uint16_t target,
+                  uint32_t durationMs, DmxFadeCurve curve, bool fine, uint32_t now) {
+    if (channel < 1 || channel + (fine ? 1 : 0) > DMX_CHANNELS) return false;
+    if (!fine && target > 255) target = 255;
+
+    DmxFade* fade = findFade(engine, channel);
+    if (fade == nullptr) {
+        fade = findFade(engine, 0);
+        if (fade == nullptr) return false;
+        engine.active++;
+    }
+
+    fade->channel = channel;
+    fade->fine = fine;
+    fade->curve = curve;
+    fade->from = currentValue(universe, channel, fine);
+    fade->to = fine ? target : target << 8;
+    fade->startTime = now;
+    fade->duration = durationMs;
+    fade->rate = durationMs > 0 ? 0xFFFFFFFFUL / durationMs : 0;
+    return true;
+}
+
+void dmxFadeStop(DmxFadeEngine& engine, uint16_t channel) {
+    if (channel == 0) return;
+    DmxFade* fade = findFade(engine, channel);
+    if (fade != nullptr) {
+        fade->channel = 0;
+        engine.active--;
+    }
+}
+
+void dmxFadeStopAll(DmxFadeEngine& engine) {
+    dmxFadeInit(engine);
+}
+
+bool dmxFadeTick(DmxFadeEngine& engine, DmxUniverse& universe, uint32_t now) {
+    if (engine.active == 0) return false;
+
+    for (int i = 0; i < DMX_FADE_SLOTS; i++) {
+        DmxFade& fade = engine.fades[i];
+        if (fade.channel == 0) continue;
+
+        uint32_t elapsed = now - fade.startTime;
+        if (elapsed >= fade.duration) {
+            writeValue(universe, fade, fade.to);
+            fade.channel = 0;
+            engine.active--;
+            continue;
+        }
+
+        // elapsed < duration, so elapsed * rate stays below 2^32
+        uint32_t progress = applyCurve(fade.curve, (elapsed * fade.rate) >> 16);
+        int32_t delta = (int32_t)fade.to - (int32_t)fade.from;
+        writeValue(universe, fade, fade.from + (int32_t)(((int64_t)delta * progress) >> 16));
+    }
+
+    dmxUniverseCommit(universe);
+    return true;
+}
+
+DmxFadeCurve dmxFadeCurveFromName(const char* name) {
+    if (name == nullptr) return FADE_LINEAR;
+    if (strcmp(name, "in") == 0) return FADE_EASE_IN;
+    if (strcmp(name, "out") == 0) return FADE_EASE_OUT;
+    if (strcmp(name, "inout") == 0) return FADE_EASE_IN_OUT;
+    return FADE_LINEAR;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+
+// Per-channel fade engine. A fixed pool of fade slots is advanced once per DMX
+// frame in Q16 fixed point: every active slot costs two multiplies and a
+// shift, with the division done once when the fade starts. Fades can be 8-bit
+// (one channel) or 16-bit (coarse at channel, fine at channel + 1), so
+// pan/tilt move as smoothly as the fixture allows.
+
+#define DMX_FADE_SLOTS 32
+
+enum DmxFadeCurve : uint8_t {
+    FADE_LINEAR,
+    FADE_EASE_IN,      // Quadratic, slow start
+    FADE_EASE_OUT,     // Quadratic, slow end
+    FADE_EASE_IN_OUT   // Smoothstep
+};
+
+struct DmxFade {
+    uint16_t channel;    // First channel, 0 = slot unused
+    bool fine;           // 16-bit fade over channel and channel + 1
+    DmxFadeCurve curve;
+    uint16_t from;       // 16-bit values; 8-bit fades use value << 8
+    uint16_t to;
+    uint32_t startTime;  // ms
+    uint32_t duration;   // ms
+    uint32_t rate;       // Q32 progress per ms, 0xFFFFFFFF / duration
+};
+
+struct DmxFadeEngine {
+    DmxFade fades[DMX_FADE_SLOTS];
+    uint8_t active;
+};
+
+void dmxFadeInit(DmxFadeEngine& engine);
+
+// Fade channel from its current value to target over durationMs. target is
+// 0-255, or 0-65535 when fine is set. A fade already running on the channel is
+// replaced and continues from where it got to. Duration 0 jumps on the next
+// tick. Returns false if the channel is out of range or all slots are busy.
+bool dmxFadeStart(DmxFadeEngine& engine, const DmxUniverse& universe, uint16_t channel, uint16_t target,
+                  uint32_t durationMs, DmxFadeCurve curve, bool fine, uint32_t now);
+
+// Leave the channel at its current value
+void dmxFadeStop(DmxFadeEngine& engine, uint16_t channel);
+void dmxFadeStopAll(DmxFadeEngine& engine);
+
+// Call once per frame, before the universe is flipped. Writes every running
+// fade into the universe and commits; returns true if anything was written.
+bool dmxFadeTick(DmxFadeEngine& engine, DmxUniverse& universe, uint32_t now);
+
+// "linear", "in", "out" or "inout"; anything else is linear
+DmxFadeCurve dmxFadeCurveFromName(const char* name);
@@ -0,0 +1,171 @@
+#include "dmx_failsafe.h"
+#include <string.h>
+#include <stddef.h>
+
+static inline bool reached(uint32_t now, uint32_t time) {
+    return (int32_t)(now - time) >= 0;
+}
+
+void dmxFailsafeInit(DmxFailsafe& failsafe) {
+    memset(&failsafe, 0, sizeof(failsafe));
+    dmxFailsafeConfigure(failsafe, FAILSAFE_HOLD, 0, FAILSAFE_DELAY, FAILSAFE_FADE);
+}
+
+void dmxFailsafeConfigure(DmxFailsafe& failsafe, DmxFailsafePolicy policy, uint8_t preset, uint32_t delay,
+                          uint32_t fadeMs) {
+    failsafe.policy = policy <= FAILSAFE_BLACKOUT ? policy : FAILSAFE_HOLD;
+    failsafe.preset = preset < PRESET_SLOTS ? preset : 0;
+    failsafe.delay = delay;
+    failsafe.fadeMs = fadeMs;
+}
+
+void dmxFailsafeResume(DmxFailsafe& failsafe, const uint16_t* slots, uint8_t count, uint32_t now) {
+    for (uint8_t u = 0; u < count && u < DMX_UNIVERSES; u++) failsafe.slots[u] = slots[u];
+    failsafe.active = true;
+    failsafe.fading = false;
+    failsafe.fadeEnd = now;
+    failsafe.lastTick = now;
+    failsafe.networkChanged = now;
+    failsafe.engaged++;
+}
+
+// Copy what is going out into the layers, taking every slot, and start the
+// fade from it
+static void engage(DmxFailsafe& failsafe, DmxUniverse* layers, const DmxUniverse* outputs, uint8_t count,
+                   const DmxPresetBank& presets, uint32_t now) {
+    const DmxPreset& scene = presets.presets[failsafe.preset];
+    for (uint8_t u = 0; u < count && u < DMX_UNIVERSES; u++) {
+        uint16_t slots = dmxUniverseSlotCount(outputs[u]);
+        // The safe scene may reach beyond the frame
+        if (failsafe.policy == FAILSAFE_SCENE && scene.count > 0 && scene.universe == u &&
+            scene.channel + scene.count - 1 > slots) {
+            slots = scene.channel + scene.count - 1;
+        }
+        memcpy(dmxUniverseReserve(layers[u], 1, slots), dmxUniverseValues(outputs[u]), slots);
+        failsafe.slots[u] = slots;
+    }
+    failsafe.active = true;
+    failsafe.fading = failsafe.policy != FAILSAFE_HOLD;
+    failsafe.fadeEnd = now + (failsafe.policy == FAILSAFE_HOLD ? 0 : failsafe.fadeMs);
+    failsafe.lastTick = now;
+    failsafe.engaged++;
+}
+
+// Move every slot the same fraction of the way to its target that the time
+// since the last tick is of the time left, so it lands on it at fadeEnd
+static void fade(const DmxFailsafe& failsafe, const uint8_t* values, uint8_t* out, uint16_t slots, uint8_t u,
+                 const DmxPresetBank& presets, uint32_t now) {
+    const DmxPreset& scene = presets.presets[failsafe.preset];
+    uint16_t first = 0;
+    uint16_t last = 0; // Past the end
+    if (failsafe.policy == FAILSAFE_SCENE && scene.count > 0 && scene.universe == u) {
+        first = scene.channel - 1;
+        last = first + scene.count;
+    }
+
+    bool done = reached(now, failsafe.fadeEnd);
+    int32_t left = done ? 0 : (int32_t)(failsafe.fadeEnd - now);
+    int32_t before = (int32_t)(failsafe.fadeEnd - failsafe.lastTick);
+    if (before < 1) before = 1;
+    for (uint16_t i = 0; i < slots; i++) {
+        int32_t target = i >= first && i < last ? scene.values[i - first] : 0;
+        out[i] = done ? target : target + (values[i] - target) * left / before;
+    }
+}
+
+// Rewrite a layer as it is: the commit keeps its source live in the merge
+// without taking any slot
+static void keepLive(DmxUniverse& layer, uint16_t slots) {
+    if (slots == 0) return;
+    dmxUniverseWrite(layer, 1, dmxUniverseValues(layer), slots);
+    dmxUniverseCommit(layer);
+}
+
+void dmxFailsafeTick(DmxFailsafe& failsafe, bool networkUp, DmxUniverse* layers, DmxUniverse* networkLayers,
+                     const DmxUniverse* outputs, uint8_t count, const DmxPresetBank& presets, uint32_t now) {
+    if (networkUp != failsafe.networkUp) {
+        failsafe.networkUp = networkUp;
+        failsafe.networkChanged = now;
+        if (networkUp) failsafe.networkSeen = true;
+    }
+
+    uint32_t since = now - failsafe.networkChanged;
+    if (networkUp) {
+        // Held while the senders come back
+        failsafe.fading = false;
+        if (failsafe.active && since >= FAILSAFE_RECOVER_DELAY) failsafe.active = false;
+        if (!failsafe.active) return; // No more commits, so the layers time out of the merge
+    } else if (!failsafe.active) {
+        if (!failsafe.networkSeen) return;
+        if (since < failsafe.delay) {
+            // Until the policy applies, what the network sent stays
+            for (uint8_t u = 0; u < count && u < DMX_UNIVERSES; u++) {
+                keepLive(networkLayers[u], networkLayers[u].highestChannel);
+            }
+            return;
+        }
+        engage(failsafe, layers, outputs, count, presets, now);
+    }
+
+    // The fade writes only the slots it moves, which it takes back
+    for (uint8_t u = 0; u < count && u < DMX_UNIVERSES; u++) {
+        uint16_t slots = failsafe.slots[u];
+        if (slots == 0) continue;
+        if (failsafe.fading) {
+            fade(failsafe, dmxUniverseValues(layers[u]), dmxScratch, slots, u, presets, now);
+            dmxUniverseWrite(layers[u], 1, dmxScratch, slots);
+            dmxUniverseCommit(layers[u]);
+        } else {
+            keepLive(layers[u], slots);
+        }
+    }
+    failsafe.lastTick = now;
+    if (reached(now, failsafe.fadeEnd)) failsafe.fading = false;
+}
+
+DmxFailsafePolicy dmxFailsafePolicyFromName(const char* name) {
+    if (name == nullptr) return FAILSAFE_HOLD;
+    if (strcmp(name, "scene") == 0) return FAILSAFE_SCENE;
+    if (strcmp(name, "blackout") == 0) return FAILSAFE_BLACKOUT;
+    return FAILSAFE_HOLD;
+}
+
+const char* dmxFailsafePolicyName(DmxFailsafePolicy policy) {
+    switch (policy) {
+        case FAILSAFE_SCENE: return "scene";
+        case FAILSAFE_BLACKOUT: return "blackout";
+        default: return "hold";
+    }
+}
+
+static uint32_t checksum(const DmxRetainedScene& scene) {
+    // Rotate and xor over the words after the checksum
+    const uint8_t* p = (const uint8_t*)&scene.slots;
+    size_t length = sizeof(scene) - offsetof(DmxRetainedScene, slots);
+    uint32_t sum = RETAINED_SCENE_MAGIC;
+    for (size_t i = 0; i + 4 <= length; i += 4) {
+        uint32_t word;
+        memcpy(&word, p + i, 4);
+        sum = ((sum << 5) | (sum >> 27)) ^ word;
+    }
+    return sum;
+}
+
+void dmxRetainedStore(DmxRetainedScene& scene, const DmxUniverse* outputs, uint8_t count, uint8_t inputs) {
+    scene.magic = 0;
+    for (uint8_t u = 0; u < DMX_UNIVERSES; u++) {
+        uint16_t slots = u < count && !(inputs & (1 << u)) ? dmxUniverseSlotCount(outputs[u]) : 0;
+        scene.slots[u] = slots;
+        if (slots > 0) memcpy(scene.values[u], dmxUniverseValues(outputs[u]), slots);
+    }
+    scene.checksum = checksum(scene);
+    scene.magic = RETAINED_SCENE_MAGIC;
+}
+
+bool dmxRetainedValid(const DmxRetainedScene& scene) {
+    if (scene.magic != RETAINED_SCENE_MAGIC || scene.checksum != checksum(scene)) return false;
+    for (uint16_t slots : scene.slots) {
+        if (slots > DMX_CHANNELS) return false;
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+#include "dmx_presets.h"
+
+// Network-loss fail-safe. Each universe gets a fail-safe layer, merged as an
+// LTP source like the others. From the moment the network goes the network
+// layers (Art-Net and sACN) are committed as they are, so they do not time
+// out of the merge, and once it has been gone for the configured delay the
+// fail-safe layer takes every slot of what is on the wire, whichever source
+// fed it (MQTT, HTTP, WebSocket and UDP as much as Art-Net and sACN), plus
+// the safe scene's range:
+//   FAILSAFE_HOLD      keep it as it was
+//   FAILSAFE_SCENE     fade to the safe scene: the preset's slots at its
+//                      values, the rest at 0
+//   FAILSAFE_BLACKOUT  fade to 0
+// The fade takes back every slot it moves. After that a local source (the
+// show, BLE quick control) gets a slot by changing it, as in any LTP merge.
+// The layer lets go when the network has been back for
+// FAILSAFE_RECOVER_DELAY, and the slots fall back to the sources that wrote
+// them last. Loss only counts once the network was up, a boot without it is
+// not one.
+
+#define FAILSAFE_DELAY 5000          // ms, default
+#define FAILSAFE_FADE 3000           // ms, default
+#define FAILSAFE_RECOVER_DELAY 3000  // ms, for the senders to resume
+
+enum DmxFailsafePolicy : uint8_t {
+    FAILSAFE_HOLD,
+    FAILSAFE_SCENE,
+    FAILSAFE_BLACKOUT
+};
+
+struct DmxFailsafe {
+    DmxFailsafePolicy policy;
+    uint8_t preset;            // The safe scene
+    uint32_t delay;
+    uint32_t fadeMs;
+
+    bool active;
+    bool fading;
+    bool networkSeen;
+    bool networkUp;
+    uint32_t networkChanged;   // When networkUp last changed
+    uint32_t fadeEnd;
+    uint32_t lastTick;
+    uint16_t slots[DMX_UNIVERSES];  // Taken by the layer
+    unsigned long engaged;     // Times it took over
+};
+
+void dmxFailsafeInit(DmxFailsafe& failsafe);
+void dmxFailsafeConfigure(DmxFailsafe& failsafe, DmxFailsafePolicy policy, uint8_t preset, uint32_t delay,
+                          uint32_t fadeMs);
+
+// Hold what the caller already wrote into the layers (slots each, through
+// dmxUniverseReserve() so they take those slots) until the network is back,
+// e.g. the output from before a reset
+void dmxFailsafeResume(DmxFailsafe& failsafe, const uint16_t* slots, uint8_t count, uint32_t now);
+
+// Call every frame before the merges: follows the network state, keeps the
+// network layers live while it is gone, takes over from outputs when the
+// delay is up, then fades and commits the fail-safe layers while active.
+void dmxFailsafeTick(DmxFailsafe& failsafe, bool networkUp, DmxUniverse* layers, DmxUniverse* networkLayers,
+                     const DmxUniverse* outputs, uint8_t count, const DmxPresetBank& presets, uint32_t now);
+
+DmxFailsafePolicy dmxFailsafePolicyFromName(const char* name);
+const char* dmxFailsafePolicyName(DmxFailsafePolicy policy);
+
+// What is on the wire, kept in RAM that survives a reset (the caller places
+// it in .noinit) so the next boot can send it again in its first frame.
+// Universes in inputs (a bit each) are stored empty: their port receives,
+// and the next boot must not drive that line. The magic is cleared while it
+// is being written, so a reset halfway leaves it invalid rather than torn.
+#define RETAINED_SCENE_MAGIC 0x53434E45 // "SCNE"
+
+struct DmxRetainedScene {
+    uint32_t magic;
+    uint32_t checksum;
+    uint16_t slots[DMX_UNIVERSES];
+    uint8_t values[DMX_UNIVERSES][DMX_CHANNELS];
+};
+
+void dmxRetainedStore(DmxRetainedScene& scene, const DmxUniverse* outputs, uint8_t count, uint8_t inputs);
+bool dmxRetainedValid(const DmxRetainedScene& scene);
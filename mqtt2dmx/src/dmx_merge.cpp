@@ -0,0 +1,164 @@
+#include "dmx_merge.h"
+#include <string.h>
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#endif
+
+static inline bool isSet(const uint8_t* bits, uint16_t slot) {
+    return bits[slot >> 3] & (1 << (slot & 7));
+}
+
+static inline bool newer(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+// Hand the touched slots to LTP source s
+static void claim(DmxMerge& merge, uint8_t s, const uint8_t* touched) {
+    uint8_t* written = merge.sources[s].written;
+    for (uint16_t i = 0; i < DMX_CHANNELS / 8; i++) {
+        uint8_t bits = touched[i];
+        if (bits == 0) continue;
+        written[i] |= bits;
+        if (bits == 0xFF) {
+            memset(merge.owner + i * 8, s, 8);
+            continue;
+        }
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (bits & (1 << bit)) merge.owner[i * 8 + bit] = s;
+        }
+    }
+}
+
+// Add slots 0..slots-1 to touched
+static void allSlots(uint8_t* touched, uint16_t slots) {
+    memset(touched, 0xFF, slots >> 3);
+    if (slots & 7) touched[slots >> 3] |= (1 << (slots & 7)) - 1;
+}
+
+// Give the slots owned by s to the live LTP source that wrote them last
+static void release(DmxMerge& merge, uint8_t s) {
+    for (uint16_t slot = 0; slot < DMX_CHANNELS; slot++) {
+        if (merge.owner[slot] != s) continue;
+
+        uint8_t next = DMX_MERGE_NO_OWNER;
+        for (uint8_t i = 0; i < merge.count; i++) {
+            const DmxMergeSource& other = merge.sources[i];
+            if (i == s || !other.live || other.mode != MERGE_LTP || !isSet(other.written, slot)) continue;
+            if (next == DMX_MERGE_NO_OWNER || newer(other.lastUpdate, merge.sources[next].lastUpdate)) next = i;
+        }
+        merge.owner[slot] = next;
+    }
+}
+
+// target = max(target, values) per byte, count a multiple of 4
+static void maxInto(uint8_t* target, const uint8_t* values, uint16_t count) {
+#if defined(__ARM_FEATURE_SIMD32)
+    for (uint16_t i = 0; i < count; i += 4) {
+        uint32_t a, b;
+        memcpy(&a, target + i, 4);
+        memcpy(&b, values + i, 4);
+        (void)__usub8(a, b); // GE flags: a >= b per byte
+        a = __sel(a, b);
+        memcpy(target + i, &a, 4);
+    }
+#else
+    for (uint16_t i = 0; i < count; i++) {
+        if (values[i] > target[i]) target[i] = values[i];
+    }
+#endif
+}
+
+void dmxMergeInit(DmxMerge& merge) {
+    memset(&merge, 0, sizeof(merge));
+    memset(merge.owner, DMX_MERGE_NO_OWNER, sizeof(merge.owner));
+}
+
+int dmxMergeAddSource(DmxMerge& merge, DmxUniverse& layer, DmxMergeMode mode, uint8_t priority, uint32_t timeout) {
+    if (merge.count >= DMX_MERGE_SOURCES) return -1;
+    DmxMergeSource& source = merge.sources[merge.count];
+    memset(&source, 0, sizeof(source));
+    source.layer = &layer;
+    source.mode = mode;
+    source.priority = priority;
+    source.timeout = timeout;
+    return merge.count++;
+}
+
+void dmxMergeConfigure(DmxMerge& merge, uint8_t source, DmxMergeMode mode, uint8_t priority, uint32_t timeout) {
+    if (source >= merge.count) return;
+    DmxMergeSource& s = merge.sources[source];
+    if (s.mode == MERGE_LTP && mode == MERGE_HTP) {
+        release(merge, source);
+        memset(s.written, 0, sizeof(s.written));
+    }
+    s.mode = mode;
+    s.priority = priority;
+    s.timeout = timeout;
+}
+
+bool dmxMergeTick(DmxMerge& merge, DmxUniverse& output, uint32_t now) {
+    uint8_t touched[DMX_CHANNELS / 8];
+    uint8_t top = 0;
+    uint16_t slots = output.highestChannel;
+
+    for (uint8_t s = 0; s < merge.count; s++) {
+        DmxMergeSource& source = merge.sources[s];
+        if (source.layer->commitPending) {
+            dmxUniverseTakeTouched(*source.layer, touched);
+            // Coming back after a timeout it takes all it holds, even the
+            // slots it resends unchanged
+            if (source.timedOut) allSlots(touched, source.layer->highestChannel);
+            source.timedOut = false;
+            if (source.mode == MERGE_LTP) claim(merge, s, touched);
+            dmxUniverseFlip(*source.layer);
+            source.live = true;
+            source.lastUpdate = now;
+        } else if (source.live && source.timeout != 0 && now - source.lastUpdate > source.timeout) {
+            source.live = false;
+            source.timedOut = true;
+            release(merge, s);
+            memset(source.written, 0, sizeof(source.written));
+        }
+        if (!source.live) continue;
+        if (source.priority > top) top = source.priority;
+        if (source.layer->highestChannel > slots) slots = source.layer->highestChannel;
+    }
+
+    // Whole words for the HTP pass; DMX_CHANNELS is a multiple of 4
+    uint16_t words = (slots + 3) & ~3;
+
+    // LTP: each slot from its owner, if that one is taking part
+    const uint8_t* ltp[DMX_MERGE_SOURCES + 1] = {};
+    for (uint8_t s = 0; s < merge.count; s++) {
+        const DmxMergeSource& source = merge.sources[s];
+        if (source.live && source.priority == top && source.mode == MERGE_LTP) {
+            ltp[s] = dmxUniverseValues(*source.layer);
+        }
+    }
+    for (uint16_t slot = 0; slot < words; slot++) {
+        const uint8_t* values = ltp[merge.owner[slot]];
+        dmxScratch[slot] = values ? values[slot] : 0;
+    }
+
+    // HTP on top
+    for (uint8_t s = 0; s < merge.count; s++) {
+        const DmxMergeSource& source = merge.sources[s];
+        if (source.live && source.priority == top && source.mode == MERGE_HTP) {
+            maxInto(dmxScratch, dmxUniverseValues(*source.layer), words);
+        }
+    }
+
+    if (slots == 0) return false;
+    bool changed = dmxUniverseUpdate(output, 1, dmxScratch, slots);
+    if (slots > output.highestChannel) output.highestChannel = slots;
+    if (changed) dmxUniverseCommit(output);
+    return changed;
+}
+
+DmxMergeMode dmxMergeModeFromName(const char* name) {
+    return name != nullptr && strcmp(name, "htp") == 0 ? MERGE_HTP : MERGE_LTP;
+}
+
+const char* dmxMergeModeName(DmxMergeMode mode) {
+    return mode == MERGE_HTP ? "htp" : "ltp";
+}
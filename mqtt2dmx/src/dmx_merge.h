@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include "dmx_universe.h"
+
+// Merges several input sources into one output universe, once per frame.
+// Every source (HTTP, Art-Net/sACN, the show...) writes and commits its own
+// layer, a single-buffered DmxUniverse, and never touches the output. Per
+// slot:
+//   - only live sources at the highest live priority take part, as in E1.31
+//   - LTP: the slot follows the LTP source that last committed a change to it,
+//     a refresh with the same value does not take it over
+//   - HTP: the highest value wins, over the LTP value as well
+// A source is live from its first commit until it has not committed for its
+// timeout (0 = never times out). Its LTP slots then fall back to the live
+// source that wrote them most recently, or to 0. When it comes back it takes
+// every slot it holds, not only the ones it changed.
+//
+// The HTP pass is a byte-wise max over whole words (UQSUB8/SEL on the M4), so
+// merging a full universe costs well under the time of a DMX frame.
+
+#ifndef DMX_MERGE_SOURCES
+#define DMX_MERGE_SOURCES 6
+#endif
+#define DMX_MERGE_NO_OWNER DMX_MERGE_SOURCES
+
+enum DmxMergeMode : uint8_t {
+    MERGE_LTP,
+    MERGE_HTP
+};
+
+struct DmxMergeSource {
+    DmxUniverse* layer;
+    DmxMergeMode mode;
+    uint8_t priority;
+    bool live;
+    bool timedOut;        // Went quiet, the next commit takes all its slots
+    uint32_t timeout;     // ms, 0 = never
+    uint32_t lastUpdate;  // millis() of the last commit
+    uint8_t written[DMX_CHANNELS / 8]; // Slots written since it went live
+};
+
+struct DmxMerge {
+    DmxMergeSource sources[DMX_MERGE_SOURCES];
+    uint8_t count;
+    uint8_t owner[DMX_CHANNELS]; // LTP source per slot, DMX_MERGE_NO_OWNER if none
+};
+
+void dmxMergeInit(DmxMerge& merge);
+
+// Returns the source index, or -1 if the merge is full
+int dmxMergeAddSource(DmxMerge& merge, DmxUniverse& layer, DmxMergeMode mode, uint8_t priority, uint32_t timeout);
+
+// Change a source's settings; switching to HTP gives up its LTP slots
+void dmxMergeConfigure(DmxMerge& merge, uint8_t source, DmxMergeMode mode, uint8_t priority, uint32_t timeout);
+
+// Take the layers' pending commits, time out quiet sources and merge into
+// the output back buffer. Commits the output only if a slot changed; returns
+// true if it did. Call right before each frame.
+bool dmxMergeTick(DmxMerge& merge, DmxUniverse& output, uint32_t now);
+
+// "ltp" or "htp", LTP if unknown
+DmxMergeMode dmxMergeModeFromName(const char* name);
+const char* dmxMergeModeName(DmxMergeMode mode);
@@ -0,0 +1,201 @@
+#include "dmx_network.h"
+#include <WiFiS3.h>
+
+#define ARTNET_HEADER_SIZE 18
+#define ARTNET_OP_DMX 0x5000
+
+#define SACN_HEADER_SIZE 126      // Up to and including the DMX start code
+#define SACN_VECTOR_ROOT_DATA 0x00000004
+#define SACN_VECTOR_FRAMING_DATA 0x00000002
+#define SACN_VECTOR_DMP_SET 0x02
+#define SACN_OPTION_PREVIEW 0x80
+#define SACN_OPTION_TERMINATED 0x40
+
+enum NetProtocol : uint8_t {
+    NET_ARTNET,
+    NET_SACN
+};
+
+struct NetSource {
+    uint32_t address;
+    NetProtocol protocol;
+    uint8_t priority;
+    uint8_t sequence;
+    bool active;
+    unsigned long lastSeen;
+};
+
+static const uint8_t ARTNET_ID[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+static const uint8_t SACN_ACN_ID[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+static WiFiUDP artnetUdp;
+static WiFiUDP sacnUdp[DMX_UNIVERSES];
+static DmxUniverse* netUniverses = nullptr;
+static uint8_t netUniverseCount = 0;
+static uint16_t artnetUniverse = ARTNET_DEFAULT_UNIVERSE;
+static uint16_t sacnUniverse = SACN_DEFAULT_UNIVERSE;
+static NetSource sources[DMX_UNIVERSES][NET_MAX_SOURCES];
+
+static inline uint16_t readU16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8) | p[1];
+}
+
+static inline uint32_t readU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Sequence, timeout and priority checks. Returns true if the packet should be
+// written to the universe.
+static bool acceptPacket(NetSource* table, NetProtocol protocol, uint32_t address, uint8_t priority,
+                         uint8_t sequence, bool checkSequence, bool terminated) {
+    unsigned long now = millis();
+    NetSource* source = nullptr;
+    NetSource* freeSlot = nullptr;
+    uint8_t highestPriority = 0;
+
+    for (int i = 0; i < NET_MAX_SOURCES; i++) {
+        NetSource& s = table[i];
+        if (s.active && now - s.lastSeen > NET_SOURCE_TIMEOUT) {
+            s.active = false;
+        }
+        if (s.active && s.address == address && s.protocol == protocol) {
+            source = &s;
+        } else if (s.active) {
+            if (s.priority > highestPriority) highestPriority = s.priority;
+        } else if (freeSlot == nullptr) {
+            freeSlot = &s;
+        }
+    }
+
+    if (source == nullptr) {
+        if (freeSlot == nullptr || terminated) return false;
+        source = freeSlot;
+        source->address = address;
+        source->protocol = protocol;
+        source->active = true;
+    } else if (checkSequence) {
+        // E1.31 6.7.2: discard if the sequence went back by less than 20
+        int8_t diff = (int8_t)(sequence - source->sequence);
+        if (diff <= 0 && diff > -20) return false;
+    }
+
+    source->sequence = sequence;
+    source->priority = priority;
+    source->lastSeen = now;
+
+    if (terminated) {
+        source->active = false;
+        return false;
+    }
+    return priority >= highestPriority;
+}
+
+// Through dmxScratch rather than straight into the layer, so only the slots
+// that changed count as written and a sender refreshing its frame does not
+// take back slots another source has changed since
+static void readSlots(WiFiUDP& udp, uint8_t index, uint16_t count) {
+    if (count == 0 || count > DMX_CHANNELS || udp.read(dmxScratch, count) != (int)count) return;
+    dmxUniverseWrite(netUniverses[index], 1, dmxScratch, count);
+    dmxUniverseCommit(netUniverses[index]);
+}
+
+static void handleArtnetPacket(int size) {
+    uint8_t header[ARTNET_HEADER_SIZE];
+    if (size < ARTNET_HEADER_SIZE || artnetUdp.read(header, ARTNET_HEADER_SIZE) != ARTNET_HEADER_SIZE) return;
+    if (memcmp(header, ARTNET_ID, sizeof(ARTNET_ID)) != 0) return;
+
+    uint16_t opcode = header[8] | (header[9] << 8); // Little endian, unlike the rest
+    if (opcode != ARTNET_OP_DMX) return;
+
+    uint8_t sequence = header[12];
+    uint16_t portAddress = header[14] | ((header[15] & 0x7F) << 8);
+    uint16_t index = portAddress - artnetUniverse;
+    if (index >= netUniverseCount) return;
+
+    uint16_t count = readU16(&header[16]);
+    if (count > size - ARTNET_HEADER_SIZE) count = size - ARTNET_HEADER_SIZE;
+    if (count > DMX_CHANNELS) count = DMX_CHANNELS;
+    if (count == 0) return;
+
+    // Sequence 0 means the sender does not use sequencing
+    if (!acceptPacket(sources[index], NET_ARTNET, artnetUdp.remoteIP(), ARTNET_PRIORITY, sequence,
+                      sequence != 0, false)) return;
+    readSlots(artnetUdp, index, count);
+}
+
+static void handleSacnPacket(uint8_t index, int size) {
+    WiFiUDP& udp = sacnUdp[index];
+    uint8_t header[SACN_HEADER_SIZE];
+    if (size < SACN_HEADER_SIZE || udp.read(header, SACN_HEADER_SIZE) != SACN_HEADER_SIZE) return;
+
+    if (readU16(&header[0]) != 0x0010 || memcmp(&header[4], SACN_ACN_ID, sizeof(SACN_ACN_ID)) != 0) return;
+    if (readU32(&header[18]) != SACN_VECTOR_ROOT_DATA || readU32(&header[40]) != SACN_VECTOR_FRAMING_DATA) return;
+    if (header[117] != SACN_VECTOR_DMP_SET || header[118] != 0xA1) return;
+    if (readU16(&header[113]) != sacnUniverse + index) return;
+
+    uint8_t priority = header[108];
+    uint8_t sequence = header[111];
+    uint8_t options = header[112];
+    if (options & SACN_OPTION_PREVIEW) return;
+
+    // Property value count includes the start code, only NULL start code frames carry levels
+    uint16_t count = readU16(&header[123]);
+    if (count == 0 || header[125] != 0x00) return;
+    count--;
+    if (count > size - SACN_HEADER_SIZE) count = size - SACN_HEADER_SIZE;
+    if (count > DMX_CHANNELS) count = DMX_CHANNELS;
+
+    if (!acceptPacket(sources[index], NET_SACN, udp.remoteIP(), priority, sequence, true,
+                      options & SACN_OPTION_TERMINATED)) return;
+    if (count > 0) readSlots(udp, index, count);
+}
+
+static void joinSacnUniverses() {
+    for (uint8_t i = 0; i < netUniverseCount; i++) {
+        uint16_t number = sacnUniverse + i;
+        sacnUdp[i].stop();
+        sacnUdp[i].beginMulticast(IPAddress(239, 255, number >> 8, number & 0xFF), SACN_PORT);
+    }
+}
+
+void dmxNetworkBegin(DmxUniverse* universes, uint8_t count) {
+    netUniverses = universes;
+    netUniverseCount = min(count, (uint8_t)DMX_UNIVERSES);
+    memset(sources, 0, sizeof(sources));
+    artnetUdp.begin(ARTNET_PORT);
+    joinSacnUniverses();
+}
+
+void dmxNetworkSetUniverses(uint16_t newArtnetUniverse, uint16_t newSacnUniverse) {
+    artnetUniverse = newArtnetUniverse & 0x7FFF;
+    memset(sources, 0, sizeof(sources));
+    if (newSacnUniverse >= 1 && newSacnUniverse + DMX_UNIVERSES - 1 <= 63999 && newSacnUniverse != sacnUniverse) {
+        sacnUniverse = newSacnUniverse;
+        if (netUniverses != nullptr) joinSacnUniverses();
+    }
+}
+
+uint16_t dmxNetworkArtnetUniverse() {
+    return artnetUniverse;
+}
+
+uint16_t dmxNetworkSacnUniverse() {
+    return sacnUniverse;
+}
+
+void dmxNetworkLoop() {
+    if (netUniverses == nullptr) return;
+
+    for (int i = 0; i < NET_MAX_PACKETS_PER_LOOP; i++) {
+        int size = artnetUdp.parsePacket();
+        if (size <= 0) break;
+        handleArtnetPacket(size);
+    }
+    for (uint8_t u = 0; u < netUniverseCount; u++) {
+        for (int i = 0; i < NET_MAX_PACKETS_PER_LOOP; i++) {
+            int size = sacnUdp[u].parsePacket();
+            if (size <= 0) break;
+            handleSacnPacket(u, size);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+#include "dmx_universe.h"
+
+// Art-Net (ArtDmx) and sACN (E1.31) receivers. Packet headers are parsed from a
+// small stack buffer and the slot data is read into dmxScratch, then written
+// to the layer so only changed slots count (see dmxUniverseTakeTouched());
+// no JSON, no String, no heap.
+//
+// Sources are tracked per sender. The highest priority live source owns the
+// universe (Art-Net has no priority field and uses ARTNET_PRIORITY); equal
+// priorities are last-writer-wins. Out-of-order packets are dropped using the
+// E1.31 sequence rule, and a source that goes quiet for NET_SOURCE_TIMEOUT
+// releases its priority.
+//
+// Universe index i (0-based) listens on Art-Net port address
+// artnetUniverse + i and sACN universe sacnUniverse + i; each has its own
+// source table and sACN multicast socket.
+
+#define ARTNET_PORT 6454
+#define SACN_PORT 5568
+#define ARTNET_DEFAULT_UNIVERSE 0  // 15-bit port address (net/subnet/universe)
+#define SACN_DEFAULT_UNIVERSE 1
+#define ARTNET_PRIORITY 100        // Same as the E1.31 default priority
+#define NET_MAX_SOURCES 4
+#define NET_SOURCE_TIMEOUT 2500    // E1.31 network data loss timeout, ms
+#define NET_MAX_PACKETS_PER_LOOP 4 // Bound the time spent per loop() pass
+
+// Open the sockets; packets for the configured universes land in
+// universes[0..count-1]
+void dmxNetworkBegin(DmxUniverse* universes, uint8_t count);
+
+// Change the first universe numbers, reopens the sACN multicast groups
+void dmxNetworkSetUniverses(uint16_t artnetUniverse, uint16_t sacnUniverse);
+uint16_t dmxNetworkArtnetUniverse();
+uint16_t dmxNetworkSacnUniverse();
+
+// Drain pending packets, call every loop()
+void dmxNetworkLoop();
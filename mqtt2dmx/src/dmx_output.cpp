@@ -0,0 +1,331 @@
+#include "dmx_output.h"
+#include "IRQManager.h"
+#include "log.h"
+
+// The SCI interrupts take a plain function, so each port gets a trampoline
+static DmxPort* ports[DMX_MAX_PORTS];
+static uint8_t portCount = 0;
+
+template <uint8_t N> void DmxPort::txiIsr() {
+    ports[N]->onTxi();
+}
+
+template <uint8_t N> void DmxPort::teiIsr() {
+    ports[N]->onTei();
+}
+
+template <uint8_t N> void DmxPort::rxiIsr() {
+    ports[N]->onRxi();
+}
+
+template <uint8_t N> void DmxPort::eriIsr() {
+    ports[N]->onEri();
+}
+
+DmxPort::DmxPort(const DmxPortConfig& config, DmxUniverse& universe)
+    : config(config), target(universe), index(0) {
+}
+
+// TDR empty: feed the next byte, switch to TEI after the last one
+void DmxPort::onTxi() {
+    R_BSP_IrqStatusClear(R_FSP_CurrentIrqGet());
+
+    if (txStartCodePending) {
+        config.sci->TDR = txStartCode;
+        txStartCodePending = false;
+    } else if (txRemaining > 0) {
+        config.sci->TDR = *txData++;
+        txRemaining--;
+    }
+
+    if (!txStartCodePending && txRemaining == 0) {
+        uint8_t scr = config.sci->SCR;
+        scr |= R_SCI0_SCR_TEIE_Msk;
+        scr &= (uint8_t)~R_SCI0_SCR_TIE_Msk;
+        config.sci->SCR = scr;
+    }
+}
+
+// Transmit end: the last stop bit is out, release the bus and listen for
+// an RDM reply if one is due
+void DmxPort::onTei() {
+    R_BSP_IrqStatusClear(R_FSP_CurrentIrqGet());
+
+    config.sci->SCR &= (uint8_t)~(R_SCI0_SCR_TIE_Msk | R_SCI0_SCR_TEIE_Msk);
+    digitalWrite(config.dePin, LOW);
+    if (rxAfterTx) {
+        rxAfterTx = false;
+        rxLength = 0;
+        rxLastByte = micros();
+        rxActive = true;
+        // TE and RE may only be set from both clear
+        config.sci->SCR = 0;
+        config.sci->SCR = R_SCI0_SCR_RE_Msk | R_SCI0_SCR_RIE_Msk;
+    }
+    txBusy = false;
+}
+
+void DmxPort::onRxi() {
+    R_BSP_IrqStatusClear(R_FSP_CurrentIrqGet());
+
+    uint8_t value = config.sci->RDR;
+    rxLastByte = micros();
+    if (inputMode) {
+        if (rxAwaitBreak || rxLength > DMX_CHANNELS) return;
+        if (rxLength == 0) inputStartCode = value;
+        else if (inputStartCode == 0x00) inputBuffers[inputBack * DMX_CHANNELS + rxLength - 1] = value;
+        rxLength++;
+        return;
+    }
+    if (!rxAwaitBreak && rxLength < rxSize) rxBuffer[rxLength++] = value;
+}
+
+// The break before the next frame: a dimmer frame becomes the one the loop
+// reads. Long breaks give several framing errors, only the first has slots.
+void DmxPort::completeInputFrame() {
+    if (rxAwaitBreak || inputStartCode != 0x00 || rxLength < 2) return;
+    inputSlots = rxLength - 1;
+    inputFront = inputBack;
+    inputBack ^= 1;
+    inputFrameTime = millis();
+    inputCount++;
+}
+
+// A break reads as a 0 with a framing error: the reply or frame starts
+// after it
+void DmxPort::onEri() {
+    R_BSP_IrqStatusClear(R_FSP_CurrentIrqGet());
+
+    R_SCI0_Type* sci = config.sci;
+    bool framingError = sci->SSR & R_SCI0_SSR_FER_Msk;
+    (void)sci->RDR;
+    sci->SSR &= (uint8_t)~(R_SCI0_SSR_ORER_Msk | R_SCI0_SSR_FER_Msk | R_SCI0_SSR_PER_Msk);
+    if (framingError) {
+        if (inputMode) completeInputFrame();
+        rxAwaitBreak = false;
+        rxLength = 0;
+    } else if (inputMode) {
+        rxAwaitBreak = true; // Overrun: the frame is incomplete, drop it
+    }
+    rxLastByte = micros();
+}
+
+void DmxPort::stopReceive() {
+    config.sci->SCR = 0;
+    rxActive = false;
+}
+
+// Start code and slots go out on TXI once TE and TIE are set in one write
+void DmxPort::startTransmit() {
+    config.sci->SCR = R_SCI0_SCR_TE_Msk | R_SCI0_SCR_TIE_Msk;
+}
+
+// Break/MAB generator. The GPT runs one period for the break and one for the
+// MAB; the MAB period is loaded into the buffer register while the break is
+// running, so the overflows themselves are exact. Both edges on the line
+// are still made here in the overflow interrupt (SPTR back to mark, then
+// starting the SCI), so each lands one interrupt latency after its overflow:
+// the break grows by the first latency and the MAB by the difference of the
+// two, which the DMX_BREAK_TIME / DMX_MAB_TIME margins over the minimums
+// absorb. No GPT output pin drives the line.
+void DmxPort::breakTimerCallback(timer_callback_args_t* args) {
+    if (args->event != TIMER_EVENT_CYCLE_END) return;
+    ((DmxPort*)args->p_context)->onBreakTimer();
+}
+
+void DmxPort::onBreakTimer() {
+    if (inBreak) {
+        // End of break, the MAB period is already latched
+        config.sci->SPTR = R_SCI0_SPTR_SPB2IO_Msk | R_SCI0_SPTR_SPB2DT_Msk;
+        inBreak = false;
+    } else {
+        breakTimer.stop();
+        startTransmit();
+    }
+}
+
+bool DmxPort::beginBreakTimer() {
+    uint8_t type;
+    int8_t channel = FspTimer::get_available_timer(type);
+    if (channel < 0 || type != GPT_TIMER) {
+        return false;
+    }
+
+    breakCountsPerUs = R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_PCLKD) / 1000000UL;
+    uint32_t period = breakTimeUs * breakCountsPerUs;
+    if (!breakTimer.begin(TIMER_MODE_PERIODIC, type, channel, period, period / 2,
+                          TIMER_SOURCE_DIV_1, breakTimerCallback, this)) {
+        return false;
+    }
+    return breakTimer.setup_overflow_irq(DMX_IRQ_PRIORITY) && breakTimer.open();
+}
+
+static bool attachSciInterrupt(elc_event_t event, Irq_f isr) {
+    GenericIrqCfg_t cfg;
+    cfg.irq = FSP_INVALID_VECTOR;
+    cfg.ipl = DMX_IRQ_PRIORITY;
+    cfg.event = event;
+    return IRQManager::getInstance().addGenericInterrupt(cfg, isr);
+}
+
+bool DmxPort::begin() {
+    static const Irq_f txiIsrs[DMX_MAX_PORTS] = { txiIsr<0>, txiIsr<1>, txiIsr<2>, txiIsr<3> };
+    static const Irq_f teiIsrs[DMX_MAX_PORTS] = { teiIsr<0>, teiIsr<1>, teiIsr<2>, teiIsr<3> };
+    static const Irq_f rxiIsrs[DMX_MAX_PORTS] = { rxiIsr<0>, rxiIsr<1>, rxiIsr<2>, rxiIsr<3> };
+    static const Irq_f eriIsrs[DMX_MAX_PORTS] = { eriIsr<0>, eriIsr<1>, eriIsr<2>, eriIsr<3> };
+    if (portCount >= DMX_MAX_PORTS) {
+        LOG_ERROR("DMX: more than %u ports", DMX_MAX_PORTS);
+        return false;
+    }
+    index = portCount++;
+    ports[index] = this;
+
+    pinMode(config.dePin, OUTPUT);
+    digitalWrite(config.dePin, LOW);
+
+    R_BSP_MODULE_START(FSP_IP_SCI, config.sciChannel);
+
+    // Everything below must be written with TE/RE cleared
+    R_SCI0_Type* sci = config.sci;
+    sci->SCR = 0;
+    // While TE is off the pin follows SPTR, keep it at mark (idle high)
+    sci->SPTR = R_SCI0_SPTR_SPB2IO_Msk | R_SCI0_SPTR_SPB2DT_Msk;
+    sci->SIMR1 = 0;
+    sci->SPMR = 0;
+    sci->SMR = R_SCI0_SMR_STOP_Msk; // Async, 8 data bits, no parity, 2 stop bits
+    sci->SEMR = R_SCI0_SEMR_ABCS_Msk | R_SCI0_SEMR_BGDM_Msk; // 8 clocks per bit
+    uint32_t pclk = R_FSP_SystemClockHzGet(BSP_FEATURE_SCI_CLOCK);
+    sci->BRR = (uint8_t)(pclk / (8UL * DMX_BAUD) - 1);
+
+    R_IOPORT_PinCfg(&g_ioport_ctrl, g_pin_cfg[config.txPin].pin,
+                    (uint32_t)(IOPORT_CFG_PERIPHERAL_PIN | config.pinFunction));
+
+    if (!attachSciInterrupt(config.txiEvent, txiIsrs[index]) ||
+        !attachSciInterrupt(config.teiEvent, teiIsrs[index])) {
+        LOG_ERROR("DMX: failed to allocate SCI%u interrupts!", config.sciChannel);
+        return false;
+    }
+
+    if (config.rxPin != DMX_NO_PIN) {
+        R_IOPORT_PinCfg(&g_ioport_ctrl, g_pin_cfg[config.rxPin].pin,
+                        (uint32_t)(IOPORT_CFG_PERIPHERAL_PIN | config.pinFunction));
+        rxReady = attachSciInterrupt(config.rxiEvent, rxiIsrs[index]) &&
+                  attachSciInterrupt(config.eriEvent, eriIsrs[index]);
+        if (!rxReady) LOG_WARN("DMX: no receive interrupts for SCI%u, RDM unavailable", config.sciChannel);
+    }
+
+    breakTimerReady = beginBreakTimer();
+    if (!breakTimerReady) {
+        LOG_WARN("DMX: no GPT channel free for SCI%u, falling back to software break timing",
+                 config.sciChannel);
+    }
+    return true;
+}
+
+void DmxPort::setBreakTiming(uint16_t breakUs, uint16_t mabUs) {
+    breakTimeUs = constrain(breakUs, DMX_BREAK_MIN, DMX_BREAK_MAX);
+    mabTimeUs = constrain(mabUs, DMX_MAB_MIN, DMX_MAB_MAX);
+}
+
+bool DmxPort::sendFrame() {
+    if (inputMode || txBusy || (rxActive && !rdmPoll())) return false;
+
+    // The transmitter reads the front buffer in place until TEI
+    txData = dmxUniverseFlip(target);
+    txRemaining = dmxUniverseSlotCount(target);
+    txStartCode = 0x00;
+    txStartCodePending = true;
+    txBusy = true;
+    frameCount++;
+    startBreak(breakTimeUs, mabTimeUs);
+    return true;
+}
+
+bool DmxPort::sendRdm(const uint8_t* packet, uint16_t length, uint8_t* reply, uint16_t replySize, DmxRdmReply expect) {
+    if (inputMode || txBusy || rxActive || length < 2 ||
+        (expect != RDM_NO_REPLY && (!rxReady || reply == nullptr))) {
+        return false;
+    }
+
+    txData = packet + 1;
+    txRemaining = length - 1;
+    txStartCode = packet[0];
+    txStartCodePending = true;
+    rxBuffer = reply;
+    rxSize = replySize;
+    rxLength = 0;
+    rxAwaitBreak = expect == RDM_REPLY;
+    rxAfterTx = expect != RDM_NO_REPLY;
+    txBusy = true;
+    startBreak(RDM_BREAK_TIME, RDM_MAB_TIME);
+    return true;
+}
+
+bool DmxPort::rdmPoll() {
+    if (txBusy) return false;
+    if (!rxActive) return true;
+
+    uint16_t length = rxLength;
+    uint32_t idle = micros() - rxLastByte;
+    bool complete = length >= 3 && rxBuffer[0] == 0xCC && length >= rxBuffer[2] + 2;
+    if (complete || length >= rxSize || idle > (length == 0 ? RDM_REPLY_TIMEOUT : RDM_BYTE_TIMEOUT)) {
+        stopReceive();
+        return true;
+    }
+    return false;
+}
+
+bool DmxPort::setInput(bool enabled, uint8_t* storage) {
+    if (enabled == inputMode) return true;
+    if (!frameDone() || (enabled && (!rxReady || storage == nullptr))) return false;
+
+    config.sci->SCR = 0;
+    digitalWrite(config.dePin, LOW);
+    if (!enabled) {
+        inputMode = false;
+        return true;
+    }
+
+    inputBuffers = storage;
+    inputBack = 0;
+    inputFront = 0;
+    inputSlots = 0;
+    inputCount = 0;
+    rxLength = 0;
+    rxAwaitBreak = true;
+    inputMode = true;
+    config.sci->SCR = R_SCI0_SCR_RE_Msk | R_SCI0_SCR_RIE_Msk;
+    return true;
+}
+
+const uint8_t* DmxPort::inputFrame(uint16_t& slots) const {
+    noInterrupts();
+    uint8_t front = inputFront;
+    slots = inputSlots;
+    bool received = inputCount > 0;
+    interrupts();
+    return inputMode && received ? inputBuffers + front * DMX_CHANNELS : nullptr;
+}
+
+// Break: with TE off the pin is driven from SPTR, so the UART keeps its
+// configuration and we only flip the output level
+void DmxPort::startBreak(uint16_t breakUs, uint16_t mabUs) {
+    digitalWrite(config.dePin, HIGH);
+    config.sci->SCR = 0;
+    config.sci->SPTR = R_SCI0_SPTR_SPB2IO_Msk;
+
+    if (breakTimerReady) {
+        inBreak = true;
+        // Stopped timer: the break period is applied and the counter cleared
+        breakTimer.set_period(breakUs * breakCountsPerUs);
+        breakTimer.start();
+        // Running timer: the MAB period goes to the buffer register
+        breakTimer.set_period(mabUs * breakCountsPerUs);
+        return;
+    }
+
+    delayMicroseconds(breakUs);
+    config.sci->SPTR = R_SCI0_SPTR_SPB2IO_Msk | R_SCI0_SPTR_SPB2DT_Msk;
+    delayMicroseconds(mabUs);
+    startTransmit();
+}
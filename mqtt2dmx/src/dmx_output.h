@@ -0,0 +1,178 @@
+#pragma once
+
+#include <Arduino.h>
+#include "FspTimer.h"
+#include "dmx_universe.h"
+
+// DMX break timing. The edges come from the GPT interrupt, so the lengths
+// on the wire carry a few μs of interrupt latency; the defaults keep that
+// much above the minimums.
+#define DMX_BREAK_TIME 92 // 92μs break (default)
+#define DMX_MAB_TIME 12   // 12μs mark after break (default)
+#define DMX_BREAK_MIN 88  // DMX512-A minimum break
+#define DMX_BREAK_MAX 1000
+#define DMX_MAB_MIN 8     // DMX512-A minimum mark after break
+#define DMX_MAB_MAX 1000
+
+#define DMX_BAUD 250000
+#define DMX_IRQ_PRIORITY 6 // Higher than the core's default of 12
+#define DMX_MAX_PORTS 4    // Interrupt trampolines available
+
+// RDM timing (E1.20): controllers send a longer break, responders start
+// their reply within 2.8 ms of the request's last stop bit
+#define RDM_BREAK_TIME 176
+#define RDM_MAB_TIME 12
+#define RDM_REPLY_TIMEOUT 2800 // us to the first reply byte
+#define RDM_BYTE_TIMEOUT 2100  // us between reply bytes
+#define DMX_NO_PIN 0xFF
+#define DMX_INPUT_LOSS 1000    // ms without a frame before the input counts as lost
+
+enum DmxRdmReply : uint8_t {
+    RDM_NO_REPLY,        // Broadcasts
+    RDM_REPLY,           // A packet after a break
+    RDM_DISCOVERY_REPLY  // DISC_UNIQUE_BRANCH: raw bytes without a break
+};
+
+// One DMX output: an SCI channel driven directly (not through the core's
+// UART class, so the matching SerialN must not be started), a MAX485 DE pin
+// and a GPT channel for break/MAB timing. With an RX pin, the MAX485's /RE
+// tied to DE, the port can also listen while DE is low (RDM replies, or a
+// console's universe in input mode).
+struct DmxPortConfig {
+    R_SCI0_Type* sci;
+    uint8_t sciChannel;
+    elc_event_t txiEvent;
+    elc_event_t teiEvent;
+    uint8_t txPin;          // Arduino pin wired to the SCI's TXD
+    uint32_t pinFunction;   // IOPORT_PERIPHERAL_SCI0_2_4_6_8 or _SCI1_3_5_7_9
+    uint8_t dePin;          // Direction Enable for the MAX485
+    uint8_t rxPin;          // Arduino pin wired to the SCI's RXD, DMX_NO_PIN if none
+    elc_event_t rxiEvent;
+    elc_event_t eriEvent;
+};
+
+// Universe 1 on D1/D0 (Serial1, SCI2), universe 2 on D11/D12 (SCI0 TXD0 and
+// RXD0, the SPI MOSI and MISO pins, so SPI is unavailable while it is in use)
+#define DMX_PORT_1 { R_SCI2, 2, ELC_EVENT_SCI2_TXI, ELC_EVENT_SCI2_TEI, 1, IOPORT_PERIPHERAL_SCI0_2_4_6_8, 2, \
+                     0, ELC_EVENT_SCI2_RXI, ELC_EVENT_SCI2_ERI }
+#define DMX_PORT_2 { R_SCI0, 0, ELC_EVENT_SCI0_TXI, ELC_EVENT_SCI0_TEI, 11, IOPORT_PERIPHERAL_SCI0_2_4_6_8, 3, \
+                     12, ELC_EVENT_SCI0_RXI, ELC_EVENT_SCI0_ERI }
+
+// Transmits one universe. Frames are sent entirely from interrupts (GPT
+// overflows end break and MAB, TXI feeds the slots), so all ports run at the
+// same time without the loop waiting on any of them.
+class DmxPort {
+public:
+    DmxPort(const DmxPortConfig& config, DmxUniverse& universe);
+
+    // Configure the SCI for 250k 8N2, hook up the TXI/TEI interrupts and
+    // claim a GPT channel for break/MAB timing
+    bool begin();
+
+    // Change break and mark-after-break lengths (μs), applied from the next
+    // frame. Values are clamped to the DMX_BREAK_* / DMX_MAB_* limits.
+    void setBreakTiming(uint16_t breakUs, uint16_t mabUs);
+    uint16_t breakTime() const { return breakTimeUs; }
+    uint16_t mabTime() const { return mabTimeUs; }
+
+    // Flip the universe and start sending the new front buffer (break, MAB,
+    // start code, slots) in the background. Returns false if the previous
+    // frame is still on the wire.
+    bool sendFrame();
+
+    // True once the last stop bit of the previous frame has left the UART
+    bool frameDone() const { return !txBusy && !rxActive; }
+
+    // Send an RDM packet (start code included) in place of a frame, after
+    // the longer RDM break. If a reply is expected the line is released at
+    // the last stop bit and the reply received into reply from the RXI/ERI
+    // interrupts. False if the port is busy or cannot receive.
+    bool sendRdm(const uint8_t* packet, uint16_t length, uint8_t* reply, uint16_t replySize, DmxRdmReply expect);
+
+    // True once the request is out and the reply complete or timed out.
+    // Called from loop() and before each frame.
+    bool rdmPoll();
+    uint16_t rdmReplyLength() const { return rxLength; }
+
+    // Time on the wire at the current frame length, us: break, MAB, then 11
+    // bits of 4us each for the start code and every slot
+    uint32_t frameTime() const {
+        return breakTimeUs + mabTimeUs + (dmxUniverseSlotCount(target) + 1) * 44UL;
+    }
+
+    // Input mode: stop sending and receive a console's frames instead, DE
+    // held low. The RXI/ERI interrupts take the slots of frames with the null
+    // start code into storage (2 * DMX_CHANNELS bytes, two frame buffers); the
+    // framing error of the next break completes a frame. Only switches while
+    // the port is idle; false if it cannot receive or is busy.
+    bool setInput(bool enabled, uint8_t* storage);
+    bool isInput() const { return inputMode; }
+
+    // The last complete frame received, nullptr before the first. Stays
+    // intact for at least one frame time after the call.
+    const uint8_t* inputFrame(uint16_t& slots) const;
+    unsigned long inputFrames() const { return inputCount; }
+    // A frame arrived within DMX_INPUT_LOSS
+    bool inputSignal() const { return inputCount > 0 && millis() - inputFrameTime < DMX_INPUT_LOSS; }
+
+    DmxUniverse& universe() { return target; }
+    unsigned long frames() const { return frameCount; }
+
+private:
+    template <uint8_t N> static void txiIsr();
+    template <uint8_t N> static void teiIsr();
+    template <uint8_t N> static void rxiIsr();
+    template <uint8_t N> static void eriIsr();
+    static void breakTimerCallback(timer_callback_args_t* args);
+
+    void onTxi();
+    void onTei();
+    void onBreakTimer();
+    void onRxi();
+    void onEri();
+    void completeInputFrame();
+    void startBreak(uint16_t breakUs, uint16_t mabUs);
+    void startTransmit();
+    void stopReceive();
+    bool beginBreakTimer();
+
+    const DmxPortConfig config;
+    DmxUniverse& target;
+    uint8_t index;
+
+    // Frame currently on the wire
+    const uint8_t* volatile txData = nullptr;
+    volatile uint16_t txRemaining = 0;
+    uint8_t txStartCode = 0x00;
+    volatile bool txStartCodePending = false;
+    volatile bool txBusy = false;
+
+    // RDM reply being received
+    bool rxReady = false;
+    bool rxAfterTx = false;      // Listen once the request is out
+    bool rxAwaitBreak = false;   // A reply with a break, not a discovery one
+    uint8_t* rxBuffer = nullptr;
+    uint16_t rxSize = 0;
+    volatile uint16_t rxLength = 0;
+    volatile bool rxActive = false;
+    volatile uint32_t rxLastByte = 0; // micros() of the last byte, or of the end of the request
+    unsigned long frameCount = 0;
+
+    // Input mode; rxLength counts the start code, rxAwaitBreak is set until
+    // the first break and after an overrun
+    volatile bool inputMode = false;
+    uint8_t* inputBuffers = nullptr;
+    uint8_t inputBack = 0;               // Being received into
+    volatile uint8_t inputFront = 0;     // Last complete frame
+    volatile uint8_t inputStartCode = 0;
+    volatile uint16_t inputSlots = 0;
+    volatile unsigned long inputCount = 0;
+    volatile unsigned long inputFrameTime = 0;
+
+    FspTimer breakTimer;
+    bool breakTimerReady = false;
+    uint32_t breakCountsPerUs = 0;
+    uint16_t breakTimeUs = DMX_BREAK_TIME;
+    uint16_t mabTimeUs = DMX_MAB_TIME;
+    volatile bool inBreak = false;
+};
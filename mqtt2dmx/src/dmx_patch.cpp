@@ -0,0 +1,246 @@
+#include "dmx_patch.h"
+#include <string.h>
+
+#define PATCH_VERSION 1
+
+static bool copyName(char* dest, const char* name, size_t length) {
+    // The dot separates fixture and attribute in a path
+    if (name == nullptr || length == 0 || length >= PATCH_NAME_MAX || memchr(name, '.', length)) return false;
+    memcpy(dest, name, length);
+    dest[length] = '\0';
+    return true;
+}
+
+void dmxPatchInit(DmxPatch& patch) {
+    memset(&patch, 0, sizeof(patch));
+}
+
+int dmxPatchAddType(DmxPatch& patch, const char* name, uint8_t footprint) {
+    if (patch.typeCount >= PATCH_MAX_TYPES || footprint == 0) return -1;
+
+    FixtureType& type = patch.types[patch.typeCount];
+    if (name == nullptr || !copyName(type.name, name, strlen(name))) return -1;
+    type.footprint = footprint;
+    type.attributeCount = 0;
+    return patch.typeCount++;
+}
+
+bool dmxPatchAddAttribute(DmxPatch& patch, uint8_t type, const char* name, uint8_t offset, bool fine, uint16_t home) {
+    if (type >= patch.typeCount) return false;
+
+    FixtureType& fixtureType = patch.types[type];
+    if (fixtureType.attributeCount >= PATCH_MAX_ATTRIBUTES) return false;
+    if (offset > PATCH_MAX_OFFSET || offset + (fine ? 2 : 1) > fixtureType.footprint) return false;
+
+    PatchAttribute& attribute = fixtureType.attributes[fixtureType.attributeCount];
+    if (name == nullptr || !copyName(attribute.name, name, strlen(name))) return false;
+    attribute.offset = offset;
+    attribute.fine = fine;
+    attribute.home = fine ? home : (home > 255 ? 255 : home);
+    fixtureType.attributeCount++;
+    return true;
+}
+
+bool dmxPatchAddFixture(DmxPatch& patch, const char* name, uint8_t type, uint8_t universe, uint16_t address) {
+    if (patch.fixtureCount >= PATCH_MAX_FIXTURES || type >= patch.typeCount || universe >= DMX_UNIVERSES) return false;
+    if (address < 1 || address + patch.types[type].footprint - 1 > DMX_CHANNELS) return false;
+
+    Fixture& fixture = patch.fixtures[patch.fixtureCount];
+    if (name == nullptr || !copyName(fixture.name, name, strlen(name))) return false;
+    fixture.type = type;
+    fixture.universe = universe;
+    fixture.address = address;
+    patch.fixtureCount++;
+    return true;
+}
+
+int dmxPatchFindType(const DmxPatch& patch, const char* name) {
+    for (uint8_t i = 0; i < patch.typeCount; i++) {
+        if (strcmp(patch.types[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int findFixture(const DmxPatch& patch, const char* name, size_t length) {
+    for (uint8_t i = 0; i < patch.fixtureCount; i++) {
+        const char* fixtureName = patch.fixtures[i].name;
+        if (strncmp(fixtureName, name, length) == 0 && fixtureName[length] == '\0') return i;
+    }
+    return -1;
+}
+
+int dmxPatchFindFixture(const DmxPatch& patch, const char* name) {
+    return findFixture(patch, name, strlen(name));
+}
+
+bool dmxPatchResolveAttribute(const DmxPatch& patch, uint8_t fixture, const char* attribute, PatchTarget& target) {
+    if (fixture >= patch.fixtureCount) return false;
+
+    const Fixture& f = patch.fixtures[fixture];
+    const FixtureType& type = patch.types[f.type];
+    for (uint8_t i = 0; i < type.attributeCount; i++) {
+        const PatchAttribute& a = type.attributes[i];
+        if (strcmp(a.name, attribute) != 0) continue;
+
+        target.universe = f.universe;
+        target.channel = f.address + a.offset;
+        target.fine = a.fine;
+        return true;
+    }
+    return false;
+}
+
+bool dmxPatchResolve(const DmxPatch& patch, const char* path, PatchTarget& target) {
+    const char* dot = strchr(path, '.');
+    if (dot == nullptr) return false;
+
+    int fixture = findFixture(patch, path, dot - path);
+    return fixture >= 0 && dmxPatchResolveAttribute(patch, fixture, dot + 1, target);
+}
+
+void dmxPatchWrite(DmxUniverse& universe, const PatchTarget& target, uint16_t value) {
+    if (target.fine) {
+        dmxUniverseSet(universe, target.channel, value >> 8);
+        dmxUniverseSet(universe, target.channel + 1, value & 0xFF);
+    } else {
+        dmxUniverseSet(universe, target.channel, value > 255 ? 255 : value);
+    }
+}
+
+void dmxPatchHome(const DmxPatch& patch, DmxUniverse* universes, uint8_t count) {
+    for (uint8_t i = 0; i < patch.fixtureCount; i++) {
+        const Fixture& fixture = patch.fixtures[i];
+        if (fixture.universe >= count) continue;
+
+        const FixtureType& type = patch.types[fixture.type];
+        for (uint8_t j = 0; j < type.attributeCount; j++) {
+            const PatchAttribute& a = type.attributes[j];
+            PatchTarget target = { fixture.universe, (uint16_t)(fixture.address + a.offset), a.fine };
+            dmxPatchWrite(universes[fixture.universe], target, a.home);
+        }
+    }
+}
+
+// [version] [type count]
+//   per type: [name length] [name] [footprint] [attribute count]
+//     per attribute: [name length] [name] [offset | 0x80 if fine] [home u16]
+// [fixture count]
+//   per fixture: [name length] [name] [type] [universe] [address u16]
+// All u16 little endian.
+struct PatchWriter {
+    uint8_t* buffer;
+    size_t size;
+    size_t length;
+
+    void byte(uint8_t value) {
+        if (length < size) buffer[length] = value;
+        length++;
+    }
+    void word(uint16_t value) {
+        byte(value & 0xFF);
+        byte(value >> 8);
+    }
+    void name(const char* value) {
+        uint8_t n = strlen(value);
+        byte(n);
+        for (uint8_t i = 0; i < n; i++) byte(value[i]);
+    }
+};
+
+struct PatchReader {
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+    bool ok;
+
+    uint8_t byte() {
+        if (pos >= length) {
+            ok = false;
+            return 0;
+        }
+        return data[pos++];
+    }
+    uint16_t word() {
+        uint8_t low = byte();
+        return low | (byte() << 8);
+    }
+    // Points into data, so it is not terminated
+    const char* name(uint8_t& n) {
+        n = byte();
+        if (pos + n > length) {
+            ok = false;
+            return "";
+        }
+        const char* value = (const char*)data + pos;
+        pos += n;
+        return value;
+    }
+};
+
+size_t dmxPatchSerialize(const DmxPatch& patch, uint8_t* buffer, size_t size) {
+    PatchWriter out = { buffer, size, 0 };
+    out.byte(PATCH_VERSION);
+    out.byte(patch.typeCount);
+    for (uint8_t i = 0; i < patch.typeCount; i++) {
+        const FixtureType& type = patch.types[i];
+        out.name(type.name);
+        out.byte(type.footprint);
+        out.byte(type.attributeCount);
+        for (uint8_t j = 0; j < type.attributeCount; j++) {
+            const PatchAttribute& a = type.attributes[j];
+            out.name(a.name);
+            out.byte(a.offset | (a.fine ? 0x80 : 0));
+            out.word(a.home);
+        }
+    }
+    out.byte(patch.fixtureCount);
+    for (uint8_t i = 0; i < patch.fixtureCount; i++) {
+        const Fixture& fixture = patch.fixtures[i];
+        out.name(fixture.name);
+        out.byte(fixture.type);
+        out.byte(fixture.universe);
+        out.word(fixture.address);
+    }
+    return out.length <= size ? out.length : 0;
+}
+
+bool dmxPatchDeserialize(DmxPatch& patch, const uint8_t* data, size_t length, DmxPatch& scratch) {
+    dmxPatchInit(scratch);
+
+    PatchReader in = { data, length, 0, true };
+    if (in.byte() != PATCH_VERSION) return false;
+
+    char name[PATCH_NAME_MAX];
+    uint8_t n;
+    uint8_t typeCount = in.byte();
+    for (uint8_t i = 0; in.ok && i < typeCount; i++) {
+        const char* typeName = in.name(n);
+        if (!copyName(name, typeName, n)) return false;
+        uint8_t footprint = in.byte();
+        int type = dmxPatchAddType(scratch, name, footprint);
+        if (type < 0) return false;
+
+        uint8_t attributeCount = in.byte();
+        for (uint8_t j = 0; in.ok && j < attributeCount; j++) {
+            const char* attributeName = in.name(n);
+            if (!copyName(name, attributeName, n)) return false;
+            uint8_t offset = in.byte();
+            uint16_t home = in.word();
+            if (!dmxPatchAddAttribute(scratch, type, name, offset & 0x7F, offset & 0x80, home)) return false;
+        }
+    }
+
+    uint8_t fixtureCount = in.byte();
+    for (uint8_t i = 0; in.ok && i < fixtureCount; i++) {
+        const char* fixtureName = in.name(n);
+        if (!copyName(name, fixtureName, n)) return false;
+        uint8_t type = in.byte();
+        uint8_t universe = in.byte();
+        uint16_t address = in.word();
+        if (!dmxPatchAddFixture(scratch, name, type, universe, address)) return false;
+    }
+
+    if (!in.ok || in.pos != length) return false;
+    patch = scratch;
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dmx_universe.h"
+
+// Patch table: fixture types with their attribute maps, and the fixtures
+// placed at a start address in a universe. Commands address
+// "fixture.attribute" and get back the slot(s) to write, so clients no longer
+// do address math. 16-bit attributes (pan, tilt, ...) cover two slots, coarse
+// then fine, and take 0-65535 values.
+//
+// Names are looked up once into a PatchTarget, which holds everything needed
+// to write the attribute; keep it when addressing the same attribute often.
+
+#define PATCH_MAX_TYPES 4
+#define PATCH_MAX_ATTRIBUTES 12
+#define PATCH_MAX_FIXTURES 16
+#define PATCH_NAME_MAX 8          // Including the terminator
+#define PATCH_STORE_MAX 960       // Largest dmxPatchSerialize() output
+#define PATCH_MAX_OFFSET 127      // The stored offset byte carries the fine flag in bit 7
+
+struct PatchAttribute {
+    char name[PATCH_NAME_MAX];
+    uint8_t offset;   // From the fixture's start address
+    bool fine;        // 16-bit, fine byte at offset + 1
+    uint16_t home;    // Value written by dmxPatchHome()
+};
+
+struct FixtureType {
+    char name[PATCH_NAME_MAX];
+    uint8_t footprint;  // Slots used
+    uint8_t attributeCount;
+    PatchAttribute attributes[PATCH_MAX_ATTRIBUTES];
+};
+
+struct Fixture {
+    char name[PATCH_NAME_MAX];
+    uint8_t type;
+    uint8_t universe;   // 0-based index
+    uint16_t address;   // 1-512
+};
+
+struct DmxPatch {
+    FixtureType types[PATCH_MAX_TYPES];
+    uint8_t typeCount;
+    Fixture fixtures[PATCH_MAX_FIXTURES];
+    uint8_t fixtureCount;
+};
+
+struct PatchTarget {
+    uint8_t universe;
+    uint16_t channel;   // Coarse channel
+    bool fine;
+};
+
+void dmxPatchInit(DmxPatch& patch);
+
+// Build the patch; names longer than PATCH_NAME_MAX - 1 and attribute
+// offsets above PATCH_MAX_OFFSET are rejected. Return the new type index or
+// -1, false if the definition does not fit.
+int dmxPatchAddType(DmxPatch& patch, const char* name, uint8_t footprint);
+bool dmxPatchAddAttribute(DmxPatch& patch, uint8_t type, const char* name, uint8_t offset, bool fine, uint16_t home);
+bool dmxPatchAddFixture(DmxPatch& patch, const char* name, uint8_t type, uint8_t universe, uint16_t address);
+
+int dmxPatchFindType(const DmxPatch& patch, const char* name);
+int dmxPatchFindFixture(const DmxPatch& patch, const char* name);
+
+// Resolve "fixture.attribute", or an attribute of a fixture by index
+bool dmxPatchResolve(const DmxPatch& patch, const char* path, PatchTarget& target);
+bool dmxPatchResolveAttribute(const DmxPatch& patch, uint8_t fixture, const char* attribute, PatchTarget& target);
+
+// Write value (0-255, or 0-65535 for fine targets) to the universe the target
+// belongs to; the caller commits
+void dmxPatchWrite(DmxUniverse& universe, const PatchTarget& target, uint16_t value);
+
+// Every attribute of every fixture to its home value, without committing
+void dmxPatchHome(const DmxPatch& patch, DmxUniverse* universes, uint8_t count);
+
+// Compact binary form for the journal. Serialize returns the length, 0 if it
+// does not fit; deserialize parses into scratch and only copies it to patch
+// if the data is well formed.
+size_t dmxPatchSerialize(const DmxPatch& patch, uint8_t* buffer, size_t size);
+bool dmxPatchDeserialize(DmxPatch& patch, const uint8_t* data, size_t length, DmxPatch& scratch);
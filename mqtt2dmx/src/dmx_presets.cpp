@@ -0,0 +1,91 @@
+#include "dmx_presets.h"
+#include <string.h>
+
+static bool valid(uint8_t universe, uint16_t channel, uint8_t count) {
+    return universe < DMX_UNIVERSES && count >= 1 && count <= PRESET_MAX_VALUES && channel >= 1 &&
+           channel + count - 1 <= DMX_CHANNELS;
+}
+
+void dmxPresetInit(DmxPresetBank& bank) {
+    memset(&bank, 0, sizeof(bank));
+}
+
+bool dmxPresetStore(DmxPresetBank& bank, uint8_t id, const char* name, uint8_t universe, uint16_t channel,
+                    const uint8_t* values, uint8_t count) {
+    if (id >= PRESET_SLOTS || !valid(universe, channel, count) || name == nullptr) return false;
+    size_t length = strlen(name);
+    if (length == 0 || length >= PRESET_NAME_MAX) return false;
+    // Names go into JSON as they are
+    for (size_t i = 0; i < length; i++) {
+        if (name[i] == '"' || name[i] == '\\' || (uint8_t)name[i] < 0x20) return false;
+    }
+
+    DmxPreset& preset = bank.presets[id];
+    memset(&preset, 0, sizeof(preset));
+    preset.count = count;
+    preset.universe = universe;
+    preset.channel = channel;
+    memcpy(preset.name, name, length);
+    memcpy(preset.values, values, count);
+    return true;
+}
+
+void dmxPresetErase(DmxPresetBank& bank, uint8_t id) {
+    if (id < PRESET_SLOTS) memset(&bank.presets[id], 0, sizeof(DmxPreset));
+}
+
+int dmxPresetFind(const DmxPresetBank& bank, const char* name) {
+    if (name == nullptr) return -1;
+    for (uint8_t i = 0; i < PRESET_SLOTS; i++) {
+        if (bank.presets[i].count > 0 && strcmp(bank.presets[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int dmxPresetFree(const DmxPresetBank& bank) {
+    for (uint8_t i = 0; i < PRESET_SLOTS; i++) {
+        if (bank.presets[i].count == 0) return i;
+    }
+    return -1;
+}
+
+const uint8_t* dmxPresetRecord(const DmxPresetBank& bank, uint8_t id, uint8_t& length) {
+    if (id >= PRESET_SLOTS || bank.presets[id].count == 0) return nullptr;
+    length = PRESET_HEADER_SIZE + bank.presets[id].count;
+    return (const uint8_t*)&bank.presets[id];
+}
+
+bool dmxPresetDecode(DmxPresetBank& bank, uint8_t id, const uint8_t* record, uint8_t length) {
+    dmxPresetErase(bank, id);
+    if (id >= PRESET_SLOTS || length < PRESET_HEADER_SIZE || length > sizeof(DmxPreset)) return false;
+
+    DmxPreset preset = {};
+    memcpy(&preset, record, length);
+    if (preset.count != length - PRESET_HEADER_SIZE || memchr(preset.name, '\0', PRESET_NAME_MAX) == nullptr) {
+        return false;
+    }
+    return dmxPresetStore(bank, id, preset.name, preset.universe, preset.channel, preset.values, preset.count);
+}
+
+bool dmxPresetRecall(const DmxPresetBank& bank, uint8_t id, DmxUniverse* layers, uint8_t layerCount,
+                     DmxFadeEngine& fades, const DmxUniverse& fadeStart, uint32_t fadeMs, DmxFadeCurve curve,
+                     uint32_t now) {
+    if (id >= PRESET_SLOTS) return false;
+    const DmxPreset& preset = bank.presets[id];
+    if (preset.count == 0 || preset.universe >= layerCount) return false;
+
+    if (fadeMs == 0) {
+        DmxUniverse& layer = layers[preset.universe];
+        dmxUniverseWrite(layer, preset.channel, preset.values, preset.count);
+        dmxUniverseCommit(layer);
+        return true;
+    }
+
+    // The fade engine only runs on universe 1
+    if (preset.universe != 0) return false;
+    bool ok = true;
+    for (uint8_t i = 0; i < preset.count; i++) {
+        ok = dmxFadeStart(fades, fadeStart, preset.channel + i, preset.values[i], fadeMs, curve, false, now) && ok;
+    }
+    return ok;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dmx_universe.h"
+#include "dmx_fade.h"
+
+// Preset bank: named snapshots of a run of slots, kept in RAM and stored one
+// journal record per preset. A client recalls one by id with a few bytes
+// instead of carrying the values; the values are copied into the layer in
+// one write, or faded to on universe 1.
+
+#define PRESET_SLOTS 16
+#define PRESET_NAME_MAX 12     // Including the terminator
+#define PRESET_MAX_VALUES 24   // Fits a journal record with the header
+#define PRESET_HEADER_SIZE 16
+
+// The stored record is the first PRESET_HEADER_SIZE + count bytes
+struct DmxPreset {
+    uint8_t count;      // Values, 0 = slot unused
+    uint8_t universe;   // 0-based
+    uint16_t channel;   // First channel
+    char name[PRESET_NAME_MAX];
+    uint8_t values[PRESET_MAX_VALUES];
+};
+static_assert(offsetof(DmxPreset, values) == PRESET_HEADER_SIZE, "preset record layout");
+
+struct DmxPresetBank {
+    DmxPreset presets[PRESET_SLOTS];
+};
+
+void dmxPresetInit(DmxPresetBank& bank);
+
+// Store values for channel onwards in slot id, replacing what was there.
+// False if anything is out of range; names longer than PRESET_NAME_MAX - 1
+// are rejected rather than cut, as are names with quotes, backslashes or
+// control characters, which could not be listed as JSON unescaped.
+bool dmxPresetStore(DmxPresetBank& bank, uint8_t id, const char* name, uint8_t universe, uint16_t channel,
+                    const uint8_t* values, uint8_t count);
+void dmxPresetErase(DmxPresetBank& bank, uint8_t id);
+
+// Slot of the preset called name, and the first unused slot; -1 if none
+int dmxPresetFind(const DmxPresetBank& bank, const char* name);
+int dmxPresetFree(const DmxPresetBank& bank);
+
+// The bytes to store for slot id, nullptr if it is unused. Points into the
+// bank, so it stays valid until the slot is changed.
+const uint8_t* dmxPresetRecord(const DmxPresetBank& bank, uint8_t id, uint8_t& length);
+
+// Restore slot id from a stored record; false (and the slot unused) if it is
+// not a valid one
+bool dmxPresetDecode(DmxPresetBank& bank, uint8_t id, const uint8_t* record, uint8_t length);
+
+// Recall slot id. Without a fade the values are written into
+// layers[universe] and committed; with one, each slot fades from what
+// fadeStart is sending, which only works on universe 1. False if the slot is
+// unused, its universe is out of range or the fade slots run out.
+bool dmxPresetRecall(const DmxPresetBank& bank, uint8_t id, DmxUniverse* layers, uint8_t layerCount,
+                     DmxFadeEngine& fades, const DmxUniverse& fadeStart, uint32_t fadeMs, DmxFadeCurve curve,
+                     uint32_t now);
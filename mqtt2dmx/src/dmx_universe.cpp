@@ -0,0 +1,173 @@
+#include "dmx_universe.h"
+#include <string.h>
+
+uint8_t dmxScratch[DMX_CHANNELS];
+
+static inline uint8_t* backBuffer(DmxUniverse& universe) {
+    return universe.buffers[universe.front ^ 1];
+}
+
+static inline void markClean(DmxUniverse& universe) {
+    universe.dirtyLow = DMX_CHANNELS;
+    universe.dirtyHigh = 0;
+}
+
+static void touch(DmxUniverse& universe, uint16_t first, uint16_t last) {
+    uint8_t* flags = universe.touched;
+    for (uint16_t slot = first; slot <= last; ) {
+        if ((slot & 7) == 0 && slot + 7 <= last) {
+            flags[slot >> 3] = 0xFF;
+            slot += 8;
+        } else {
+            flags[slot >> 3] |= 1 << (slot & 7);
+            slot++;
+        }
+    }
+}
+
+// Widen the dirty range and frame length to cover first..last
+static uint8_t* extend(DmxUniverse& universe, uint16_t first, uint16_t last) {
+    if (first < universe.dirtyLow) universe.dirtyLow = first;
+    if (last > universe.dirtyHigh) universe.dirtyHigh = last;
+    if (last + 1 > universe.highestChannel) universe.highestChannel = last + 1;
+    return backBuffer(universe) + first;
+}
+
+// Copy count values from first (or fill them with value if values is
+// nullptr), flagging only the slots that change as touched
+static void store(DmxUniverse& universe, uint16_t first, const uint8_t* values, uint8_t value, uint16_t count) {
+    uint8_t* slots = extend(universe, first, first + count - 1);
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t v = values ? values[i] : value;
+        if (slots[i] == v) continue;
+        slots[i] = v;
+        uint16_t slot = first + i;
+        universe.touched[slot >> 3] |= 1 << (slot & 7);
+    }
+}
+
+void dmxUniverseInit(DmxUniverse& universe, uint8_t* storage, bool layer) {
+    memset(storage, 0, layer ? DMX_LAYER_STORAGE : DMX_UNIVERSE_STORAGE);
+    universe.buffers[0] = storage;
+    universe.buffers[1] = layer ? storage : storage + DMX_CHANNELS;
+    memset(universe.touched, 0, sizeof(universe.touched));
+    universe.front = 0;
+    universe.commitPending = false;
+    universe.highestChannel = 0;
+    universe.activeSlots = 0;
+    markClean(universe);
+}
+
+void dmxUniverseSet(DmxUniverse& universe, uint16_t channel, uint8_t value) {
+    if (channel < 1 || channel > DMX_CHANNELS) return;
+
+    store(universe, channel - 1, nullptr, value, 1);
+}
+
+uint8_t* dmxUniverseReserve(DmxUniverse& universe, uint16_t startChannel, uint16_t count) {
+    if (startChannel < 1 || count == 0 || startChannel + count - 1 > DMX_CHANNELS) return nullptr;
+
+    uint16_t first = startChannel - 1;
+    uint16_t last = first + count - 1;
+    touch(universe, first, last);
+    return extend(universe, first, last);
+}
+
+bool dmxUniverseUpdate(DmxUniverse& universe, uint16_t startChannel, const uint8_t* values, uint16_t count) {
+    if (startChannel < 1 || startChannel > DMX_CHANNELS || count == 0) return false;
+    if (count > DMX_CHANNELS - startChannel + 1) count = DMX_CHANNELS - startChannel + 1;
+
+    // Narrow down to the changed range, then write just that
+    const uint8_t* current = backBuffer(universe) + startChannel - 1;
+    uint16_t first = 0;
+    while (first < count && current[first] == values[first]) first++;
+    if (first == count) return false;
+    uint16_t last = count - 1;
+    while (current[last] == values[last]) last--;
+
+    store(universe, startChannel - 1 + first, values + first, 0, last - first + 1);
+    return true;
+}
+
+void dmxUniverseTakeTouched(DmxUniverse& universe, uint8_t* touched) {
+    memcpy(touched, universe.touched, sizeof(universe.touched));
+    memset(universe.touched, 0, sizeof(universe.touched));
+}
+
+void dmxUniverseWrite(DmxUniverse& universe, uint16_t startChannel, const uint8_t* values, uint16_t count) {
+    if (startChannel < 1 || startChannel > DMX_CHANNELS || count == 0) return;
+    if (count > DMX_CHANNELS - startChannel + 1) count = DMX_CHANNELS - startChannel + 1;
+
+    store(universe, startChannel - 1, values, 0, count);
+}
+
+#define RLE_LITERAL 0x00
+#define RLE_REPEAT 0x80
+#define RLE_SKIP 0xC0
+
+// Walk the runs, writing only if a universe is given. Returns false on a truncated
+// run or one that goes past the end of the universe.
+static bool decodeRle(DmxUniverse* universe, uint16_t startChannel, const uint8_t* data, uint16_t length) {
+    uint16_t channel = startChannel;
+    uint16_t i = 0;
+    while (i < length) {
+        uint8_t control = data[i++];
+        uint8_t type = control & 0x80 ? control & 0xC0 : RLE_LITERAL;
+        uint16_t count = (type == RLE_LITERAL ? control & 0x7F : control & 0x3F) + 1;
+        if (channel + count - 1 > DMX_CHANNELS) return false;
+
+        if (type == RLE_LITERAL) {
+            if (i + count > length) return false;
+            if (universe) store(*universe, channel - 1, data + i, 0, count);
+            i += count;
+        } else if (type == RLE_REPEAT) {
+            if (i >= length) return false;
+            if (universe) store(*universe, channel - 1, nullptr, data[i], count);
+            i++;
+        }
+        channel += count;
+    }
+    return true;
+}
+
+bool dmxUniverseWriteRle(DmxUniverse& universe, uint16_t startChannel, const uint8_t* data, uint16_t length) {
+    if (startChannel < 1 || startChannel > DMX_CHANNELS) return false;
+    if (!decodeRle(nullptr, startChannel, data, length)) return false;
+    return decodeRle(&universe, startChannel, data, length);
+}
+
+uint8_t dmxUniverseGet(const DmxUniverse& universe, uint16_t channel) {
+    if (channel < 1 || channel > DMX_CHANNELS) return 0;
+    return universe.buffers[universe.front ^ 1][channel - 1];
+}
+
+void dmxUniverseCommit(DmxUniverse& universe) {
+    if (universe.dirtyLow <= universe.dirtyHigh) {
+        universe.commitPending = true;
+    }
+}
+
+uint16_t dmxUniverseSlotCount(const DmxUniverse& universe) {
+    if (universe.activeSlots > 0) return universe.activeSlots;
+    return universe.highestChannel > 0 ? universe.highestChannel : 1;
+}
+
+void dmxUniverseSetActiveSlots(DmxUniverse& universe, uint16_t slots) {
+    universe.activeSlots = slots > DMX_CHANNELS ? DMX_CHANNELS : slots;
+}
+
+const uint8_t* dmxUniverseFlip(DmxUniverse& universe) {
+    if (universe.commitPending) {
+        universe.front ^= 1;
+        universe.commitPending = false;
+
+        // The old front buffer missed everything written since the last flip
+        const uint8_t* front = universe.buffers[universe.front];
+        if (front != backBuffer(universe)) {
+            memcpy(backBuffer(universe) + universe.dirtyLow, front + universe.dirtyLow,
+                   universe.dirtyHigh - universe.dirtyLow + 1);
+        }
+        markClean(universe);
+    }
+    return universe.buffers[universe.front];
+}
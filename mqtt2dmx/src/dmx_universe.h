@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#define DMX_CHANNELS 512  // Total DMX channels
+
+#ifndef DMX_UNIVERSES
+#define DMX_UNIVERSES 2   // One per output port, see dmx_output.h
+#endif
+
+// Double-buffered DMX universe. Writers only ever touch the back buffer and
+// call dmxUniverseCommit() once a batch of changes is complete; the output
+// flips buffers at the next frame boundary, so a batch is either entirely on
+// the wire or not at all. The transmitter reads the front buffer in place.
+//
+// Merge layers (see dmx_merge.h) are only ever written and read from loop(),
+// so they use the same API on a single buffer: both buffer pointers refer to
+// the same storage and a flip only consumes the commit.
+#define DMX_UNIVERSE_STORAGE (2 * DMX_CHANNELS)
+#define DMX_LAYER_STORAGE DMX_CHANNELS
+
+struct DmxUniverse {
+    uint8_t* buffers[2];
+    uint8_t front;        // Index of the buffer currently being transmitted
+    bool commitPending;   // Back buffer holds a complete batch
+    uint16_t dirtyLow;    // Slot range written since the last flip
+    uint16_t dirtyHigh;   // (dirtyLow > dirtyHigh when clean)
+    uint16_t highestChannel; // Highest channel ever written
+    uint16_t activeSlots;    // Fixed frame length, 0 = follow highestChannel
+    uint8_t touched[DMX_CHANNELS / 8]; // Slots written since dmxUniverseTakeTouched()
+};
+
+// One universe of values for whoever needs them in passing: the merge, the
+// network and UDP receivers, the fail-safe fade. All of them run from loop()
+// and none keeps anything in it across calls, so they share this one.
+extern uint8_t dmxScratch[DMX_CHANNELS];
+
+// storage holds DMX_UNIVERSE_STORAGE bytes, or DMX_LAYER_STORAGE for a layer
+void dmxUniverseInit(DmxUniverse& universe, uint8_t* storage, bool layer = false);
+
+// Channel numbers are 1-based like on the wire; out of range writes are ignored
+void dmxUniverseSet(DmxUniverse& universe, uint16_t channel, uint8_t value);
+uint8_t dmxUniverseGet(const DmxUniverse& universe, uint16_t channel);
+
+// Copy a run of slot values starting at startChannel, clipped to the universe
+void dmxUniverseWrite(DmxUniverse& universe, uint16_t startChannel, const uint8_t* values, uint16_t count);
+
+// Mark count slots from startChannel as written, and all of them as touched
+// whatever the caller puts there, and return where they live in the back
+// buffer. Returns nullptr if the range does not fit.
+uint8_t* dmxUniverseReserve(DmxUniverse& universe, uint16_t startChannel, uint16_t count);
+
+// Run-length/delta encoded write starting at startChannel. The data is a
+// sequence of runs, each introduced by one control byte:
+//   0nnnnnnn  n+1 literal values follow
+//   10nnnnnn  the next byte is repeated n+1 times
+//   11nnnnnn  n+1 slots are left as they are
+// Nothing is written unless the whole sequence decodes and fits the universe.
+bool dmxUniverseWriteRle(DmxUniverse& universe, uint16_t startChannel, const uint8_t* data, uint16_t length);
+
+// Write count values from startChannel, but only the slots that differ, so
+// an unchanged universe stays clean. Returns true if anything changed.
+bool dmxUniverseUpdate(DmxUniverse& universe, uint16_t startChannel, const uint8_t* values, uint16_t count);
+
+// Back buffer for reading, e.g. by the merge
+inline const uint8_t* dmxUniverseValues(const DmxUniverse& universe) {
+    return universe.buffers[universe.front ^ 1];
+}
+
+// Writes flag the slots whose value they change as touched (dmxUniverseReserve()
+// all of them), which is how the merge tells which slots an LTP source took
+// over; a source resending the same values takes nothing. Copies the flags
+// and clears them.
+void dmxUniverseTakeTouched(DmxUniverse& universe, uint8_t* touched);
+
+// Mark the back buffer as a consistent state to send
+void dmxUniverseCommit(DmxUniverse& universe);
+
+// Number of slots to put on the wire. Frames only need to reach the highest
+// channel in use, which lets small rigs refresh much faster than 40Hz.
+uint16_t dmxUniverseSlotCount(const DmxUniverse& universe);
+
+// Fix the frame length (1-512) or pass 0 for automatic
+void dmxUniverseSetActiveSlots(DmxUniverse& universe, uint16_t slots);
+
+// Call at a frame boundary, once the previous frame is fully sent. Swaps the
+// buffers if a commit is pending and returns the buffer to transmit. The new
+// back buffer is brought up to date by copying only the slots written since
+// the last flip.
+const uint8_t* dmxUniverseFlip(DmxUniverse& universe);
@@ -0,0 +1,91 @@
+#include "frame_clock.h"
+#include "FspTimer.h"
+#include "log.h"
+
+static FspTimer timer;
+static bool timerReady = false;
+static uint32_t countsPerUs = 0;
+static uint32_t periodUs = 1000000UL / FRAME_RATE_DEFAULT;
+
+// Written by the tick
+static volatile uint32_t ticks = 0;
+static volatile uint32_t showMs = 0;
+static volatile uint32_t showUs = 0; // Below 1 ms, carried to the next tick
+
+static uint32_t ticksTaken = 0;
+static uint32_t lastTickUs = 0;   // Software fallback
+
+static void tick() {
+    uint32_t us = showUs + periodUs;
+    showMs = showMs + us / 1000;
+    showUs = us % 1000;
+    ticks = ticks + 1;
+}
+
+static void timerCallback(timer_callback_args_t* args) {
+    if (args->event == TIMER_EVENT_CYCLE_END) tick();
+}
+
+bool frameClockBegin(uint32_t period) {
+    periodUs = constrain(period, (uint32_t)FRAME_PERIOD_MIN, (uint32_t)FRAME_PERIOD_MAX);
+    lastTickUs = micros();
+
+    uint8_t type;
+    int8_t channel = FspTimer::get_available_timer(type);
+    if (channel < 0 || type != GPT_TIMER) {
+        LOG_WARN("Frame clock: no GPT channel free, polling micros()");
+        return false;
+    }
+
+    // A 32-bit GPT at PCLKD holds even a 1 Hz period without a prescaler
+    countsPerUs = R_FSP_SystemClockHzGet(FSP_PRIV_CLOCK_PCLKD) / 1000000UL;
+    uint32_t counts = periodUs * countsPerUs;
+    timerReady = timer.begin(TIMER_MODE_PERIODIC, type, channel, counts, counts / 2, TIMER_SOURCE_DIV_1,
+                             timerCallback, nullptr) &&
+                 timer.setup_overflow_irq(FRAME_CLOCK_IRQ_PRIORITY) && timer.open() && timer.start();
+    if (!timerReady) LOG_WARN("Frame clock: GPT setup failed, polling micros()");
+    return timerReady;
+}
+
+void frameClockSetPeriod(uint32_t period) {
+    uint32_t newPeriod = constrain(period, (uint32_t)FRAME_PERIOD_MIN, (uint32_t)FRAME_PERIOD_MAX);
+    if (newPeriod == periodUs) return;
+    noInterrupts();
+    periodUs = newPeriod;
+    interrupts();
+    // Running timer: the new period goes to the buffer register and applies
+    // from the next overflow
+    if (timerReady) timer.set_period(newPeriod * countsPerUs);
+}
+
+uint32_t frameClockPeriod() {
+    return periodUs;
+}
+
+uint32_t frameClockTake() {
+    if (!timerReady) {
+        uint32_t now = micros();
+        while (now - lastTickUs >= periodUs) {
+            lastTickUs += periodUs;
+            tick();
+        }
+    }
+
+    uint32_t due = ticks - ticksTaken;
+    ticksTaken += due;
+    return due;
+}
+
+uint32_t frameClockRemaining() {
+    if (!timerReady) {
+        uint32_t elapsed = micros() - lastTickUs;
+        return elapsed < periodUs ? periodUs - elapsed : 0;
+    }
+    if (ticks != ticksTaken) return 0;
+    uint32_t elapsed = timer.get_counter() / countsPerUs;
+    return elapsed < periodUs ? periodUs - elapsed : 0;
+}
+
+uint32_t frameClockMillis() {
+    return showMs;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+
+// DMX frame clock. A GPT channel interrupts once per frame period and the
+// scheduler starts a frame on every tick, so the refresh rate holds no
+// matter what else the loop is doing. Falls back to polling micros() when
+// no GPT channel is left.
+//
+// Shows, fades and effects run on frameClockMillis(), which advances by
+// exactly one period per tick: playback moves in whole frames and does not
+// drift against the output.
+
+#define FRAME_RATE_DEFAULT 40        // Hz
+#define FRAME_PERIOD_MIN 1204        // DMX512-A minimum break-to-break time, us
+#define FRAME_PERIOD_MAX 1000000     // 1 Hz
+#define FRAME_CLOCK_IRQ_PRIORITY 8   // Below the DMX ports
+
+bool frameClockBegin(uint32_t periodUs);
+
+// Takes effect from the next tick; clamped to FRAME_PERIOD_MIN..MAX. Periods
+// shorter than the longest universe takes to send just skip frames.
+void frameClockSetPeriod(uint32_t periodUs);
+uint32_t frameClockPeriod();  // us
+inline uint16_t frameClockRate() { return (1000000UL + frameClockPeriod() / 2) / frameClockPeriod(); }
+
+// Ticks since the last call, 0 if none are due. More than 1 means frames
+// were missed.
+uint32_t frameClockTake();
+
+// Time left until the next tick, us
+uint32_t frameClockRemaining();
+
+// Show time at the latest tick, ms
+uint32_t frameClockMillis();
@@ -0,0 +1,160 @@
+#include "http_parser.h"
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+static void fail(HttpRequest& request, uint16_t status) {
+    request.state = HTTP_ERROR;
+    request.errorStatus = status;
+}
+
+static void copyField(char* dest, size_t size, const char* src, size_t length) {
+    if (length >= size) length = size - 1;
+    memcpy(dest, src, length);
+    dest[length] = '\0';
+}
+
+// Case-insensitive "Name:" match, returns the trimmed value or nullptr
+static const char* headerValue(const char* line, const char* name) {
+    size_t nameLength = strlen(name);
+    if (strncasecmp(line, name, nameLength) != 0 || line[nameLength] != ':') return nullptr;
+
+    const char* value = line + nameLength + 1;
+    while (*value == ' ' || *value == '\t') value++;
+    return value;
+}
+
+static void parseRequestLine(HttpRequest& request) {
+    char* line = request.line;
+    char* methodEnd = strchr(line, ' ');
+    if (methodEnd == nullptr) return fail(request, 400);
+
+    size_t methodLength = methodEnd - line;
+    if (methodLength == 3 && memcmp(line, "GET", 3) == 0) request.method = HTTP_GET;
+    else if (methodLength == 4 && memcmp(line, "POST", 4) == 0) request.method = HTTP_POST;
+    else request.method = HTTP_OTHER;
+
+    char* target = methodEnd + 1;
+    char* targetEnd = strchr(target, ' ');
+    if (targetEnd == nullptr) return fail(request, 400);
+
+    char* queryStart = (char*)memchr(target, '?', targetEnd - target);
+    char* pathEnd = queryStart ? queryStart : targetEnd;
+    if ((size_t)(pathEnd - target) >= sizeof(request.path)) return fail(request, 414);
+    copyField(request.path, sizeof(request.path), target, pathEnd - target);
+    if (queryStart) {
+        copyField(request.query, sizeof(request.query), queryStart + 1, targetEnd - queryStart - 1);
+    }
+
+    request.state = HTTP_HEADERS;
+}
+
+static void parseHeaderLine(HttpRequest& request) {
+    const char* value;
+    if ((value = headerValue(request.line, "Content-Length")) != nullptr) {
+        request.contentLength = strtoul(value, nullptr, 10);
+    } else if ((value = headerValue(request.line, "Sec-WebSocket-Key")) != nullptr) {
+        copyField(request.wsKey, sizeof(request.wsKey), value, strlen(value));
+    } else if ((value = headerValue(request.line, "If-None-Match")) != nullptr) {
+        copyField(request.ifNoneMatch, sizeof(request.ifNoneMatch), value, strlen(value));
+    }
+}
+
+static void endOfHeaders(HttpRequest& request) {
+    if (request.contentLength > HTTP_MAX_BODY) return fail(request, 413);
+    if (request.contentLength > HTTP_INLINE_BODY) {
+        request.state = HTTP_NEED_BODY;
+        return;
+    }
+    request.state = request.contentLength > 0 ? HTTP_BODY : HTTP_COMPLETE;
+}
+
+static void endOfLine(HttpRequest& request) {
+    // Trailing spaces are not significant in anything we look at
+    while (request.lineLength > 0 && request.line[request.lineLength - 1] == ' ') request.lineLength--;
+    request.line[request.lineLength] = '\0';
+
+    if (request.state == HTTP_REQUEST_LINE) {
+        if (request.lineLength == 0) return; // Tolerate leading empty lines
+        if (request.lineTruncated) return fail(request, 414);
+        parseRequestLine(request);
+    } else if (request.lineLength == 0) {
+        endOfHeaders(request);
+    } else {
+        parseHeaderLine(request);
+    }
+
+    request.lineLength = 0;
+    request.lineTruncated = false;
+}
+
+void httpRequestReset(HttpRequest& request) {
+    request.state = HTTP_REQUEST_LINE;
+    request.method = HTTP_OTHER;
+    request.errorStatus = 0;
+    request.path[0] = '\0';
+    request.query[0] = '\0';
+    request.wsKey[0] = '\0';
+    request.ifNoneMatch[0] = '\0';
+    request.contentLength = 0;
+    request.lineLength = 0;
+    request.lineTruncated = false;
+    request.body = request.inlineBody;
+    request.body[0] = '\0';
+    request.bodyLength = 0;
+}
+
+void httpRequestSetBody(HttpRequest& request, char* buffer) {
+    if (request.state != HTTP_NEED_BODY) return;
+    request.body = buffer;
+    request.body[0] = '\0';
+    request.state = HTTP_BODY;
+}
+
+size_t httpParse(HttpRequest& request, const uint8_t* data, size_t length) {
+    size_t i = 0;
+
+    while (i < length && !httpDone(request) && request.state != HTTP_NEED_BODY) {
+        if (request.state == HTTP_BODY) {
+            // Bulk copy, the body is the only part that can be large
+            size_t wanted = request.contentLength - request.bodyLength;
+            size_t n = length - i < wanted ? length - i : wanted;
+            memcpy(request.body + request.bodyLength, data + i, n);
+            request.bodyLength += n;
+            i += n;
+            if (request.bodyLength == request.contentLength) {
+                request.body[request.bodyLength] = '\0';
+                request.state = HTTP_COMPLETE;
+            }
+            continue;
+        }
+
+        char c = data[i++];
+        if (c == '\n') {
+            endOfLine(request);
+        } else if (c != '\r') {
+            if (request.lineLength < HTTP_MAX_LINE - 1) {
+                request.line[request.lineLength++] = c;
+            } else {
+                request.lineTruncated = true;
+            }
+        }
+    }
+    return i;
+}
+
+bool httpQueryNumber(const HttpRequest& request, const char* name, unsigned long& value) {
+    size_t nameLength = strlen(name);
+    for (const char* p = request.query; *p != '\0'; ) {
+        if (strncmp(p, name, nameLength) == 0 && p[nameLength] == '=') {
+            const char* start = p + nameLength + 1;
+            char* end;
+            value = strtoul(start, &end, 10);
+            return end != start && (*end == '\0' || *end == '&');
+        }
+        p = strchr(p, '&');
+        if (p == nullptr) break;
+        p++;
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Incremental HTTP/1.1 request parser working on fixed buffers. Bytes can be
+// fed in chunks of any size as they arrive from the socket; the body is read
+// up to Content-Length, so requests split over several TCP segments parse the
+// same as single-segment ones. Nothing is allocated: a body goes into the
+// request's own HTTP_INLINE_BODY bytes, and a longer one waits in
+// HTTP_NEED_BODY for the caller to lend it a buffer of up to HTTP_MAX_BODY.
+
+#define HTTP_MAX_LINE 128   // Request line / header line, longer headers are truncated
+#define HTTP_MAX_PATH 48
+#define HTTP_MAX_QUERY 32
+#define HTTP_INLINE_BODY 192 // Enough for the usual control requests
+#define HTTP_MAX_BODY 1536
+
+enum HttpMethod : uint8_t {
+    HTTP_GET,
+    HTTP_POST,
+    HTTP_OTHER
+};
+
+enum HttpParseState : uint8_t {
+    HTTP_REQUEST_LINE,
+    HTTP_HEADERS,
+    HTTP_NEED_BODY,             // Headers done, the body is longer than HTTP_INLINE_BODY
+    HTTP_BODY,
+    HTTP_COMPLETE,
+    HTTP_ERROR
+};
+
+struct HttpRequest {
+    HttpParseState state;
+    HttpMethod method;
+    uint16_t errorStatus;       // Status to answer with when state is HTTP_ERROR
+    char path[HTTP_MAX_PATH];
+    char query[HTTP_MAX_QUERY]; // Everything after '?', without it
+    char wsKey[32];             // Sec-WebSocket-Key
+    char ifNoneMatch[24];       // If-None-Match, for ETag revalidation
+    uint32_t contentLength;
+    char line[HTTP_MAX_LINE];
+    uint16_t lineLength;
+    bool lineTruncated;
+    char* body;                 // Always NUL terminated
+    uint16_t bodyLength;
+    char inlineBody[HTTP_INLINE_BODY + 1];
+};
+
+void httpRequestReset(HttpRequest& request);
+
+// Read the body of a request in HTTP_NEED_BODY into buffer, which holds
+// HTTP_MAX_BODY + 1 bytes and must stay valid until the request is done
+void httpRequestSetBody(HttpRequest& request, char* buffer);
+
+// Numeric query parameter, e.g. "offset" in "offset=12&universe=2". False if
+// it is missing or not a number.
+bool httpQueryNumber(const HttpRequest& request, const char* name, unsigned long& value);
+
+// Feed received bytes. Returns how many were consumed; parsing stops at the end
+// of the request, so anything left over belongs to the next one, and in
+// HTTP_NEED_BODY, where the rest is the body.
+size_t httpParse(HttpRequest& request, const uint8_t* data, size_t length);
+
+inline bool httpDone(const HttpRequest& request) {
+    return request.state == HTTP_COMPLETE || request.state == HTTP_ERROR;
+}
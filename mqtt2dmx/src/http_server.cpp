@@ -0,0 +1,190 @@
+#include "http_server.h"
+
+struct HttpConnection {
+    WiFiClient client;
+    bool active;
+    unsigned long lastProgress;
+    HttpRequest request;
+    const uint8_t* txData;  // Streamed response body still to send
+    size_t txRemaining;
+};
+
+static HttpConnection connections[HTTP_MAX_CONNECTIONS];
+static char longBody[HTTP_MAX_BODY + 1];
+static HttpConnection* longBodyOwner = nullptr;
+static HttpRequestHandler requestHandler = nullptr;
+static HttpConnection* handlingConnection = nullptr;
+
+static const char* httpStatusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 503: return "Service Unavailable";
+        case 507: return "Insufficient Storage";
+        default: return "Error";
+    }
+}
+
+// Responses are assembled before writing: every client write is a round trip
+// to the WiFi module
+void sendResponseHeader(WiFiClient& client, int status, const char* contentType, size_t bodyLength,
+                        const char* extraHeaders) {
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n%sConnection: close\r\n\r\n",
+                     status, httpStatusText(status), contentType, (unsigned)bodyLength, extraHeaders);
+    client.write((const uint8_t*)header, min(n, (int)sizeof(header) - 1));
+}
+
+void sendResponse(WiFiClient& client, int status, const char* contentType, const char* body, size_t bodyLength) {
+    sendResponseHeader(client, status, contentType, bodyLength);
+    if (bodyLength > 0) {
+        client.write((const uint8_t*)body, bodyLength);
+    }
+}
+
+void streamResponseBody(const uint8_t* data, size_t length) {
+    if (handlingConnection == nullptr) return;
+    handlingConnection->txData = data;
+    handlingConnection->txRemaining = length;
+}
+
+void sendStatus(WiFiClient& client, int status) {
+    sendResponse(client, status, "text/plain", nullptr, 0);
+}
+
+void sendJson(WiFiClient& client, const char* json) {
+    sendResponse(client, 200, "application/json", json, strlen(json));
+}
+
+static void releaseBody(HttpConnection& connection) {
+    if (longBodyOwner == &connection) longBodyOwner = nullptr;
+}
+
+static void closeConnection(HttpConnection& connection) {
+    releaseBody(connection);
+    connection.client.stop();
+    connection.active = false;
+}
+
+// Lend the long body buffer to a request that needs it; false if it is taken
+static bool lendBody(HttpConnection& connection) {
+    if (longBodyOwner != nullptr && longBodyOwner != &connection) return false;
+    longBodyOwner = &connection;
+    httpRequestSetBody(connection.request, longBody);
+    return true;
+}
+
+static void finishRequest(HttpConnection& connection) {
+    HttpRequest& request = connection.request;
+    if (request.state == HTTP_ERROR) {
+        sendStatus(connection.client, request.errorStatus);
+    } else {
+        handlingConnection = &connection;
+        bool handedOver = requestHandler(connection.client, request);
+        handlingConnection = nullptr;
+        releaseBody(connection);
+        if (handedOver) {
+            // Socket handed over, release the slot without closing it
+            connection.active = false;
+            return;
+        }
+    }
+    // A streamed body keeps the slot until it is written out
+    if (connection.txRemaining == 0) {
+        closeConnection(connection);
+    }
+}
+
+// Write the next piece of a streamed body, close once it is all out
+static void continueResponse(HttpConnection& connection, unsigned long now) {
+    size_t n = min(connection.txRemaining, (size_t)HTTP_WRITE_CHUNK);
+    size_t written = connection.client.write(connection.txData, n);
+    if (written > 0) {
+        connection.txData += written;
+        connection.txRemaining -= written;
+        connection.lastProgress = now;
+    }
+
+    if (connection.txRemaining == 0) {
+        closeConnection(connection);
+    } else if (!connection.client.connected() || now - connection.lastProgress > HTTP_REQUEST_TIMEOUT) {
+        connection.txRemaining = 0;
+        closeConnection(connection);
+    }
+}
+
+void httpServerBegin(HttpRequestHandler handler) {
+    requestHandler = handler;
+}
+
+void httpServerAccept(WiFiClient& client) {
+    HttpConnection* freeSlot = nullptr;
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        if (connections[i].active && connections[i].client == client) return;
+        if (!connections[i].active && freeSlot == nullptr) freeSlot = &connections[i];
+    }
+
+    if (freeSlot == nullptr) {
+        sendStatus(client, 503);
+        client.stop();
+        return;
+    }
+
+    freeSlot->client = client;
+    freeSlot->active = true;
+    freeSlot->lastProgress = millis();
+    freeSlot->txData = nullptr;
+    freeSlot->txRemaining = 0;
+    httpRequestReset(freeSlot->request);
+}
+
+void httpServerLoop() {
+    if (requestHandler == nullptr) return;
+
+    unsigned long now = millis();
+    uint8_t chunk[HTTP_READ_CHUNK];
+
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        HttpConnection& connection = connections[i];
+        if (!connection.active) continue;
+
+        if (connection.txRemaining > 0) {
+            continueResponse(connection, now);
+            continue;
+        }
+
+        int available = connection.client.available();
+        if (available > 0) {
+            int n = connection.client.read(chunk, min(available, (int)sizeof(chunk)));
+            if (n > 0) {
+                size_t used = httpParse(connection.request, chunk, n);
+                if (connection.request.state == HTTP_NEED_BODY) {
+                    if (!lendBody(connection)) {
+                        sendStatus(connection.client, 503);
+                        closeConnection(connection);
+                        continue;
+                    }
+                    httpParse(connection.request, chunk + used, n - used);
+                }
+                connection.lastProgress = now;
+            }
+        } else if (!connection.client.connected()) {
+            closeConnection(connection);
+            continue;
+        }
+
+        if (httpDone(connection.request)) {
+            finishRequest(connection);
+        } else if (now - connection.lastProgress > HTTP_REQUEST_TIMEOUT) {
+            sendStatus(connection.client, 408);
+            closeConnection(connection);
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiS3.h>
+#include "http_parser.h"
+
+// Cooperative HTTP connection handling. Each connection gets a slot with its
+// own parser state; httpServerLoop() reads at most one chunk per slot and
+// returns, so a slow or stalled client costs one short pass of loop() rather
+// than holding up DMX output until it times out.
+//
+// A slot only holds a short body itself (HTTP_INLINE_BODY); one longer than
+// that gets the single HTTP_MAX_BODY buffer, or 503 while another request
+// has it: about 1.5 KB for the pool and 1.5 KB for the buffer, where a
+// full body per slot took 5.4 KB.
+
+#define HTTP_MAX_CONNECTIONS 3
+#define HTTP_READ_CHUNK 256      // Bytes read per slot per pass
+#define HTTP_REQUEST_TIMEOUT 3000 // Drop a connection that makes no progress, ms
+#define HTTP_WRITE_CHUNK 1024    // Bytes of a streamed body written per pass
+
+// Called with a complete request. Return true if the handler took the socket
+// over (WebSocket upgrade), otherwise the connection is closed afterwards.
+typedef bool (*HttpRequestHandler)(WiFiClient& client, HttpRequest& request);
+
+void httpServerBegin(HttpRequestHandler handler);
+
+// Hand a socket returned by WiFiServer::available() to the pool. Sockets that
+// already have a slot are ignored; when the pool is full the client gets 503.
+void httpServerAccept(WiFiClient& client);
+
+// Advance every open connection by one step, call every loop()
+void httpServerLoop();
+
+// Shared with the request handlers. extraHeaders, if given, must be complete
+// "Name: value\r\n" lines.
+void sendResponseHeader(WiFiClient& client, int status, const char* contentType, size_t bodyLength,
+                        const char* extraHeaders = "");
+void sendResponse(WiFiClient& client, int status, const char* contentType, const char* body, size_t bodyLength);
+void sendStatus(WiFiClient& client, int status);
+void sendJson(WiFiClient& client, const char* json);
+
+// Queue a large constant body (e.g. the gzipped UI in flash) after the header
+// has been sent. It is written HTTP_WRITE_CHUNK bytes per httpServerLoop()
+// pass, so DMX output keeps running while a page loads. Only valid from
+// inside the request handler; data must outlive the connection.
+void streamResponseBody(const uint8_t* data, size_t length);
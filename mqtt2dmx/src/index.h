@@ -138,15 +138,15 @@ button.secondary:hover {
     width: 80px;
     padding: 8px;
 }
-</style></head><body><h1>DMX Light Controller</h1><div class="page-container"><div class="controls-container"><div class="card"><h2>Position Control</h2><div class="slider-container"><label>Pan (0-540°)</label><div class="slider-row"><input type="range" id="pan" min="0" max="255" value="128"><input type="number" id="panValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Pan Fine</label><div class="slider-row"><input type="range" id="panFine" min="0" max="255" value="128"><input type="number" id="panFineValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Tilt (0-190°)</label><div class="slider-row"><input type="range" id="tilt" min="0" max="255" value="128"><input type="number" id="tiltValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Tilt Fine</label><div class="slider-row"><input type="range" id="tiltFine" min="0" max="255" value="128"><input type="number" id="tiltFineValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Movement Speed (Fast → Slow)</label><div class="slider-row"><input type="range" id="speed" min="0" max="255" value="0"><input type="number" id="speedValue" min="0" max="255" value="0"></div></div></div><div class="card"><h2>Light Control</h2><div class="slider-container"><label>Master Dimmer</label><div class="slider-row"><input type="range" id="dimmer" min="0" max="255" value="255"><input type="number" id="dimmerValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>Strobe (Slow → Fast)</label><div class="slider-row"><input type="range" id="strobe" min="0" max="255" value="0"><input type="number" id="strobeValue" min="0" max="255" value="0"></div></div><div class="slider-container"><label>Red</label><div class="slider-row"><input type="range" id="red" min="0" max="255" value="255"><input type="number" id="redValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>Green</label><div class="slider-row"><input type="range" id="green" min="0" max="255" value="255"><input type="number" id="greenValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>Blue</label><div class="slider-row"><input type="range" id="blue" min="0" max="255" value="255"><input type="number" id="blueValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>White</label><div class="slider-row"><input type="range" id="white" min="0" max="255" value="255"><input type="number" id="whiteValue" min="0" max="255" value="255"></div></div></div><div class="card"><h2>Custom Channel Control</h2><div class="custom-channel"><label>Channel: <input type="number" id="customChannel" min="1" max="512" value="1"></label><label>Value: <input type="number" id="customValue" min="0" max="255" value="0"></label><button onclick="setCustomChannel()">Set Channel</button></div><div id="customChannelHistory" style="margin-top: 10px; font-family: monospace;"></div></div></div><div class="presets-container"><div class="card presets-card"><h2>Presets</h2><div class="preset-controls"><input type="text" id="presetName" placeholder="Preset name" style="width: 200px; padding: 8px; margin-right: 5px;"><button onclick="savePreset()">Save Current as Preset</button></div><div class="preset-controls"><button onclick="downloadPresets()" class="secondary">Download All Presets</button><button onclick="document.getElementById('uploadPresets').click()" class="secondary">Upload Presets</button><input type="file" id="uploadPresets" style="display:none" onchange="uploadPresetsFile(this)"></div><div id="presetList"></div><div class="demo-controls"><h3>Demo Mode</h3><div><label>Movement Delay (ms): <input type="number" id="moveDelay" value="1000" min="0" max="10000"></label></div><div><label>Hold Time (s): <input type="number" id="holdTime" value="5" min="1" max="60"></label></div><div>Selected Sequence:</div><div id="demoSequence" class="demo-sequence"></div><div><button onclick="startDemo()" id="demoButton">Start Demo</button><button onclick="stopDemo()" class="secondary" id="stopButton" style="display:none">Stop Demo</button></div></div></div></div></div><script>const channels={pan:1,panFine:2,tilt:3,tiltFine:4,speed:5,dimmer:6,strobe:7,red:8,green:9,blue:10,white:11};Object.keys(channels).forEach(id=>{const slider=document.getElementById(id);const value=document.getElementById(id+"Value");slider.oninput=()=>{value.value=slider.value;updateChannel(channels[id],parseInt(slider.value))};value.oninput=()=>{slider.value=value.value;updateChannel(channels[id],parseInt(value.value))}});async function updateChannel(channel,value){try{const response=await fetch("/api/channels",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify({channel,value})});if(!response.ok)throw new Error("Failed to update channel")}catch(error){console.error("Error updating channel:",error)}}async function updateChannelsBatch(updates){try{const response=await fetch("/api/channels/batch",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify({updates})});if(!response.ok)throw new Error("Failed to update channels")}catch(error){console.error("Error updating channels:",error)}}function savePreset(){const name=document.getElementById("presetName").value.trim();if(!name){alert("Please enter a preset name");return}const values=Object.keys(channels).map(id=>parseInt(document.getElementById(id).value));const presets=JSON.parse(localStorage.getItem("dmxPresets")||"{}");presets[name]=values;localStorage.setItem("dmxPresets",JSON.stringify(presets));document.getElementById("presetName").value="";updatePresetList()}async function loadPreset(name){const presets=JSON.parse(localStorage.getItem("dmxPresets")||"{}");const values=presets[name];if(!values)return;const updates=[];Object.keys(channels).forEach((id,index)=>{const slider=document.getElementById(id);const valueInput=document.getElementById(id+"Value");slider.value=values[index];valueInput.value=values[index];updates.push({channel:channels[id],value:values[index]})});await updateChannelsBatch(updates)}function deletePreset(name){const presets=JSON.parse(localStorage.getItem("dmxPresets")||"{}");delete presets[name];localStorage.setItem("dmxPresets",JSON.stringify(presets));updatePresetList()}function updatePresetList(){const presets=JSON.parse(localStorage.getItem("dmxPresets")||"{}");const list=document.getElementById("presetList");list.innerHTML="";Object.entries(presets).forEach(([name,values])=>{const item=document.createElement("div");item.className="preset-item";item.innerHTML=`<span>${name}</span><div><button onclick="loadPreset('${name}')">Load</button><button onclick="togglePresetSelection('${name}')" class="secondary">Add to Demo</button><button onclick="deletePreset('${name}')" class="secondary">Delete</button></div>`;list.appendChild(item)})}function downloadPresets(){const presets=localStorage.getItem("dmxPresets")||"{}";const blob=new Blob([presets],{type:"application/json"});const url=URL.createObjectURL(blob);const a=document.createElement("a");a.href=url;a.download="dmx_presets.json";document.body.appendChild(a);a.click();document.body.removeChild(a);URL.revokeObjectURL(url)}function uploadPresetsFile(input){const file=input.files[0];if(!file)return;const reader=new FileReader;reader.onload=function(e){try{const presets=JSON.parse(e.target.result);localStorage.setItem("dmxPresets",JSON.stringify(presets));updatePresetList();input.value=""}catch(error){console.error("Error parsing presets file:",error);alert("Invalid presets file")}};reader.readAsText(file)}
+</style></head><body><h1>DMX Light Controller</h1><div class="page-container"><div class="controls-container"><div class="card"><h2>Position Control</h2><div class="slider-container"><label>Pan (0-540°)</label><div class="slider-row"><input type="range" id="pan" min="0" max="255" value="128"><input type="number" id="panValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Pan Fine</label><div class="slider-row"><input type="range" id="panFine" min="0" max="255" value="128"><input type="number" id="panFineValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Tilt (0-190°)</label><div class="slider-row"><input type="range" id="tilt" min="0" max="255" value="128"><input type="number" id="tiltValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Tilt Fine</label><div class="slider-row"><input type="range" id="tiltFine" min="0" max="255" value="128"><input type="number" id="tiltFineValue" min="0" max="255" value="128"></div></div><div class="slider-container"><label>Movement Speed (Fast → Slow)</label><div class="slider-row"><input type="range" id="speed" min="0" max="255" value="0"><input type="number" id="speedValue" min="0" max="255" value="0"></div></div></div><div class="card"><h2>Light Control</h2><div class="slider-container"><label>Master Dimmer</label><div class="slider-row"><input type="range" id="dimmer" min="0" max="255" value="255"><input type="number" id="dimmerValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>Strobe (Slow → Fast)</label><div class="slider-row"><input type="range" id="strobe" min="0" max="255" value="0"><input type="number" id="strobeValue" min="0" max="255" value="0"></div></div><div class="slider-container"><label>Red</label><div class="slider-row"><input type="range" id="red" min="0" max="255" value="255"><input type="number" id="redValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>Green</label><div class="slider-row"><input type="range" id="green" min="0" max="255" value="255"><input type="number" id="greenValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>Blue</label><div class="slider-row"><input type="range" id="blue" min="0" max="255" value="255"><input type="number" id="blueValue" min="0" max="255" value="255"></div></div><div class="slider-container"><label>White</label><div class="slider-row"><input type="range" id="white" min="0" max="255" value="255"><input type="number" id="whiteValue" min="0" max="255" value="255"></div></div></div><div class="card"><h2>Custom Channel Control</h2><div class="custom-channel"><label>Channel: <input type="number" id="customChannel" min="1" max="512" value="1"></label><label>Value: <input type="number" id="customValue" min="0" max="255" value="0"></label><button onclick="setCustomChannel()">Set Channel</button></div><div id="customChannelHistory" style="margin-top: 10px; font-family: monospace;"></div></div></div><div class="presets-container"><div class="card presets-card"><h2>Presets</h2><div class="preset-controls"><input type="text" id="presetName" placeholder="Preset name" style="width: 200px; padding: 8px; margin-right: 5px;"><button onclick="savePreset()">Save Current as Preset</button></div><div class="preset-controls"><button onclick="downloadPresets()" class="secondary">Download All Presets</button><button onclick="document.getElementById('uploadPresets').click()" class="secondary">Upload Presets</button><input type="file" id="uploadPresets" style="display:none" onchange="uploadPresetsFile(this)"></div><div id="presetList"></div><div class="demo-controls"><h3>Demo Mode</h3><div><label>Movement Delay (ms): <input type="number" id="moveDelay" value="1000" min="0" max="10000"></label></div><div><label>Hold Time (s): <input type="number" id="holdTime" value="5" min="1" max="60"></label></div><div>Selected Sequence:</div><div id="demoSequence" class="demo-sequence"></div><div><button onclick="startDemo()" id="demoButton">Start Demo</button><button onclick="stopDemo()" class="secondary" id="stopButton" style="display:none">Stop Demo</button></div><div id="showStatus">Stopped</div></div></div></div></div><script>const channels={pan:1,panFine:2,tilt:3,tiltFine:4,speed:5,dimmer:6,strobe:7,red:8,green:9,blue:10,white:11};const lastInput={};Object.keys(channels).forEach(id=>{const slider=document.getElementById(id);const value=document.getElementById(id+"Value");slider.oninput=()=>{lastInput[id]=Date.now();value.value=slider.value;updateChannel(channels[id],parseInt(slider.value))};value.oninput=()=>{lastInput[id]=Date.now();slider.value=value.value;updateChannel(channels[id],parseInt(value.value))}});async function updateChannel(channel,value){if(socketOpen()){sendChannels(channel,[value]);return}try{const response=await fetch("/api/channels",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify({channel,value})});if(!response.ok)throw new Error("Failed to update channel")}catch(error){console.error("Error updating channel:",error)}}async function updateChannelsBatch(updates){if(socketOpen()&&sendChannelRun(updates))return;try{const response=await fetch("/api/channels/batch",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify({updates})});if(!response.ok)throw new Error("Failed to update channels")}catch(error){console.error("Error updating channels:",error)}}let storedPresets=[];async function fetchPresets(){try{const response=await fetch("/api/presets");if(!response.ok)throw new Error("Failed to load presets");storedPresets=await response.json()}catch(error){console.error("Error loading presets:",error)}updatePresetList();updateDemoSequence()}function presetBlock(valueOf){const first=Math.min(...Object.values(channels));const values=new Array(Math.max(...Object.values(channels))-first+1).fill(0);Object.keys(channels).forEach((key,index)=>{values[channels[key]-first]=valueOf(key,index)});return{channel:first,values}}async function storePreset(preset){const response=await fetch("/api/presets",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify(preset)});if(!response.ok)throw new Error("Failed to store preset")}async function savePreset(){const name=document.getElementById("presetName").value.trim();if(!name){alert("Please enter a preset name");return}try{await storePreset({name,...presetBlock(key=>parseInt(document.getElementById(key).value))});document.getElementById("presetName").value=""}catch(error){console.error("Error saving preset:",error);alert("Could not store the preset (names are up to 11 characters without quotes or backslashes, 16 presets)")}fetchPresets()}async function loadPreset(id){const preset=storedPresets.find(p=>p.id===id);if(!preset)return;try{const response=await fetch("/api/presets/recall",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify({id})});if(!response.ok)throw new Error("Failed to recall preset")}catch(error){console.error("Error recalling preset:",error);return}if(preset.universe!==1)return;Object.keys(channels).forEach(key=>{const value=preset.values[channels[key]-preset.channel];if(value===undefined)return;document.getElementById(key).value=value;document.getElementById(key+"Value").value=value})}async function deletePreset(id){try{await fetch("/api/presets/delete",{method:"POST",headers:{"Content-Type":"application/json"},body:JSON.stringify({id})})}catch(error){console.error("Error deleting preset:",error)}selectedPresets=selectedPresets.filter(p=>p!==id);fetchPresets()}function updatePresetList(){const list=document.getElementById("presetList");list.innerHTML="";storedPresets.forEach(preset=>{const item=document.createElement("div");item.className="preset-item";item.innerHTML=`<span>${preset.name}</span><div><button onclick="loadPreset(${preset.id})">Load</button><button onclick="togglePresetSelection(${preset.id})" class="secondary">Add to Demo</button><button onclick="deletePreset(${preset.id})" class="secondary">Delete</button></div>`;list.appendChild(item)})}function downloadPresets(){const blob=new Blob([JSON.stringify(storedPresets)],{type:"application/json"});const url=URL.createObjectURL(blob);const a=document.createElement("a");a.href=url;a.download="dmx_presets.json";document.body.appendChild(a);a.click();document.body.removeChild(a);URL.revokeObjectURL(url)}function presetsFromFile(data){if(Array.isArray(data))return data.map(({name,universe,channel,values})=>({name,universe,channel,values}));return Object.entries(data).map(([name,values])=>({name:name.slice(0,11),...presetBlock((key,index)=>values[index]||0)}))}async function uploadPresets(presets){const failed=[];for(const preset of presets){try{await storePreset(preset)}catch(error){console.error("Error storing preset "+preset.name+":",error);failed.push(preset)}}return failed}function uploadPresetsFile(input){const file=input.files[0];if(!file)return;const reader=new FileReader;reader.onload=async function(e){let presets;try{presets=presetsFromFile(JSON.parse(e.target.result))}catch(error){console.error("Error parsing presets file:",error);alert("Invalid presets file");return}const failed=await uploadPresets(presets);input.value="";if(failed.length)alert("Could not store: "+failed.map(p=>p.name).join(", "));fetchPresets()};reader.readAsText(file)}async function migratePresets(){const saved=localStorage.getItem("dmxPresets");if(!saved)return;try{const failed=await uploadPresets(presetsFromFile(JSON.parse(saved)));if(failed.length){localStorage.setItem("dmxPresets",JSON.stringify(failed));alert("Could not move these presets to the device, they stay in this browser: "+failed.map(p=>p.name).join(", "));return}localStorage.removeItem("dmxPresets")}catch(error){console.error("Error moving presets to the device:",error)}}
 
 let selectedPresets = [];
 let isDemoRunning = false;
 
-function togglePresetSelection(name) {
-    const idx = selectedPresets.indexOf(name);
+function togglePresetSelection(id) {
+    const idx = selectedPresets.indexOf(id);
     if (idx === -1) {
-        selectedPresets.push(name);
+        selectedPresets.push(id);
     } else {
         selectedPresets.splice(idx, 1);
     }
@@ -155,9 +155,10 @@ function togglePresetSelection(name) {
 
 function updateDemoSequence() {
     const seq = document.getElementById('demoSequence');
-    seq.innerHTML = selectedPresets.map((name, idx) => 
-        `<div>${idx + 1}. ${name}</div>`
-    ).join('');
+    seq.innerHTML = selectedPresets.map((id, idx) => {
+        const preset = storedPresets.find(p => p.id === id);
+        return `<div>${idx + 1}. ${preset ? preset.name : id}</div>`;
+    }).join('');
 }
 
 async function startDemo() {
@@ -176,10 +177,7 @@ async function startDemo() {
                 'Content-Type': 'application/json'
             },
             body: JSON.stringify({
-                presets: selectedPresets.map(name => ({
-                    name,
-                    values: JSON.parse(localStorage.getItem('dmxPresets'))[name]
-                })),
+                presets: selectedPresets.map(id => ({ preset: id })),
                 moveDelay,
                 holdTime: holdTime * 1000
             })
@@ -241,6 +239,100 @@ async function setCustomChannel() {
     }
 }
 
-updatePresetList();
+// Persistent control socket, HTTP is only used while it is not open
+let ws = null;
+
+function connectSocket() {
+    ws = new WebSocket(`ws://${location.host}/ws`);
+    ws.binaryType = 'arraybuffer';
+    ws.onmessage = (event) => applyMessage(new Uint8Array(event.data));
+    ws.onclose = () => setTimeout(connectSocket, 2000);
+}
+
+function socketOpen() {
+    return ws && ws.readyState === WebSocket.OPEN;
+}
+
+// [0x01, start hi, start lo, values...]
+function sendChannels(start, values) {
+    const msg = new Uint8Array(3 + values.length);
+    msg[0] = 0x01;
+    msg[1] = start >> 8;
+    msg[2] = start & 0xff;
+    msg.set(values, 3);
+    ws.send(msg);
+}
+
+// Send a batch as one message if it covers a contiguous channel range
+function sendChannelRun(updates) {
+    const sorted = [...updates].sort((a, b) => a.channel - b.channel);
+    for (let i = 1; i < sorted.length; i++) {
+        if (sorted[i].channel !== sorted[i - 1].channel + 1) return false;
+    }
+    if (sorted.length === 0) return true;
+    sendChannels(sorted[0].channel, sorted.map(u => u.value));
+    return true;
+}
+
+// Reflect a run of channel values in the sliders, except the ones being
+// dragged: their own echo would pull them back
+function applyValues(start, values) {
+    const now = Date.now();
+    Object.keys(channels).forEach(id => {
+        const i = channels[id] - start;
+        if (i >= 0 && i < values.length && !(now - (lastInput[id] || 0) < 500)) {
+            document.getElementById(id).value = values[i];
+            document.getElementById(id + 'Value').value = values[i];
+        }
+    });
+}
+
+// The controller pushes what is on the wire and the show status:
+// [0x01, start hi, start lo, values...] the full universe,
+// [0x02, (start hi, start lo, count, values...)...] the slots that changed,
+// [0x03, flags, cue, cue count] playback
+function applyMessage(msg) {
+    if (msg[0] === 0x01 && msg.length >= 4) {
+        applyValues((msg[1] << 8) | msg[2], msg.subarray(3));
+    } else if (msg[0] === 0x02) {
+        for (let i = 1; i + 3 <= msg.length; i += 3 + msg[i + 2]) {
+            applyValues((msg[i] << 8) | msg[i + 1], msg.subarray(i + 3, i + 3 + msg[i + 2]));
+        }
+    } else if (msg[0] === 0x03 && msg.length >= 4) {
+        applyShowStatus(msg[1] & 1, msg[1] & 2, msg[2], msg[3]);
+    }
+}
+
+function applyShowStatus(running, held, cue, count) {
+    isDemoRunning = !!running;
+    document.getElementById('demoButton').style.display = running ? 'none' : 'inline-block';
+    document.getElementById('stopButton').style.display = running ? 'inline-block' : 'none';
+    document.getElementById('showStatus').textContent =
+        running ? `Cue ${cue + 1} of ${count}${held ? ', waiting for GO' : ''}` : 'Stopped';
+}
+
+// Point the sliders at the first fixture in the controller's patch. Slider
+// ids are attribute names, 16-bit attributes drive <name>Fine as well.
+async function loadPatch() {
+    try {
+        const patch = await (await fetch('/api/patch')).json();
+        const fixture = patch.fixtures[0];
+        const type = fixture && patch.types.find(t => t.name === fixture.type);
+        if (!type || fixture.universe !== 1) return;
+        for (const a of type.attributes) {
+            if (a.name in channels) channels[a.name] = fixture.address + a.offset;
+            if (a.fine && (a.name + 'Fine') in channels) channels[a.name + 'Fine'] = fixture.address + a.offset + 1;
+        }
+    } catch (error) {
+        console.error('Error loading patch:', error);
+    }
+}
+
+// Presets saved by older versions of the page move to the device once the
+// patch has mapped the channels
+loadPatch().then(() => {
+    connectSocket();
+    migratePresets().then(fetchPresets);
+});
 </script></body></html>
 )====="; 
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "journal.h"
+#include <EEPROM.h>
+#include <string.h>
+#include "log.h"
+
+#define JOURNAL_MAGIC 0x4A524E4C // "JRNL"
+#define BANK_SIZE ((JOURNAL_END - JOURNAL_START) / 2)
+#define BANK_HEADER_SIZE 8       // magic, generation
+#define RECORD_HEADER_SIZE 4     // key, length, crc16
+#define KEY_END 0xFF
+
+static uint16_t bankBase = JOURNAL_START;
+static uint32_t generation = 0;
+static uint16_t writePos = 0;
+static uint16_t recordAt[JOURNAL_MAX_KEYS]; // Latest record per key, 0 = none
+
+static uint64_t pendingMask = 0;
+static const uint8_t* pendingData[JOURNAL_MAX_KEYS];
+static uint8_t pendingLength[JOURNAL_MAX_KEYS];
+
+// Compaction in progress, see compactStep()
+static bool compacting = false;
+static bool freshBank = false; // Compacted and nothing appended since
+static uint16_t compactTarget = 0;
+static uint16_t compactPos = 0;
+static uint8_t compactKey = 0;
+
+static_assert(JOURNAL_MAX_KEYS <= 64, "pendingMask holds one bit per key");
+
+static uint16_t crc16(uint16_t crc, uint8_t byte) {
+    crc ^= byte << 8;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t recordCrc(uint8_t key, const uint8_t* data, uint8_t length) {
+    uint16_t crc = crc16(crc16(0xFFFF, key), length);
+    for (uint8_t i = 0; i < length; i++) crc = crc16(crc, data[i]);
+    return crc;
+}
+
+static uint16_t storedCrc(uint16_t pos, uint8_t key, uint8_t length) {
+    uint16_t crc = crc16(crc16(0xFFFF, key), length);
+    for (uint8_t i = 0; i < length; i++) crc = crc16(crc, EEPROM.read(pos + RECORD_HEADER_SIZE + i));
+    return crc;
+}
+
+static uint32_t readU32(uint16_t addr) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | EEPROM.read(addr + i);
+    return value;
+}
+
+static void writeU32(uint16_t addr, uint32_t value) {
+    for (int i = 0; i < 4; i++) EEPROM.update(addr + i, (value >> (8 * i)) & 0xFF);
+}
+
+static inline uint16_t bankEnd() {
+    return bankBase + BANK_SIZE;
+}
+
+// Index every valid record; the log ends at the first free or broken one
+static void scanBank() {
+    memset(recordAt, 0, sizeof(recordAt));
+    uint16_t pos = bankBase + BANK_HEADER_SIZE;
+    while (pos + RECORD_HEADER_SIZE <= bankEnd()) {
+        uint8_t key = EEPROM.read(pos);
+        if (key == KEY_END) break;
+        uint8_t length = EEPROM.read(pos + 1);
+        if (key >= JOURNAL_MAX_KEYS || length > JOURNAL_MAX_RECORD) break;
+        if (pos + RECORD_HEADER_SIZE + length > bankEnd()) break;
+
+        uint16_t crc = EEPROM.read(pos + 2) | (EEPROM.read(pos + 3) << 8);
+        if (crc != storedCrc(pos, key, length)) break;
+
+        recordAt[key] = pos;
+        pos += RECORD_HEADER_SIZE + length;
+    }
+    writePos = pos;
+}
+
+// Copy the live records into the other bank, then switch to it. One step
+// per call so a compaction never holds up the frame: the first invalidates
+// the target, each further one copies a single record and the last writes
+// the header. Copied keys already read from the target, which holds the same
+// bytes, while a power cut before the header keeps the old bank current.
+// Returns true when the switch is done.
+static bool compactStep() {
+    if (!compacting) {
+        compactTarget = bankBase == JOURNAL_START ? JOURNAL_START + BANK_SIZE : JOURNAL_START;
+        writeU32(compactTarget, 0); // Invalidate until the copy is complete
+        compactPos = compactTarget + BANK_HEADER_SIZE;
+        compactKey = 0;
+        compacting = true;
+        return false;
+    }
+
+    while (compactKey < JOURNAL_MAX_KEYS) {
+        uint8_t key = compactKey++;
+        uint16_t from = recordAt[key];
+        uint8_t length = from ? EEPROM.read(from + 1) : 0;
+        if (length == 0) {
+            recordAt[key] = 0; // Erased keys are dropped
+            continue;
+        }
+        for (uint16_t i = 0; i < RECORD_HEADER_SIZE + length; i++) {
+            EEPROM.update(compactPos + i, EEPROM.read(from + i));
+        }
+        recordAt[key] = compactPos;
+        compactPos += RECORD_HEADER_SIZE + length;
+        return false;
+    }
+
+    uint16_t target = compactTarget;
+    if (compactPos < target + BANK_SIZE) EEPROM.update(compactPos, KEY_END);
+    writeU32(target + 4, generation + 1);
+    writeU32(target, JOURNAL_MAGIC);
+
+    bankBase = target;
+    generation++;
+    writePos = compactPos;
+    compacting = false;
+    freshBank = true;
+    LOG_INFO("Journal: compacted into bank at %u, %u bytes live", target, compactPos - target);
+    return true;
+}
+
+static inline bool bankFull(uint16_t size) {
+    return writePos + size > bankEnd();
+}
+
+static bool append(uint8_t key, const uint8_t* data, uint8_t length) {
+    uint16_t size = RECORD_HEADER_SIZE + length;
+    // A direct write can't wait for journalLoop() to finish the compaction
+    if (compacting || (bankFull(size) && !freshBank)) {
+        while (!compactStep()) {}
+    }
+    if (bankFull(size)) return false;
+
+    uint16_t pos = writePos;
+    uint16_t crc = recordCrc(key, data, length);
+    EEPROM.update(pos + 1, length);
+    EEPROM.update(pos + 2, crc & 0xFF);
+    EEPROM.update(pos + 3, crc >> 8);
+    for (uint8_t i = 0; i < length; i++) EEPROM.update(pos + RECORD_HEADER_SIZE + i, data[i]);
+    if (pos + size < bankEnd()) EEPROM.update(pos + size, KEY_END);
+    EEPROM.update(pos, key); // Commit
+
+    recordAt[key] = pos;
+    writePos = pos + size;
+    freshBank = false;
+    return true;
+}
+
+void journalBegin() {
+    const uint16_t banks[2] = { JOURNAL_START, JOURNAL_START + BANK_SIZE };
+    bool found = false;
+    for (uint16_t base : banks) {
+        if (readU32(base) != JOURNAL_MAGIC) continue;
+        uint32_t gen = readU32(base + 4);
+        if (!found || (int32_t)(gen - generation) > 0) {
+            bankBase = base;
+            generation = gen;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        LOG_INFO("Journal: formatting");
+        bankBase = JOURNAL_START;
+        generation = 1;
+        EEPROM.update(bankBase + BANK_HEADER_SIZE, KEY_END);
+        writeU32(bankBase + 4, generation);
+        writeU32(bankBase, JOURNAL_MAGIC);
+    }
+    scanBank();
+}
+
+int journalRead(uint8_t key, uint8_t* buffer, uint8_t size) {
+    if (key >= JOURNAL_MAX_KEYS || recordAt[key] == 0) return -1;
+
+    uint16_t pos = recordAt[key];
+    uint8_t length = EEPROM.read(pos + 1);
+    if (length == 0) return -1;
+    for (uint8_t i = 0; i < length && i < size; i++) {
+        buffer[i] = EEPROM.read(pos + RECORD_HEADER_SIZE + i);
+    }
+    return length;
+}
+
+bool journalWrite(uint8_t key, const uint8_t* data, uint8_t length) {
+    if (key >= JOURNAL_MAX_KEYS || length > JOURNAL_MAX_RECORD) return false;
+    if (data == nullptr) length = 0;
+
+    // Delta write: skip records that already hold this value
+    uint16_t pos = recordAt[key];
+    if (pos != 0 && EEPROM.read(pos + 1) == length) {
+        bool same = true;
+        for (uint8_t i = 0; i < length && same; i++) {
+            same = EEPROM.read(pos + RECORD_HEADER_SIZE + i) == data[i];
+        }
+        if (same) return true;
+    } else if (pos == 0 && length == 0) {
+        return true;
+    }
+
+    return append(key, data, length);
+}
+
+void journalQueue(uint8_t key, const uint8_t* data, uint8_t length) {
+    if (key >= JOURNAL_MAX_KEYS) return;
+    pendingData[key] = data;
+    pendingLength[key] = data ? length : 0;
+    pendingMask |= 1ULL << key;
+}
+
+bool journalPending() {
+    return pendingMask != 0 || compacting;
+}
+
+void journalLoop() {
+    if (compacting) {
+        compactStep();
+        return;
+    }
+    if (pendingMask == 0) return;
+
+    // A full bank is compacted a step per call first, the key stays pending
+    uint8_t key = __builtin_ctzll(pendingMask);
+    if (bankFull(RECORD_HEADER_SIZE + pendingLength[key]) && !freshBank) {
+        compactStep();
+        return;
+    }
+    pendingMask &= ~(1ULL << key);
+    if (!journalWrite(key, pendingData[key], pendingLength[key])) {
+        LOG_ERROR("Journal: write of key %u failed", key);
+    }
+}
+
+uint16_t journalCrc(const uint8_t* data, uint16_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) crc = crc16(crc, data[i]);
+    return crc;
+}
+
+bool journalQueueBlob(JournalBlob& blob, const uint8_t* data, uint16_t length) {
+    if (length > blob.chunks * JOURNAL_MAX_RECORD) return false;
+
+    uint16_t crc = journalCrc(data, length);
+    blob.header[0] = length & 0xFF;
+    blob.header[1] = length >> 8;
+    blob.header[2] = crc & 0xFF;
+    blob.header[3] = crc >> 8;
+
+    for (uint16_t offset = 0; offset < length; offset += JOURNAL_MAX_RECORD) {
+        uint16_t chunk = length - offset < JOURNAL_MAX_RECORD ? length - offset : JOURNAL_MAX_RECORD;
+        journalQueue(blob.firstKey + offset / JOURNAL_MAX_RECORD, data + offset, chunk);
+    }
+    journalQueue(blob.firstKey + blob.chunks, blob.header, sizeof(blob.header));
+    return true;
+}
+
+void journalEraseBlob(JournalBlob& blob) {
+    journalQueue(blob.firstKey + blob.chunks, nullptr, 0);
+}
+
+int journalReadBlob(const JournalBlob& blob, uint8_t* buffer, uint16_t size) {
+    uint8_t header[4];
+    if (journalRead(blob.firstKey + blob.chunks, header, sizeof(header)) != sizeof(header)) {
+        return JOURNAL_BLOB_MISSING;
+    }
+
+    uint16_t length = header[0] | (header[1] << 8);
+    uint16_t crc = header[2] | (header[3] << 8);
+    if (length > size || length > blob.chunks * JOURNAL_MAX_RECORD) return JOURNAL_BLOB_DAMAGED;
+
+    for (uint16_t offset = 0; offset < length; offset += JOURNAL_MAX_RECORD) {
+        uint16_t chunk = length - offset < JOURNAL_MAX_RECORD ? length - offset : JOURNAL_MAX_RECORD;
+        if (journalRead(blob.firstKey + offset / JOURNAL_MAX_RECORD, buffer + offset, chunk) != chunk) {
+            return JOURNAL_BLOB_DAMAGED;
+        }
+    }
+    return journalCrc(buffer, length) == crc ? length : JOURNAL_BLOB_DAMAGED;
+}
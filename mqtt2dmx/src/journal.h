@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+// Wear-leveled record store in the EEPROM (data flash) area above the fixed
+// WiFi/MQTT slots. Small keyed records are appended to a log in one of two
+// banks; a rewrite of a key appends a new version instead of wearing the same
+// cells. When a bank fills, the live records are compacted into the other
+// bank, whose header is written last, so a power cut at any point leaves the
+// previous state readable.
+//
+// Record: [key] [length] [crc16 over key, length and data] [data]
+// The key byte is written last and 0xFF ends the log, so a torn append is
+// simply not there after a reset. Every record is CRC checked when mounting.
+//
+// Writes can be queued and are then done one record per journalLoop() call,
+// which the main loop runs right after starting a DMX frame. A compaction
+// started from there also copies one record per call.
+
+#define JOURNAL_START 512
+#define JOURNAL_END 8192           // EEPROM size on the RA4M1
+#define JOURNAL_MAX_KEYS 64
+#define JOURNAL_MAX_RECORD 64      // Data bytes per record
+
+// Mount the newest valid bank, formatting the area if there is none
+void journalBegin();
+
+// Copy the latest value of key into buffer. Returns its length, or -1 if the
+// key was never written or has been erased.
+int journalRead(uint8_t key, uint8_t* buffer, uint8_t size);
+
+// Append a new version of key now. Unchanged data is not written again.
+bool journalWrite(uint8_t key, const uint8_t* data, uint8_t length);
+
+// Defer a write to journalLoop(). data must stay valid until it is written;
+// queuing a key again replaces the pending write. nullptr erases the key.
+// Pending keys are written lowest first.
+void journalQueue(uint8_t key, const uint8_t* data, uint8_t length);
+bool journalPending();
+
+// Write at most one queued record
+void journalLoop();
+
+// CRC16-CCITT as used for records, for values spread over several keys
+uint16_t journalCrc(const uint8_t* data, uint16_t length);
+
+// Values larger than one record, split into chunks on consecutive keys from
+// firstKey, followed by a header key with the length and a CRC over the whole
+// value. Pending keys are written lowest first, so the header always lands
+// after the chunks and a save cut short reads back as damaged, never as a
+// mix of two versions.
+struct JournalBlob {
+    uint8_t firstKey;
+    uint8_t chunks;     // Keys reserved for data, the header is firstKey + chunks
+    uint8_t header[4];  // u16 length, u16 crc, kept here until written
+};
+
+#define JOURNAL_BLOB_MISSING -1
+#define JOURNAL_BLOB_DAMAGED -2
+
+// Queue the whole value; data must stay valid until it is written. False if
+// it needs more than blob.chunks records.
+bool journalQueueBlob(JournalBlob& blob, const uint8_t* data, uint16_t length);
+void journalEraseBlob(JournalBlob& blob);
+
+// Returns the length, or JOURNAL_BLOB_MISSING / JOURNAL_BLOB_DAMAGED
+int journalReadBlob(const JournalBlob& blob, uint8_t* buffer, uint16_t size);
@@ -0,0 +1,85 @@
+#include "log.h"
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "LOG_BUFFER_SIZE must be a power of two");
+
+static char ring[LOG_BUFFER_SIZE];
+static uint16_t head = 0;  // Next byte to write
+static uint16_t tail = 0;  // Next byte to send
+static uint16_t dropped = 0;
+
+static const char levelPrefix[] = "?EWID";
+
+static inline uint16_t used() {
+    return (head - tail) & (LOG_BUFFER_SIZE - 1);
+}
+
+// Whole messages only, so the output never has torn lines
+static bool push(const char* data, uint16_t length) {
+    if (length >= LOG_BUFFER_SIZE - used()) return false;
+    for (uint16_t i = 0; i < length; i++) {
+        ring[head] = data[i];
+        head = (head + 1) & (LOG_BUFFER_SIZE - 1);
+    }
+    return true;
+}
+
+void logPrintf(uint8_t level, const char* format, ...) {
+    char line[LOG_LINE_MAX];
+    line[0] = levelPrefix[level < sizeof(levelPrefix) - 1 ? level : 0];
+    line[1] = ' ';
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line + 2, sizeof(line) - 4, format, args);
+    va_end(args);
+    if (n < 0) return;
+
+    uint16_t length = 2 + min(n, (int)sizeof(line) - 5);
+    line[length++] = '\r';
+    line[length++] = '\n';
+
+    if (dropped > 0) {
+        char notice[32];
+        int m = snprintf(notice, sizeof(notice), "W %u log messages dropped\r\n", dropped);
+        if (!push(notice, m)) {
+            dropped++;
+            return;
+        }
+        dropped = 0;
+    }
+    if (!push(line, length)) dropped++;
+}
+
+void logLoop() {
+    while (used() > 0) {
+        int room = Serial.availableForWrite();
+        if (room <= 0) return;
+
+        // Up to the end of the ring in one write
+        uint16_t contiguous = head >= tail ? head - tail : LOG_BUFFER_SIZE - tail;
+        uint16_t n = min((int)contiguous, room);
+        size_t written = Serial.write((const uint8_t*)ring + tail, n);
+        if (written == 0) return;
+        tail = (tail + written) & (LOG_BUFFER_SIZE - 1);
+    }
+}
+
+void logFlush() {
+    unsigned long start = millis();
+    while (used() > 0) {
+        logLoop();
+        if (millis() - start >= LOG_FLUSH_TIMEOUT) {
+            // Nobody is reading (no USB host): drop the rest, don't hang
+            tail = head;
+            return;
+        }
+    }
+    Serial.flush();
+}
+
+#endif
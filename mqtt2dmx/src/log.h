@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+// Leveled logging. Messages are formatted into a RAM ring buffer and drained
+// to Serial from logLoop() only as fast as the USB CDC endpoint accepts them,
+// so logging never blocks the control loop. When the buffer is full new
+// messages are dropped and counted.
+//
+// LOG_LEVEL is set at compile time (build_flags); calls above it compile to
+// nothing, arguments included. Release builds use LOG_LEVEL_NONE.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_BUFFER_SIZE 1024  // Ring buffer, bytes
+#define LOG_LINE_MAX 128      // Longer messages are truncated
+#define LOG_FLUSH_TIMEOUT 100 // ms logFlush() waits for Serial
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+void logPrintf(uint8_t level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Write out what Serial can take without blocking, call every loop()
+void logLoop();
+
+// Block until everything is written, e.g. before a reset. Gives up after
+// LOG_FLUSH_TIMEOUT if Serial stops taking data and drops what is left.
+void logFlush();
+
+#else
+
+inline void logLoop() {}
+inline void logFlush() {}
+
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logPrintf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logPrintf(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logPrintf(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logPrintf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
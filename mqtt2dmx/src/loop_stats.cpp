@@ -0,0 +1,129 @@
+#include "loop_stats.h"
+#include <Arduino.h>
+#include <string.h>
+#include <stdarg.h>
+
+struct Stat {
+    uint32_t count;
+    uint32_t min;    // Cycles
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[STAT_BUCKETS];
+};
+
+static Stat stats[STAT_COUNT];
+static uint32_t cyclesPerUs = 48;
+
+// Main stack bounds from the FSP linker script
+extern "C" uint32_t __StackLimit;
+extern "C" uint32_t __StackTop;
+#define STACK_PAINT 0xA5A5A5A5
+#define STACK_PAINT_MARGIN 64 // Words left alone below the current stack pointer
+
+static const char* const statNames[STAT_COUNT] = {
+    "loop", "frame", "frameInterval", "show", "merge", "journal",
+    "ble", "mqtt", "network", "udp", "rdm", "input", "websocket", "http", "wifi", "log"
+};
+
+static void record(StatId id, uint32_t cycles) {
+    Stat& stat = stats[id];
+    stat.count++;
+    stat.total += cycles;
+    if (cycles < stat.min) stat.min = cycles;
+    if (cycles > stat.max) stat.max = cycles;
+
+    // Buckets grow by 4x from 16us
+    uint32_t us = cycles / cyclesPerUs;
+    uint8_t bucket = 0;
+    for (uint32_t limit = 16; bucket < STAT_BUCKETS - 1 && us >= limit; limit <<= 2) bucket++;
+    stat.histogram[bucket]++;
+}
+
+static void paintStack() {
+    uint32_t* sp = (uint32_t*)(uintptr_t)__get_MSP() - STACK_PAINT_MARGIN;
+    for (uint32_t* p = &__StackLimit; p < sp; p++) *p = STACK_PAINT;
+}
+
+size_t statsStackFree() {
+    const uint32_t* p = &__StackLimit;
+    while (p < &__StackTop && *p == STACK_PAINT) p++;
+    return (p - &__StackLimit) * sizeof(uint32_t);
+}
+
+void statsBegin() {
+    paintStack();
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    cyclesPerUs = SystemCoreClock / 1000000;
+    statsReset();
+}
+
+void statsReset() {
+    memset(stats, 0, sizeof(stats));
+    for (Stat& stat : stats) stat.min = UINT32_MAX;
+}
+
+uint32_t statsStart() {
+    return DWT->CYCCNT;
+}
+
+void statsEnd(StatId id, uint32_t start) {
+    record(id, DWT->CYCCNT - start);
+}
+
+uint32_t statsElapsedUs(uint32_t start) {
+    return (DWT->CYCCNT - start) / cyclesPerUs;
+}
+
+void statsRecordUs(StatId id, uint32_t us) {
+    record(id, us * cyclesPerUs);
+}
+
+// snprintf at buffer + n, advancing n; stops quietly when the buffer is full
+static void append(char* buffer, size_t size, size_t& n, const char* format, ...) {
+    if (n >= size) return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + n, size - n, format, args);
+    va_end(args);
+    if (written > 0) n += written;
+}
+
+static void appendSection(char* buffer, size_t size, size_t& n, StatId id, bool histograms) {
+    const Stat& stat = stats[id];
+    uint32_t avg = stat.count ? (uint32_t)(stat.total / stat.count) : 0;
+    append(buffer, size, n, "{\"n\":%lu,\"min\":%lu,\"avg\":%lu,\"max\":%lu", (unsigned long)stat.count,
+           (unsigned long)(stat.count ? stat.min / cyclesPerUs : 0), (unsigned long)(avg / cyclesPerUs),
+           (unsigned long)(stat.max / cyclesPerUs));
+    if (histograms) {
+        append(buffer, size, n, ",\"hist\":[");
+        for (int b = 0; b < STAT_BUCKETS; b++) {
+            append(buffer, size, n, "%s%lu", b ? "," : "", (unsigned long)stat.histogram[b]);
+        }
+        append(buffer, size, n, "]");
+    }
+    append(buffer, size, n, "}");
+}
+
+const char* statsName(StatId id) {
+    return statNames[id];
+}
+
+size_t statsSectionJson(StatId id, char* buffer, size_t size) {
+    size_t n = 0;
+    appendSection(buffer, size, n, id, false);
+    return n < size ? n : size - 1;
+}
+
+size_t statsJson(char* buffer, size_t size, bool histograms) {
+    size_t n = 0;
+    append(buffer, size, n, "{");
+    for (int i = 0; i < STAT_COUNT; i++) {
+        append(buffer, size, n, "%s\"%s\":", i ? "," : "", statNames[i]);
+        appendSection(buffer, size, n, (StatId)i, histograms);
+    }
+    append(buffer, size, n, "}");
+
+    return n < size ? n : size - 1;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Loop timing instrumentation on the Cortex-M4 cycle counter (DWT CYCCNT).
+// Each section keeps count, min, max and total cycles plus a histogram of
+// durations, so jitter shows up and not just the averages. Recording a
+// sample costs a few dozen cycles.
+//
+//   uint32_t t = statsStart();
+//   BLE.poll();
+//   statsEnd(STAT_BLE, t);
+
+enum StatId : uint8_t {
+    STAT_LOOP,           // One full pass of loop()
+    STAT_FRAME,          // One frame tick: show, merges and starting the TX
+    STAT_FRAME_INTERVAL, // Time between frame starts
+    STAT_SHOW,           // Cue, fade and effect ticks
+    STAT_MERGE,          // Merging the source layers into a universe
+    STAT_JOURNAL,        // Deferred data flash writes
+    STAT_BLE,
+    STAT_MQTT,
+    STAT_NETWORK,        // Art-Net / sACN receive
+    STAT_UDP,            // UDP control commands
+    STAT_RDM,            // Starting and finishing RDM transactions
+    STAT_INPUT,          // Publishing the DMX input
+    STAT_WEBSOCKET,
+    STAT_HTTP,
+    STAT_WIFI,
+    STAT_LOG,
+    STAT_COUNT
+};
+
+// Histogram bucket i counts samples shorter than 16 * 4^i us, the last bucket
+// everything longer: <16us, <64us, <256us, <1ms, <4ms, <16ms, <65ms, more
+#define STAT_BUCKETS 8
+
+// Also fills the unused main stack with a pattern, so call it first thing
+void statsBegin();
+void statsReset();
+
+// Bytes of main stack never used since statsBegin(), the stack high-water
+// mark seen from below
+size_t statsStackFree();
+
+uint32_t statsStart();
+void statsEnd(StatId id, uint32_t start);
+
+// Time since statsStart() without recording it, us
+uint32_t statsElapsedUs(uint32_t start);
+
+// For intervals measured without the cycle counter
+void statsRecordUs(StatId id, uint32_t us);
+
+// {"section":{"n":..,"min":..,"avg":..,"max":..,"hist":[..]},...}, times in
+// us. Returns the length written, truncated to size - 1.
+size_t statsJson(char* buffer, size_t size, bool histograms);
+
+// One section without the histogram, {"n":..,"min":..,"avg":..,"max":..},
+// small enough for an MQTT message of its own
+#define STATS_SECTION_JSON_MAX 67 // Every counter at UINT32_MAX
+const char* statsName(StatId id);
+size_t statsSectionJson(StatId id, char* buffer, size_t size);
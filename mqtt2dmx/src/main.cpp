@@ -3,7 +3,30 @@
 #include <WiFiS3.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
-#include <ArduinoBLE.h>
+#include <WDT.h>
+#include "dmx_output.h"
+#include "dmx_universe.h"
+#include "dmx_merge.h"
+#include "dmx_fade.h"
+#include "dmx_cues.h"
+#include "dmx_effects.h"
+#include "dmx_patch.h"
+#include "dmx_demo.h"
+#include "dmx_presets.h"
+#include "dmx_bridge.h"
+#include "dmx_failsafe.h"
+#include "mqtt_control.h"
+#include "dmx_network.h"
+#include "udp_control.h"
+#include "rdm_controller.h"
+#include "websocket.h"
+#include "http_server.h"
+#include "log.h"
+#include "journal.h"
+#include "loop_stats.h"
+#include "ble_provision.h"
+#include "frame_clock.h"
+#include "scheduler.h"
 
 // WiFi credentials (will be loaded from EEPROM)
 char ssid[64] = "";
@@ -12,23 +35,41 @@ char password[64] = "";
 // Web server on port 80
 WiFiServer server(80);
 
-// DMX configuration
-#define DMX_TX_PIN 1      // Serial1 TX (D1)
-#define DMX_DE_PIN 2      // Direction Enable for MAX485
-#define DMX_CHANNELS 512  // Total DMX channels
-#define DMX_BREAK_TIME 92 // 92μs break
-#define DMX_MAB_TIME 12   // 12μs mark after break
-#define DMX_FRAME_TIME 25000  // 25ms = 40Hz
-
-// Demo mode state & preset storage
-#define MAX_PRESETS 10
-#define CHANNELS_PER_PRESET 11
+// WiFi comes up in the background; DMX output never waits for it.
+// WiFi.begin() only starts the join, loop() watches the status.
+#define WIFI_STATUS_INTERVAL 500   // Each status() is a round trip to the modem
+#define WIFI_RETRY_INTERVAL 10000  // Rejoin after a failed attempt or a drop
+#define WIFI_JOIN_TIMEOUT 20000
+enum WifiState { WIFI_OFF, WIFI_JOINING, WIFI_UP, WIFI_DOWN };
+WifiState wifiState = WIFI_OFF;
+unsigned long wifiStateTime = 0;
+unsigned long lastWifiStatus = 0;
+bool networkStarted = false;
+
+// DMX configuration (pins and break timing live in dmx_output.h, the frame
+// rate in frame_clock.h)
+#define FRAME_AUTO_MARGIN 100 // us added to the longest frame at the automatic rate
 
 // EEPROM configuration
 #define EEPROM_WIFI_ADDR 0
-#define EEPROM_DEMO_ADDR 512
+#define EEPROM_MQTT_ADDR 256
 #define EEPROM_WIFI_MAGIC 0x57494649 // "WIFI"
-#define EEPROM_DEMO_MAGIC 0x444D5844 // "DMXD"
+#define EEPROM_MQTT_MAGIC 0x4D515454 // "MQTT"
+
+// Journal keys (see journal.h, the journal starts at JOURNAL_START = 512).
+// The show and the patch are blobs split into record-sized chunks, so
+// changing one cue only rewrites the chunks it touches; each is followed by
+// its header key. Presets take one key per slot, the DMX input and fail-safe
+// settings one each.
+#define JOURNAL_KEY_SHOW 0         // Chunks 0..SHOW_CHUNKS-1, header SHOW_CHUNKS
+#define SHOW_CHUNKS (CUE_LIST_MAX / JOURNAL_MAX_RECORD)
+#define JOURNAL_KEY_PATCH (SHOW_CHUNKS + 1)
+#define PATCH_CHUNKS ((PATCH_STORE_MAX + JOURNAL_MAX_RECORD - 1) / JOURNAL_MAX_RECORD)
+#define JOURNAL_KEY_PRESETS (JOURNAL_KEY_PATCH + PATCH_CHUNKS + 1)
+#define JOURNAL_KEY_INPUT (JOURNAL_KEY_PRESETS + PRESET_SLOTS)
+#define JOURNAL_KEY_FAILSAFE (JOURNAL_KEY_INPUT + 1)
+static_assert(JOURNAL_KEY_FAILSAFE < JOURNAL_MAX_KEYS, "journal keys exhausted");
+static_assert(PRESET_HEADER_SIZE + PRESET_MAX_VALUES <= JOURNAL_MAX_RECORD, "preset does not fit a record");
 
 struct WifiConfig {
   uint32_t magic;
@@ -36,280 +77,255 @@ struct WifiConfig {
   char password[64];
 };
 
-struct DemoConfig {
-  uint32_t magic;
-  uint8_t numPresets;
-  unsigned long moveDelay;
-  unsigned long holdTime;
-  uint8_t presets[MAX_PRESETS][CHANNELS_PER_PRESET];
+// Stored show, played back from the frame tick
+CueList show;
+CuePlayer showPlayer;
+JournalBlob showBlob = { JOURNAL_KEY_SHOW, SHOW_CHUNKS };
+
+// Fixture patch, stored serialized
+DmxPatch patch;
+JournalBlob patchBlob = { JOURNAL_KEY_PATCH, PATCH_CHUNKS };
+uint8_t patchStore[PATCH_STORE_MAX];
+DmxPatch patchScratch; // A patch being parsed, too big for the stack
+
+// Preset bank, recalled by id over HTTP, MQTT and UDP
+DmxPresetBank presetBank;
+
+// DMX input: port 1 (Serial1) receives a console's universe instead of
+// sending one, and the bridge publishes its changes to <base>/input/... and
+// as UDP control datagrams. Universe 1 is still merged (the web UI shows
+// it), it just does not go out.
+#define INPUT_DELTA_MAX 256 // Longer diffs go out as the full universe
+struct DmxInputConfig {
+  uint8_t enabled;
+  uint8_t mqtt;
+  uint8_t udpUniverse;  // Universe in the datagrams, for the receiving end
+  uint8_t reserved;
+  uint32_t udpAddress;  // 0 = no UDP target
+  uint16_t udpPort;
+  uint16_t interval;    // ms between updates
 };
-
-// Demo mode state
-bool demoMode = false;
-unsigned long demoLastUpdate = 0;
-unsigned long demoMoveDelay = 1000;  // Movement delay in ms
-unsigned long demoHoldTime = 5000;   // Hold time in ms
-int demoCurrentStep = 0;  // 0: fade out, 1: move, 2: wait move, 3: fade in, 4: hold
-int demoCurrentPreset = 0;
-
-// Current fade values
-float currentFadeProgress = 0.0;
-uint8_t fadeStartColors[6] = {0}; // Dimmer, Strobe, R, G, B, W
-#define FADE_TIME 5000 // 5 seconds fade
-
-// Store preset data statically
-uint8_t storedPresets[MAX_PRESETS][CHANNELS_PER_PRESET];
-int numStoredPresets = 0;
-
-// DMX data buffer and timing
-uint8_t dmxData[DMX_CHANNELS] = {0};
+DmxInputConfig inputConfig = { 0, 1, 1, 0, 0, UDP_CONTROL_PORT, DMX_BRIDGE_INTERVAL };
+DmxBridge inputBridge;
+uint8_t inputStorage[2 * DMX_CHANNELS];
+uint8_t inputDelta[INPUT_DELTA_MAX];
+
+// Fail-safe: a layer in every universe that takes over the output when the
+// network goes (see dmx_failsafe.h), and the watchdog that resets a setup()
+// or loop() stuck for longer than WATCHDOG_TIMEOUT. What goes out is kept in
+// RAM that survives the reset and sent again before the rest of setup().
+#define WATCHDOG_TIMEOUT 4000 // ms, the WDT goes up to about 5.5 s
+struct FailsafeConfig {
+  uint8_t policy;
+  uint8_t preset;
+  uint16_t reserved;
+  uint32_t delay;
+  uint32_t fadeMs;
+};
+FailsafeConfig failsafeConfig = { FAILSAFE_HOLD, 0, 0, FAILSAFE_DELAY, FAILSAFE_FADE };
+DmxFailsafe failsafe;
+DmxUniverse failsafeLayers[DMX_UNIVERSES];
+DmxRetainedScene retainedScene __attribute__((section(".noinit")));
+bool watchdogReset = false;
+bool sceneResumed = false;
+
+// DMX universes (front/back buffers), one output port each, and timing.
+// Nothing writes them directly: every input has its own layer per universe,
+// merged into the universe right before each frame. HTTP, WebSocket, MQTT
+// and BLE share the manual layer. Shows, fades and effects run on the show
+// layer of the first universe and start from what is on the wire.
+static_assert(DMX_UNIVERSES >= 1 && DMX_UNIVERSES <= 2, "one DMX_PORT_n config per universe");
+DmxUniverse universes[DMX_UNIVERSES];
+DmxUniverse& universe = universes[0];
+DmxUniverse manualLayers[DMX_UNIVERSES];
+DmxUniverse networkLayers[DMX_UNIVERSES];
+DmxUniverse showLayer;
+DmxMerge merges[DMX_UNIVERSES];
+uint8_t universeStorage[DMX_UNIVERSES][DMX_UNIVERSE_STORAGE];
+uint8_t layerStorage[3 * DMX_UNIVERSES + 1][DMX_LAYER_STORAGE];
+
+// Merge sources, in this order in every universe (only the first has a show).
+// All LTP at the same priority, so the latest change wins slot by slot.
+enum MergeSourceId : uint8_t { SOURCE_MANUAL, SOURCE_NETWORK, SOURCE_SHOW, SOURCE_COUNT };
+const char* const mergeSourceNames[SOURCE_COUNT] = { "manual", "network", "show" };
+// The fail-safe layer is merged last everywhere and left out of the merge API
+inline uint8_t mergeUserSources(const DmxMerge& merge) { return merge.count - 1; }
+#define MERGE_DEFAULT_PRIORITY 100
+DmxPort dmxPorts[DMX_UNIVERSES] = {
+    { DMX_PORT_1, universes[0] },
+#if DMX_UNIVERSES > 1
+    { DMX_PORT_2, universes[1] },
+#endif
+};
+DmxFadeEngine fades;
+DmxEffectEngine effects;
 unsigned long lastFrameTime = 0;
 unsigned long frameCount = 0;
+bool frameRateAuto = false; // Frame rate follows the frame length
 
-// BLE Service and Characteristics
-BLEService wifiConfigService("1820");  // Using a standard service UUID for better visibility
-BLEStringCharacteristic ssidCharacteristic("2ABE", BLERead | BLEWrite, 64);
-BLEStringCharacteristic passwordCharacteristic("2AC4", BLERead | BLEWrite, 64);
-bool bleConfigMode = false;
-unsigned long bleConfigStartTime = 0;
+// Body of the larger GET responses (stats, patch, presets); the handlers run
+// one at a time from the HTTP task. Sized for a full preset bank.
+#define RESPONSE_JSON_SIZE 2688
+char responseJson[RESPONSE_JSON_SIZE];
 
-// Track if both characteristics have been written
-bool ssidWritten = false;
-bool passwordWritten = false;
+// Timing stats are published to <base>/stats this often
+#define STATS_PUBLISH_INTERVAL 10000
+unsigned long lastStatsPublish = 0;
+uint8_t statsPublishNext = STAT_COUNT; // Next section to publish, STAT_COUNT when done
+
+// No stored credentials, BLE provisioning stays up until they arrive
+bool bleConfigMode = false;
 
 // Function declarations
-void saveWifiConfig(String newSsid, String newPassword);
+void saveWifiConfig(const char* newSsid, const char* newPassword);
 void loadWifiConfig();
-void setDMXChannel(uint16_t channel, uint8_t value);
-void sendDMXBreak();
-void sendDMXFrame();
-void processDemo();
-void handleWebRequest(WiFiClient client);
-void saveDemoToEEPROM();
-void clearDemoFromEEPROM();
-void loadDemoFromEEPROM();
-void printBLEInfo();
-
-// Forward declare the BLE handlers
-void onSsidCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic);
-void onPasswordCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic);
-
-// Include the web interface
-#include "index.h"
+void saveMqttConfig(const MqttConfig& config);
+void loadMqttConfig();
+bool handleHttpRequest(WiFiClient& client, HttpRequest& request);
+void onMqttCommand(const char* command, const uint8_t* payload, unsigned int length);
+void saveShow();
+void clearShow();
+void loadShow();
+void loadPatch();
+void loadPresets();
+void loadInputConfig();
+void loadFailsafeConfig();
+
+// Include the web interface, gzipped from index.h at build time
+#include "index_html_gz.h"
 
 // Function implementations
-void saveWifiConfig(String newSsid, String newPassword) {
+void saveWifiConfig(const char* newSsid, const char* newPassword) {
   WifiConfig config;
   config.magic = EEPROM_WIFI_MAGIC;
-  strncpy(config.ssid, newSsid.c_str(), sizeof(config.ssid) - 1);
-  strncpy(config.password, newPassword.c_str(), sizeof(config.password) - 1);
+  strncpy(config.ssid, newSsid, sizeof(config.ssid) - 1);
+  strncpy(config.password, newPassword, sizeof(config.password) - 1);
   config.ssid[sizeof(config.ssid) - 1] = '\0';
   config.password[sizeof(config.password) - 1] = '\0';
 
-  Serial.println("Saving WiFi config to EEPROM...");
+  LOG_INFO("Saving WiFi config to EEPROM...");
   EEPROM.put(EEPROM_WIFI_ADDR, config);
-  Serial.println("WiFi config saved. Rebooting in 3 seconds...");
+  LOG_INFO("WiFi config saved. Rebooting in 3 seconds...");
+  logFlush();
   delay(3000);
   NVIC_SystemReset();
 }
 
-// Set DMX channel value
-void setDMXChannel(uint16_t channel, uint8_t value) {
-    if (channel >= 1 && channel <= DMX_CHANNELS) {
-        dmxData[channel - 1] = value;
-    }
-}
-
-// Send DMX break signal
-void sendDMXBreak() {
-    Serial1.end();
-    pinMode(DMX_TX_PIN, OUTPUT);
-    digitalWrite(DMX_TX_PIN, LOW);
-    delayMicroseconds(DMX_BREAK_TIME);
-    digitalWrite(DMX_TX_PIN, HIGH);
-    delayMicroseconds(DMX_MAB_TIME);
-    Serial1.begin(250000, SERIAL_8N2);
-}
-
-// Send complete DMX frame
-void sendDMXFrame() {
-    frameCount++;
-    digitalWrite(DMX_DE_PIN, HIGH);
-    sendDMXBreak();
-    Serial1.write((uint8_t)0x00);
-    for (int i = 0; i < DMX_CHANNELS; i++) {
-        Serial1.write((uint8_t)dmxData[i]);
-    }
-    Serial1.flush();
-    digitalWrite(DMX_DE_PIN, LOW);
-}
-
-// Demo mode functions
-void processDemo() {
-    if (!demoMode) return;
-
-    unsigned long currentTime = millis();
-    unsigned long stepTime = currentTime - demoLastUpdate;
-
-    // Debug current state
-    static int lastStep = -1;
-    if (demoCurrentStep != lastStep) {
-        Serial.print("Demo step changed to: ");
-        Serial.print(demoCurrentStep);
-        Serial.print(" (Preset: ");
-        Serial.print(demoCurrentPreset);
-        Serial.println(")");
-        lastStep = demoCurrentStep;
-
-        // Store start values at the beginning of fades
-        if (demoCurrentStep == 0) { // Start of fade out
-            fadeStartColors[0] = dmxData[5];  // Dimmer
-            fadeStartColors[1] = dmxData[6];  // Strobe
-            fadeStartColors[2] = dmxData[7];  // Red
-            fadeStartColors[3] = dmxData[8];  // Green
-            fadeStartColors[4] = dmxData[9];  // Blue
-            fadeStartColors[5] = dmxData[10]; // White
-            currentFadeProgress = 0.0;
-            Serial.println("Starting fade out from:");
-            Serial.print("Dimmer: "); Serial.print(fadeStartColors[0]);
-            Serial.print(" RGB: "); Serial.print(fadeStartColors[2]);
-            Serial.print(","); Serial.print(fadeStartColors[3]);
-            Serial.print(","); Serial.println(fadeStartColors[4]);
-        }
-        else if (demoCurrentStep == 3) { // Start of fade in
-            memset(fadeStartColors, 0, sizeof(fadeStartColors));
-            currentFadeProgress = 0.0;
-            Serial.println("Starting fade in");
-        }
-    }
+// 0-based index of the universe in a request's optional "universe" field
+// (1-based, default 1); -1 if it is out of range
+int universeIndex(JsonVariant index) {
+    int u = index | 1;
+    return u >= 1 && u <= DMX_UNIVERSES ? u - 1 : -1;
+}
 
-    switch (demoCurrentStep) {
-        case 0: // Fade out colors
-            // Calculate fade progress (0.0 to 1.0)
-            currentFadeProgress = min(1.0, (float)stepTime / FADE_TIME);
-            
-            // Linear interpolation from current colors to black
-            for (int i = 0; i < 6; i++) {
-                uint8_t targetValue = 0;
-                uint8_t currentValue = fadeStartColors[i] + (targetValue - fadeStartColors[i]) * currentFadeProgress;
-                setDMXChannel(6 + i, currentValue);  // Channels 6-11 (Dimmer through White)
-            }
+// Persisting is deferred: the chunks are written one per frame from loop()
+void saveShow() {
+  journalQueueBlob(showBlob, show.data, show.length);
+  LOG_INFO("Show queued for saving, %u bytes", show.length);
+}
 
-            if (stepTime % 1000 == 0) { // Debug print every second
-                Serial.print("Fade out progress: ");
-                Serial.print(currentFadeProgress * 100);
-                Serial.println("%");
-            }
+void clearShow() {
+  LOG_INFO("Clearing stored show");
+  journalEraseBlob(showBlob);
+}
 
-            if (currentFadeProgress >= 1.0) {
-                Serial.println("Fade out complete");
-                demoCurrentStep = 1;
-                demoLastUpdate = currentTime;
-            }
-            break;
-
-        case 1: // Change position
-            Serial.println("Changing position...");
-            Serial.print("Setting channels from preset ");
-            Serial.println(demoCurrentPreset);
-            
-            // Set position channels from stored preset
-            setDMXChannel(1, storedPresets[demoCurrentPreset][0]); // Pan
-            setDMXChannel(2, storedPresets[demoCurrentPreset][1]); // Pan Fine
-            setDMXChannel(3, storedPresets[demoCurrentPreset][2]); // Tilt
-            setDMXChannel(4, storedPresets[demoCurrentPreset][3]); // Tilt Fine
-            setDMXChannel(5, storedPresets[demoCurrentPreset][4]); // Speed
-            
-            demoCurrentStep = 2;
-            demoLastUpdate = currentTime;
-            break;
-
-        case 2: // Wait for movement
-            if (stepTime >= demoMoveDelay) {
-                Serial.print("Movement wait complete (");
-                Serial.print(demoMoveDelay);
-                Serial.println("ms)");
-                demoCurrentStep = 3;
-                demoLastUpdate = currentTime;
-            }
-            break;
-
-        case 3: // Fade in colors
-            // Calculate fade progress (0.0 to 1.0)
-            currentFadeProgress = min(1.0, (float)stepTime / FADE_TIME);
-            
-            // Linear interpolation from black to target colors
-            setDMXChannel(6, fadeStartColors[0] + (storedPresets[demoCurrentPreset][5] - fadeStartColors[0]) * currentFadeProgress);   // Dimmer
-            setDMXChannel(7, fadeStartColors[1] + (storedPresets[demoCurrentPreset][6] - fadeStartColors[1]) * currentFadeProgress);   // Strobe
-            setDMXChannel(8, fadeStartColors[2] + (storedPresets[demoCurrentPreset][7] - fadeStartColors[2]) * currentFadeProgress);   // Red
-            setDMXChannel(9, fadeStartColors[3] + (storedPresets[demoCurrentPreset][8] - fadeStartColors[3]) * currentFadeProgress);   // Green
-            setDMXChannel(10, fadeStartColors[4] + (storedPresets[demoCurrentPreset][9] - fadeStartColors[4]) * currentFadeProgress);  // Blue
-            setDMXChannel(11, fadeStartColors[5] + (storedPresets[demoCurrentPreset][10] - fadeStartColors[5]) * currentFadeProgress); // White
-
-            if (stepTime % 1000 == 0) { // Debug print every second
-                Serial.print("Fade in progress: ");
-                Serial.print(currentFadeProgress * 100);
-                Serial.println("%");
-            }
+void loadShow() {
+  int length = journalReadBlob(showBlob, show.data, CUE_LIST_MAX);
+  if (length == JOURNAL_BLOB_MISSING) {
+    LOG_INFO("No stored show.");
+    return;
+  }
 
-            if (currentFadeProgress >= 1.0) {
-                Serial.println("Fade in complete");
-                demoCurrentStep = 4;
-                demoLastUpdate = currentTime;
-            }
-            break;
-
-        case 4: // Hold
-            if (stepTime >= demoHoldTime) {
-                Serial.print("Hold complete, moving to next preset (");
-                Serial.print(demoHoldTime);
-                Serial.println("ms)");
-                demoCurrentStep = 0;
-                demoLastUpdate = currentTime;
-                demoCurrentPreset = (demoCurrentPreset + 1) % numStoredPresets;
-            }
-            break;
-    }
+  if (length >= 0 && dmxCueLoad(show, show.data, length)) {
+    LOG_INFO("Found valid stored show. Starting automatically.");
+    dmxCuePlay(showPlayer, 0, frameClockMillis());
+  } else {
+    LOG_WARN("Stored show is damaged, ignoring it.");
+    dmxCueLoad(show, nullptr, 0);
+  }
+}
+
+// The moving head the web UI and the demo were written for, at address 1
+void defaultPatch() {
+  dmxPatchInit(patch);
+  int head = dmxPatchAddType(patch, "head", 11);
+  dmxPatchAddAttribute(patch, head, "pan", 0, true, 0x0080);
+  dmxPatchAddAttribute(patch, head, "tilt", 2, true, 0x0080);
+  dmxPatchAddAttribute(patch, head, "speed", 4, false, 0);
+  dmxPatchAddAttribute(patch, head, "dimmer", 5, false, 0);
+  dmxPatchAddAttribute(patch, head, "strobe", 6, false, 0);
+  dmxPatchAddAttribute(patch, head, "red", 7, false, 0);
+  dmxPatchAddAttribute(patch, head, "green", 8, false, 0);
+  dmxPatchAddAttribute(patch, head, "blue", 9, false, 0);
+  dmxPatchAddAttribute(patch, head, "white", 10, false, 0);
+  dmxPatchAddFixture(patch, "head1", head, 0, 1);
+}
+
+bool savePatch() {
+  uint16_t length = dmxPatchSerialize(patch, patchStore, sizeof(patchStore));
+  if (length == 0) return false;
+  journalQueueBlob(patchBlob, patchStore, length);
+  LOG_INFO("Patch queued for saving, %u bytes", length);
+  return true;
+}
+
+void loadPatch() {
+  int length = journalReadBlob(patchBlob, patchStore, sizeof(patchStore));
+  if (length >= 0 && dmxPatchDeserialize(patch, patchStore, length, patchScratch)) {
+    LOG_INFO("Loaded patch: %u fixtures", patch.fixtureCount);
+    return;
+  }
+
+  if (length != JOURNAL_BLOB_MISSING) LOG_WARN("Stored patch is damaged, using the default.");
+  defaultPatch();
 }
 
-void saveDemoToEEPROM() {
-  DemoConfig config;
-  config.magic = EEPROM_DEMO_MAGIC;
-  config.numPresets = numStoredPresets;
-  config.moveDelay = demoMoveDelay;
-  config.holdTime = demoHoldTime;
-  memcpy(config.presets, storedPresets, sizeof(storedPresets));
+// Queue the slot's record, or erase it if the slot is now unused
+void savePreset(uint8_t id) {
+  uint8_t length = 0;
+  const uint8_t* record = dmxPresetRecord(presetBank, id, length);
+  journalQueue(JOURNAL_KEY_PRESETS + id, record, length);
+  LOG_INFO("Preset %u queued for saving, %u bytes", id, length);
+}
 
-  Serial.println("Saving demo to EEPROM...");
-  EEPROM.put(EEPROM_DEMO_ADDR, config);
-  Serial.println("Save complete.");
+void loadPresets() {
+  dmxPresetInit(presetBank);
+  uint8_t record[JOURNAL_MAX_RECORD];
+  uint8_t count = 0;
+  for (uint8_t id = 0; id < PRESET_SLOTS; id++) {
+    int length = journalRead(JOURNAL_KEY_PRESETS + id, record, sizeof(record));
+    if (length < 0) continue;
+    if (dmxPresetDecode(presetBank, id, record, length)) count++;
+    else LOG_WARN("Stored preset %u is damaged, ignoring it.", id);
+  }
+  LOG_INFO("Loaded %u presets", count);
 }
 
-void clearDemoFromEEPROM() {
-  Serial.println("Clearing demo from EEPROM...");
-  uint32_t magic = 0; // Invalidate the magic number
-  EEPROM.put(EEPROM_DEMO_ADDR, magic);
-  Serial.println("EEPROM cleared.");
+void saveInputConfig() {
+  journalQueue(JOURNAL_KEY_INPUT, (const uint8_t*)&inputConfig, sizeof(inputConfig));
 }
 
-void loadDemoFromEEPROM() {
-  DemoConfig config;
-  EEPROM.get(EEPROM_DEMO_ADDR, config);
+void loadInputConfig() {
+  DmxInputConfig stored;
+  if (journalRead(JOURNAL_KEY_INPUT, (uint8_t*)&stored, sizeof(stored)) == sizeof(stored)) {
+    inputConfig = stored;
+    LOG_INFO("DMX input %s", inputConfig.enabled ? "enabled" : "disabled");
+  }
+  dmxBridgeInit(inputBridge, inputConfig.interval);
+}
 
-  if (config.magic == EEPROM_DEMO_MAGIC) {
-    Serial.println("Found valid demo in EEPROM. Starting automatically.");
-    numStoredPresets = config.numPresets;
-    demoMoveDelay = config.moveDelay;
-    demoHoldTime = config.holdTime;
-    memcpy(storedPresets, config.presets, sizeof(storedPresets));
+void saveFailsafeConfig() {
+  journalQueue(JOURNAL_KEY_FAILSAFE, (const uint8_t*)&failsafeConfig, sizeof(failsafeConfig));
+}
 
-    demoCurrentPreset = 0;
-    demoCurrentStep = 0;
-    demoLastUpdate = millis();
-    demoMode = true;
-  } else {
-    Serial.println("No valid demo found in EEPROM.");
+void loadFailsafeConfig() {
+  FailsafeConfig stored;
+  if (journalRead(JOURNAL_KEY_FAILSAFE, (uint8_t*)&stored, sizeof(stored)) == sizeof(stored)) {
+    failsafeConfig = stored;
   }
+  dmxFailsafeConfigure(failsafe, (DmxFailsafePolicy)failsafeConfig.policy, failsafeConfig.preset,
+                       failsafeConfig.delay, failsafeConfig.fadeMs);
+  LOG_INFO("Fail-safe on network loss: %s", dmxFailsafePolicyName(failsafe.policy));
 }
 
 void loadWifiConfig() {
@@ -321,354 +337,1298 @@ void loadWifiConfig() {
     strncpy(password, config.password, sizeof(password) - 1);
     ssid[sizeof(ssid) - 1] = '\0';
     password[sizeof(password) - 1] = '\0';
-    Serial.println("Loaded WiFi config from EEPROM.");
+    LOG_INFO("Loaded WiFi config from EEPROM.");
   } else {
-    Serial.println("No valid WiFi config found in EEPROM. Entering BLE config mode.");
+    LOG_INFO("No valid WiFi config found in EEPROM. Entering BLE config mode.");
     bleConfigMode = true;
   }
 }
 
-// Handle incoming web requests
-void handleWebRequest(WiFiClient client) {
-    String currentLine = "";
-    String httpMethod = "";
-    String path = "";
-    bool headersDone = false;
-    String body = "";
-    
-    unsigned long timeout = millis();
-    
-    while (client.connected() && millis() - timeout < 1000) {
-        if (client.available()) {
-            char c = client.read();
-            timeout = millis();
-            
-            if (!headersDone) {
-                if (c == '\n') {
-                    if (currentLine.length() == 0) {
-                        headersDone = true;
-                        
-                        if (httpMethod == "POST") {
-                            while (client.available()) {
-                                body += (char)client.read();
-                            }
-                        }
-                        
-                        if (path == "/") {
-                            client.println("HTTP/1.1 200 OK");
-                            client.println("Content-Type: text/html");
-                            client.println();
-                            client.print(INDEX_HTML);
-                        }
-                        else if (path == "/api/channels" && httpMethod == "POST") {
-                            StaticJsonDocument<200> doc;
-                            DeserializationError error = deserializeJson(doc, body);
-                            
-                            if (!error) {
-                                int channel = doc["channel"];
-                                int value = doc["value"];
-                                
-                                if (channel >= 1 && channel <= DMX_CHANNELS) {
-                                    setDMXChannel(channel, value);
-                                    client.println("HTTP/1.1 200 OK");
-                                    client.println("Content-Type: application/json");
-                                    client.println();
-                                    client.println("{\"status\":\"ok\"}");
-                                } else {
-                                    client.println("HTTP/1.1 400 Bad Request");
-                                    client.println();
-                                }
-                            }
-                        }
-                        else if (path == "/api/channels/batch" && httpMethod == "POST") {
-                            StaticJsonDocument<1024> doc;
-                            DeserializationError error = deserializeJson(doc, body);
-                            
-                            if (!error) {
-                                JsonArray updates = doc["updates"];
-                                bool valid = true;
-                                
-                                for (JsonObject update : updates) {
-                                    int channel = update["channel"];
-                                    int value = update["value"];
-                                    if (channel < 1 || channel > DMX_CHANNELS || value < 0 || value > 255) {
-                                        valid = false;
-                                        break;
-                                    }
-                                }
-                                
-                                if (valid) {
-                                    for (JsonObject update : updates) {
-                                        setDMXChannel(update["channel"], update["value"]);
-                                    }
-                                    
-                                    client.println("HTTP/1.1 200 OK");
-                                    client.println("Content-Type: application/json");
-                                    client.println();
-                                    client.println("{\"status\":\"ok\"}");
-                                } else {
-                                    client.println("HTTP/1.1 400 Bad Request");
-                                    client.println();
-                                }
-                            }
-                        }
-                        else if (path == "/api/demo/start" && httpMethod == "POST") {
-                            StaticJsonDocument<4096> doc;
-                            DeserializationError error = deserializeJson(doc, body);
-                            
-                            if (!error) {
-                                Serial.println("Starting demo mode...");
-                                Serial.print("Request body: ");
-                                Serial.println(body);
-                                
-                                JsonArray presets = doc["presets"];
-                                if (presets.isNull()) {
-                                    Serial.println("ERROR: No presets array in request!");
-                                    client.println("HTTP/1.1 400 Bad Request");
-                                    client.println();
-                                    return;
-                                }
-
-                                Serial.print("Number of presets: ");
-                                Serial.println(presets.size());
-
-                                if (presets.size() < 2 || presets.size() > MAX_PRESETS) {
-                                    Serial.println("ERROR: Invalid number of presets!");
-                                    client.println("HTTP/1.1 400 Bad Request");
-                                    client.println();
-                                    return;
-                                }
-
-                                // Store presets in our static array
-                                numStoredPresets = 0;
-                                for (JsonObject preset : presets) {
-                                    if (!preset.containsKey("values")) {
-                                        Serial.println("ERROR: Preset missing values array!");
-                                        continue;
-                                    }
-
-                                    JsonArray values = preset["values"];
-                                    if (values.size() < CHANNELS_PER_PRESET) {
-                                        Serial.println("ERROR: Preset values array too small!");
-                                        continue;
-                                    }
-
-                                    // Copy values to our static array
-                                    for (int i = 0; i < CHANNELS_PER_PRESET; i++) {
-                                        storedPresets[numStoredPresets][i] = values[i];
-                                    }
-                                    numStoredPresets++;
-
-                                    Serial.print("Stored preset ");
-                                    Serial.print(numStoredPresets - 1);
-                                    Serial.print(": Pan=");
-                                    Serial.print(storedPresets[numStoredPresets-1][0]);
-                                    Serial.print(", Tilt=");
-                                    Serial.println(storedPresets[numStoredPresets-1][2]);
-                                }
-
-                                if (numStoredPresets < 2) {
-                                    Serial.println("ERROR: Not enough valid presets!");
-                                    client.println("HTTP/1.1 400 Bad Request");
-                                    client.println();
-                                    return;
-                                }
-
-                                // Set demo parameters
-                                demoMoveDelay = doc["moveDelay"] | 1000;
-                                demoHoldTime = doc["holdTime"] | 5000;
-                                demoCurrentPreset = 0;
-                                demoCurrentStep = 0;
-                                demoLastUpdate = millis();
-                                demoMode = true;
-
-                                Serial.print("Demo started with ");
-                                Serial.print(numStoredPresets);
-                                Serial.println(" presets");
-                                Serial.print("Move delay: ");
-                                Serial.print(demoMoveDelay);
-                                Serial.print("ms, Hold time: ");
-                                Serial.print(demoHoldTime);
-                                Serial.println("ms");
-                                
-                                saveDemoToEEPROM(); // Save the new demo
-                                
-                                client.println("HTTP/1.1 200 OK");
-                                client.println("Content-Type: application/json");
-                                client.println();
-                                client.println("{\"status\":\"ok\"}");
-                            } else {
-                                Serial.print("ERROR: JSON parse error - ");
-                                Serial.println(error.c_str());
-                                client.println("HTTP/1.1 400 Bad Request");
-                                client.println();
-                            }
-                        }
-                        else if (path == "/api/demo/stop" && httpMethod == "POST") {
-                            demoMode = false;
-                            clearDemoFromEEPROM(); // Clear auto-start
-                            client.println("HTTP/1.1 200 OK");
-                            client.println("Content-Type: application/json");
-                            client.println();
-                            client.println("{\"status\":\"ok\"}");
-                        }
-                        break;
-                    } else {
-                        if (httpMethod == "") {
-                            int spaceIndex = currentLine.indexOf(' ');
-                            if (spaceIndex != -1) {
-                                httpMethod = currentLine.substring(0, spaceIndex);
-                                path = currentLine.substring(spaceIndex + 1, currentLine.indexOf(' ', spaceIndex + 1));
-                            }
-                        }
-                        currentLine = "";
-                    }
-                } else if (c != '\r') {
-                    currentLine += c;
-                }
+void saveMqttConfig(const MqttConfig& config) {
+  MqttConfig stored = config;
+  stored.magic = EEPROM_MQTT_MAGIC;
+  LOG_INFO("Saving MQTT config to EEPROM...");
+  EEPROM.put(EEPROM_MQTT_ADDR, stored);
+}
+
+void loadMqttConfig() {
+  MqttConfig config;
+  EEPROM.get(EEPROM_MQTT_ADDR, config);
+
+  if (config.magic == EEPROM_MQTT_MAGIC) {
+    LOG_INFO("Loaded MQTT config from EEPROM, broker: %s", config.broker);
+    mqttConfigure(config);
+  } else {
+    LOG_INFO("No MQTT broker configured.");
+  }
+}
+
+void sendOk(WiFiClient& client) {
+    sendJson(client, "{\"status\":\"ok\"}");
+}
+
+// The page only changes with the firmware, so browsers may cache it and
+// revalidate with the ETag
+#define INDEX_CACHE_HEADERS "Cache-Control: public, max-age=604800\r\nETag: " INDEX_HTML_GZ_ETAG "\r\n"
+
+void handleRoot(WiFiClient& client, HttpRequest& request) {
+    if (strstr(request.ifNoneMatch, INDEX_HTML_GZ_ETAG) != nullptr) {
+        sendResponseHeader(client, 304, "text/html", 0, INDEX_CACHE_HEADERS);
+        return;
+    }
+
+    sendResponseHeader(client, 200, "text/html", INDEX_HTML_GZ_LEN,
+                       "Content-Encoding: gzip\r\n" INDEX_CACHE_HEADERS);
+    streamResponseBody(INDEX_HTML_GZ, INDEX_HTML_GZ_LEN);
+}
+
+void handleSetChannel(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<200> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    int channel = doc["channel"];
+    int value = doc["value"];
+    int u = universeIndex(doc["universe"]);
+    if (channel < 1 || channel > DMX_CHANNELS || u < 0) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    dmxUniverseSet(manualLayers[u], channel, value);
+    dmxUniverseCommit(manualLayers[u]);
+    sendOk(client);
+}
+
+void handleSetChannelsBatch(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<1024> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    JsonArray updates = doc["updates"];
+    int u = universeIndex(doc["universe"]);
+    if (u < 0) {
+        sendStatus(client, 400);
+        return;
+    }
+    for (JsonObject update : updates) {
+        int channel = update["channel"];
+        int value = update["value"];
+        if (channel < 1 || channel > DMX_CHANNELS || value < 0 || value > 255) {
+            sendStatus(client, 400);
+            return;
+        }
+    }
+
+    for (JsonObject update : updates) {
+        dmxUniverseSet(manualLayers[u], update["channel"], update["value"]);
+    }
+    dmxUniverseCommit(manualLayers[u]);
+    sendOk(client);
+}
+
+void handleDmxConfig(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<200> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    // Break timing applies to every port, "slots" to the given universe
+    int u = universeIndex(doc["universe"]);
+    if (u < 0) {
+        sendStatus(client, 400);
+        return;
+    }
+    DmxUniverse* target = &universes[u];
+    uint16_t breakTime = doc["breakTime"] | dmxPorts[0].breakTime();
+    uint16_t mabTime = doc["mabTime"] | dmxPorts[0].mabTime();
+    for (DmxPort& port : dmxPorts) {
+        port.setBreakTiming(breakTime, mabTime);
+    }
+    if (doc.containsKey("slots")) {
+        dmxUniverseSetActiveSlots(*target, doc["slots"]);
+    }
+    dmxNetworkSetUniverses(doc["artnetUniverse"] | dmxNetworkArtnetUniverse(),
+                           doc["sacnUniverse"] | dmxNetworkSacnUniverse());
+    // Frames per second, 0 = as fast as the longest universe can be sent
+    if (doc.containsKey("frameRate")) {
+        unsigned long rate = doc["frameRate"];
+        frameRateAuto = rate == 0;
+        if (!frameRateAuto) frameClockSetPeriod(1000000UL / rate);
+    }
+
+    char json[200];
+    snprintf(json, sizeof(json),
+             "{\"status\":\"ok\",\"breakTime\":%u,\"mabTime\":%u,\"slots\":%u,\"frameRate\":%u,"
+             "\"frameRateAuto\":%s,\"universes\":%u,\"artnetUniverse\":%u,\"sacnUniverse\":%u}",
+             dmxPorts[0].breakTime(), dmxPorts[0].mabTime(), dmxUniverseSlotCount(*target), frameClockRate(),
+             frameRateAuto ? "true" : "false", DMX_UNIVERSES, dmxNetworkArtnetUniverse(), dmxNetworkSacnUniverse());
+    sendJson(client, json);
+}
+
+void sendInputState(WiFiClient& client) {
+    uint16_t slots = 0;
+    dmxPorts[0].inputFrame(slots);
+    uint32_t a = inputConfig.udpAddress; // First octet in the low byte
+    char host[16] = "";
+    if (a != 0) snprintf(host, sizeof(host), "%u.%u.%u.%u", a & 0xFF, (a >> 8) & 0xFF, (a >> 16) & 0xFF, a >> 24);
+
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"enabled\":%s,\"active\":%s,\"signal\":%s,\"frames\":%lu,\"slots\":%u,\"mqtt\":%s,"
+             "\"udpHost\":\"%s\",\"udpPort\":%u,\"udpUniverse\":%u,\"interval\":%u,\"deltas\":%lu,\"full\":%lu}",
+             inputConfig.enabled ? "true" : "false", dmxPorts[0].isInput() ? "true" : "false",
+             dmxPorts[0].inputSignal() ? "true" : "false", dmxPorts[0].inputFrames(), slots,
+             inputConfig.mqtt ? "true" : "false", host, inputConfig.udpPort, inputConfig.udpUniverse,
+             inputConfig.interval, inputBridge.deltas, inputBridge.fulls);
+    sendJson(client, json);
+}
+
+void handleInputGet(WiFiClient& client, HttpRequest& request) {
+    sendInputState(client);
+}
+
+// {"enabled":true,"mqtt":true,"udpHost":"192.168.1.20","udpPort":6460,
+//  "udpUniverse":1,"interval":50}, every field optional; "udpHost":"" stops
+// the UDP side. The port switches over between two frames.
+void handleInputSet(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<256> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    DmxInputConfig config = inputConfig;
+    config.enabled = doc["enabled"] | (bool)config.enabled;
+    config.mqtt = doc["mqtt"] | (bool)config.mqtt;
+    config.udpPort = doc["udpPort"] | config.udpPort;
+    config.udpUniverse = doc["udpUniverse"] | config.udpUniverse;
+    config.interval = constrain(doc["interval"] | (int)config.interval, DMX_BRIDGE_MIN_INTERVAL, 10000);
+    if (doc.containsKey("udpHost")) {
+        const char* host = doc["udpHost"] | "";
+        IPAddress address;
+        if (host[0] != '\0' && !address.fromString(host)) {
+            sendStatus(client, 400);
+            return;
+        }
+        config.udpAddress = host[0] != '\0' ? (uint32_t)address : 0;
+    }
+    if (config.udpUniverse < 1) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    inputConfig = config;
+    dmxBridgeInit(inputBridge, inputConfig.interval);
+    saveInputConfig();
+    sendInputState(client);
+}
+
+void sendFailsafeState(WiFiClient& client) {
+    char json[256];
+    snprintf(json, sizeof(json),
+             "{\"policy\":\"%s\",\"preset\":%u,\"delay\":%lu,\"fade\":%lu,\"active\":%s,\"engaged\":%lu,"
+             "\"watchdogReset\":%s,\"resumed\":%s}",
+             dmxFailsafePolicyName(failsafe.policy), failsafe.preset, (unsigned long)failsafe.delay,
+             (unsigned long)failsafe.fadeMs, failsafe.active ? "true" : "false", failsafe.engaged,
+             watchdogReset ? "true" : "false", sceneResumed ? "true" : "false");
+    sendJson(client, json);
+}
+
+void handleFailsafeGet(WiFiClient& client, HttpRequest& request) {
+    sendFailsafeState(client);
+}
+
+// {"policy":"hold"|"scene"|"blackout","preset":2,"delay":5000,"fade":3000},
+// the fields left out keep their value. "scene" fades to the stored preset.
+void handleFailsafeSet(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<200> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    FailsafeConfig config = failsafeConfig;
+    if (doc.containsKey("policy")) config.policy = dmxFailsafePolicyFromName(doc["policy"]);
+    int preset = doc["preset"] | (int)config.preset;
+    config.delay = doc["delay"] | config.delay;
+    config.fadeMs = doc["fade"] | config.fadeMs;
+    if (preset < 0 || preset >= PRESET_SLOTS ||
+        (config.policy == FAILSAFE_SCENE && presetBank.presets[preset].count == 0)) {
+        sendStatus(client, 400);
+        return;
+    }
+    config.preset = preset;
+
+    failsafeConfig = config;
+    dmxFailsafeConfigure(failsafe, (DmxFailsafePolicy)config.policy, config.preset, config.delay, config.fadeMs);
+    saveFailsafeConfig();
+    sendFailsafeState(client);
+}
+
+// Merge settings of every source, per universe:
+// [[{"source":"manual","mode":"ltp","priority":100,"timeout":0,"live":true},...],...]
+void sendMergeState(WiFiClient& client) {
+    char json[480];
+    size_t n = snprintf(json, sizeof(json), "[");
+    for (uint8_t u = 0; u < DMX_UNIVERSES && n < sizeof(json); u++) {
+        const DmxMerge& merge = merges[u];
+        n += snprintf(json + n, sizeof(json) - n, "%s[", u ? "," : "");
+        for (uint8_t s = 0; s < mergeUserSources(merge) && n < sizeof(json); s++) {
+            const DmxMergeSource& source = merge.sources[s];
+            n += snprintf(json + n, sizeof(json) - n,
+                          "%s{\"source\":\"%s\",\"mode\":\"%s\",\"priority\":%u,\"timeout\":%lu,\"live\":%s}",
+                          s ? "," : "", mergeSourceNames[s], dmxMergeModeName(source.mode), source.priority,
+                          (unsigned long)source.timeout, source.live ? "true" : "false");
+        }
+        if (n < sizeof(json)) n += snprintf(json + n, sizeof(json) - n, "]");
+    }
+    if (n < sizeof(json)) snprintf(json + n, sizeof(json) - n, "]");
+    sendJson(client, json);
+}
+
+void handleMergeGet(WiFiClient& client, HttpRequest& request) {
+    sendMergeState(client);
+}
+
+// The fail-safe layer follows the highest priority, so it takes part in the
+// merge alongside that source rather than above or below everything
+void failsafePriority(DmxMerge& merge) {
+    uint8_t last = mergeUserSources(merge);
+    uint8_t priority = 0;
+    for (uint8_t s = 0; s < last; s++) {
+        if (merge.sources[s].priority > priority) priority = merge.sources[s].priority;
+    }
+    dmxMergeConfigure(merge, last, MERGE_LTP, priority, 1);
+}
+
+// {"universe":1,"source":"show","mode":"htp","priority":120,"timeout":0}; the
+// fields left out keep their value. Priorities are 0-200 like in E1.31.
+void handleMergeSet(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<200> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    int u = universeIndex(doc["universe"]);
+    const char* name = doc["source"] | "";
+    int s = 0;
+    while (u >= 0 && s < mergeUserSources(merges[u]) && strcmp(name, mergeSourceNames[s]) != 0) s++;
+    if (u < 0 || s >= mergeUserSources(merges[u])) {
+        sendStatus(client, 400);
+        return;
+    }
+    const DmxMergeSource& source = merges[u].sources[s];
+    int priority = doc["priority"] | (int)source.priority;
+    if (priority < 0 || priority > 200) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    DmxMergeMode mode = doc.containsKey("mode") ? dmxMergeModeFromName(doc["mode"]) : source.mode;
+    dmxMergeConfigure(merges[u], s, mode, priority, doc["timeout"] | source.timeout);
+    failsafePriority(merges[u]);
+    sendMergeState(client);
+}
+
+// Start one fade: {"channel":6,"value":255,"time":2000,"curve":"inout","fine":false},
+// or {"attribute":"head1.pan",...} with fine taken from the patch
+bool startFade(JsonObject fade) {
+    int channel = fade["channel"];
+    long value = fade["value"];
+    bool fine = fade["fine"] | false;
+    if (fade.containsKey("attribute")) {
+        PatchTarget target;
+        if (!dmxPatchResolve(patch, fade["attribute"].as<const char*>(), target) || target.universe != 0) return false;
+        channel = target.channel;
+        fine = target.fine;
+    }
+    if (value < 0 || value > (fine ? 65535 : 255)) return false;
+
+    return dmxFadeStart(fades, universe, channel, value, fade["time"] | 0UL,
+                        dmxFadeCurveFromName(fade["curve"].as<const char*>()), fine, frameClockMillis());
+}
+
+// {"head1.pan":32768,"head1.dimmer":255,...}; 16-bit attributes take 0-65535.
+// Everything is checked first and written as one commit per universe.
+void handleAttributes(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<1024> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    JsonObject values = doc.as<JsonObject>();
+    PatchTarget target;
+    for (JsonPair pair : values) {
+        long value = pair.value();
+        if (!dmxPatchResolve(patch, pair.key().c_str(), target) || value < 0 || value > (target.fine ? 65535 : 255)) {
+            sendStatus(client, 400);
+            return;
+        }
+    }
+
+    for (JsonPair pair : values) {
+        dmxPatchResolve(patch, pair.key().c_str(), target);
+        dmxPatchWrite(manualLayers[target.universe], target, pair.value().as<uint16_t>());
+    }
+    for (DmxUniverse& u : manualLayers) dmxUniverseCommit(u);
+    sendOk(client);
+}
+
+// GET /api/patch, same JSON as POST /api/patch takes:
+// {"types":[{"name":"head","footprint":11,"attributes":[{"name":"pan","offset":0,"fine":true,"home":128},...]}],
+//  "fixtures":[{"name":"head1","type":"head","universe":1,"address":1}]}
+void handlePatchGet(WiFiClient& client, HttpRequest& request) {
+    char* json = responseJson;
+    size_t n = 0;
+    n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "{\"types\":[");
+    for (uint8_t i = 0; i < patch.typeCount && n < RESPONSE_JSON_SIZE; i++) {
+        const FixtureType& type = patch.types[i];
+        n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s{\"name\":\"%s\",\"footprint\":%u,\"attributes\":[",
+                      i ? "," : "", type.name, type.footprint);
+        for (uint8_t j = 0; j < type.attributeCount && n < RESPONSE_JSON_SIZE; j++) {
+            const PatchAttribute& a = type.attributes[j];
+            n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s{\"name\":\"%s\",\"offset\":%u,\"fine\":%s,\"home\":%u}",
+                          j ? "," : "", a.name, a.offset, a.fine ? "true" : "false", a.home);
+        }
+        if (n < RESPONSE_JSON_SIZE) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "]}");
+    }
+    if (n < RESPONSE_JSON_SIZE) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "],\"fixtures\":[");
+    for (uint8_t i = 0; i < patch.fixtureCount && n < RESPONSE_JSON_SIZE; i++) {
+        const Fixture& fixture = patch.fixtures[i];
+        n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s{\"name\":\"%s\",\"type\":\"%s\",\"universe\":%u,\"address\":%u}",
+                      i ? "," : "", fixture.name, patch.types[fixture.type].name, fixture.universe + 1, fixture.address);
+    }
+    if (n < RESPONSE_JSON_SIZE) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "]}");
+
+    if (n >= RESPONSE_JSON_SIZE) {
+        sendStatus(client, 500);
+        return;
+    }
+    sendJson(client, json);
+}
+
+// Replace the whole patch and store it. Nothing is written to the universes.
+void handlePatchSet(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<3072> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    // Numbers are range checked before they narrow to the patch's fields
+    DmxPatch& parsed = patchScratch;
+    dmxPatchInit(parsed);
+    bool ok = true;
+    for (JsonObject type : doc["types"].as<JsonArray>()) {
+        long footprint = type["footprint"] | 0L;
+        int index = footprint >= 1 && footprint <= 255 ? dmxPatchAddType(parsed, type["name"], footprint) : -1;
+        ok = ok && index >= 0;
+        if (!ok) break;
+        for (JsonObject a : type["attributes"].as<JsonArray>()) {
+            long offset = a["offset"] | 0L;
+            long home = a["home"] | 0L;
+            ok = ok && offset >= 0 && offset <= PATCH_MAX_OFFSET && home >= 0 && home <= 65535 &&
+                 dmxPatchAddAttribute(parsed, index, a["name"], offset, a["fine"] | false, home);
+        }
+    }
+    for (JsonObject fixture : doc["fixtures"].as<JsonArray>()) {
+        int type = dmxPatchFindType(parsed, fixture["type"] | "");
+        long u = fixture["universe"] | 1L;
+        long address = fixture["address"] | 0L;
+        ok = ok && type >= 0 && u >= 1 && u <= DMX_UNIVERSES && address >= 1 && address <= DMX_CHANNELS &&
+             dmxPatchAddFixture(parsed, fixture["name"], type, u - 1, address);
+    }
+
+    if (!ok) {
+        sendStatus(client, 400);
+        return;
+    }
+    patch = parsed;
+    savePatch();
+    sendOk(client);
+}
+
+// GET /api/presets:
+// [{"id":0,"name":"red","universe":1,"channel":1,"values":[128,128,...]},...]
+void handlePresetsGet(WiFiClient& client, HttpRequest& request) {
+    char* json = responseJson;
+    size_t n = snprintf(json, RESPONSE_JSON_SIZE, "[");
+    bool first = true;
+    for (uint8_t id = 0; id < PRESET_SLOTS && n < RESPONSE_JSON_SIZE; id++) {
+        const DmxPreset& preset = presetBank.presets[id];
+        if (preset.count == 0) continue;
+        n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s{\"id\":%u,\"name\":\"%s\",\"universe\":%u,\"channel\":%u,\"values\":[",
+                      first ? "" : ",", id, preset.name, preset.universe + 1, preset.channel);
+        for (uint8_t i = 0; i < preset.count && n < RESPONSE_JSON_SIZE; i++) {
+            n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s%u", i ? "," : "", preset.values[i]);
+        }
+        if (n < RESPONSE_JSON_SIZE) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "]}");
+        first = false;
+    }
+    if (n < RESPONSE_JSON_SIZE) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "]");
+
+    if (n >= RESPONSE_JSON_SIZE) {
+        sendStatus(client, 500);
+        return;
+    }
+    sendJson(client, json);
+}
+
+// Slot from a request's "id", or the preset with that "name"; -1 if neither
+int presetIndex(JsonObject doc) {
+    if (doc.containsKey("id")) {
+        int id = doc["id"] | -1;
+        return id >= 0 && id < PRESET_SLOTS ? id : -1;
+    }
+    return dmxPresetFind(presetBank, doc["name"] | "");
+}
+
+// {"name":"red","universe":1,"channel":1,"values":[...]} stores the values,
+// {"name":"red","channel":1,"count":11} what is on the wire there now.
+// Goes to slot "id" if given, else replaces the preset of the same name or
+// takes a free slot. Answers {"status":"ok","id":n}.
+void handlePresetStore(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<512> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    const char* name = doc["name"] | "";
+    bool hasId = doc.containsKey("id");
+    int id = hasId ? presetIndex(doc.as<JsonObject>()) : dmxPresetFind(presetBank, name);
+    if (!hasId && id < 0) {
+        id = dmxPresetFree(presetBank);
+        if (id < 0) {
+            sendStatus(client, 507); // Bank full
+            return;
+        }
+    }
+
+    int u = universeIndex(doc["universe"]);
+    int channel = doc["channel"] | 1;
+    uint8_t values[PRESET_MAX_VALUES];
+    int count = 0;
+    JsonArray list = doc["values"];
+    if (list.isNull()) {
+        count = doc["count"] | 0;
+        for (int i = 0; u >= 0 && i < count && i < PRESET_MAX_VALUES; i++) {
+            values[i] = dmxUniverseGet(universes[u], channel + i);
+        }
+    } else {
+        for (JsonVariant value : list) {
+            int v = value | -1;
+            if (count >= PRESET_MAX_VALUES || v < 0 || v > 255) {
+                count = 0;
+                break;
             }
+            values[count++] = v;
         }
     }
-    client.stop();
+
+    if (id < 0 || u < 0 || channel < 1 || count < 1 || count > PRESET_MAX_VALUES ||
+        !dmxPresetStore(presetBank, id, name, u, channel, values, count)) {
+        sendStatus(client, 400);
+        return;
+    }
+    savePreset(id);
+
+    char json[32];
+    snprintf(json, sizeof(json), "{\"status\":\"ok\",\"id\":%d}", id);
+    sendJson(client, json);
 }
 
-void printBLEInfo() {
-    Serial.println("\n=== BLE Configuration ===");
-    Serial.print("Device MAC: ");
-    Serial.println(BLE.address());
-    Serial.println("Service UUID: 180F");
-    Serial.println("SSID Characteristic UUID: 2A19");
-    Serial.println("Password Characteristic UUID: 2A20");
-    Serial.println("=======================\n");
+// {"id":3} or {"name":"red"}, with "fade" in ms and "curve" to fade to it
+void handlePresetRecall(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<128> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    int id = presetIndex(doc.as<JsonObject>());
+    if (id < 0 || !dmxPresetRecall(presetBank, id, manualLayers, DMX_UNIVERSES, fades, universe, doc["fade"] | 0UL,
+                                   dmxFadeCurveFromName(doc["curve"].as<const char*>()), frameClockMillis())) {
+        sendStatus(client, 400);
+        return;
+    }
+    sendOk(client);
 }
 
-// BLE characteristic handlers (defined after all functions they use)
-void onSsidCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic) {
-    Serial.print("SSID Characteristic Written: ");
-    Serial.println(ssidCharacteristic.value());
-    ssidWritten = true;
-    
-    // If both have been written, save the config
-    if (ssidWritten && passwordWritten) {
-        Serial.println("Both credentials received, saving...");
-        saveWifiConfig(ssidCharacteristic.value(), passwordCharacteristic.value());
+// {"id":3} or {"name":"red"}
+void handlePresetDelete(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<128> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
     }
+
+    int id = presetIndex(doc.as<JsonObject>());
+    if (id < 0) {
+        sendStatus(client, 400);
+        return;
+    }
+    dmxPresetErase(presetBank, id);
+    savePreset(id);
+    sendOk(client);
 }
 
-void onPasswordCharacteristicWritten(BLEDevice central, BLECharacteristic characteristic) {
-    Serial.print("Password Characteristic Written: ");
-    Serial.println(passwordCharacteristic.value());
-    passwordWritten = true;
-    
-    // If both have been written, save the config
-    if (ssidWritten && passwordWritten) {
-        Serial.println("Both credentials received, saving...");
-        saveWifiConfig(ssidCharacteristic.value(), passwordCharacteristic.value());
+// A single fade object, or {"fades":[...]} to start several in the same frame
+void handleFade(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<1024> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
     }
+
+    bool ok = true;
+    JsonArray list = doc["fades"];
+    if (list.isNull()) {
+        ok = startFade(doc.as<JsonObject>());
+    } else {
+        for (JsonObject fade : list) {
+            ok = startFade(fade) && ok;
+        }
+    }
+
+    if (ok) sendOk(client);
+    else sendStatus(client, 400);
 }
 
-void setup() {
-    Serial.begin(115200);
-    while (!Serial) delay(10);
-    Serial.println("Arduino R4 DMX Web Controller");
+// {"type":"chase","channel":1,"count":8,"stride":1,"rate":2.5,"offset":0,
+//  "spread":32,"base":0,"amplitude":255,"duty":32}, rate in Hz. Chases
+// default to one lit element running along the range.
+int startEffect(JsonObject doc) {
+    DmxEffectParams params;
+    params.type = dmxEffectTypeFromName(doc["type"].as<const char*>());
+    params.channel = doc["channel"] | 0;
+    PatchTarget target;
+    if (doc.containsKey("attribute")) {
+        if (!dmxPatchResolve(patch, doc["attribute"].as<const char*>(), target) || target.universe != 0) return -1;
+        params.channel = target.channel;
+    }
+    params.count = doc["count"] | 1;
+    params.stride = doc["stride"] | 0;
+    params.rate = constrain((doc["rate"] | 1.0f) * 100.0f, 0.0f, 65535.0f);
+    params.offset = doc["offset"] | 0;
+
+    uint8_t step = params.count > 1 ? 256 / params.count : 255;
+    params.spread = doc["spread"] | (params.type == EFFECT_CHASE ? step : 0);
+    params.duty = doc["duty"] | (params.type == EFFECT_CHASE ? step : 128);
+    params.base = doc["base"] | 0;
+    params.amplitude = doc["amplitude"] | 255;
+    return dmxEffectStart(effects, params);
+}
 
-    loadWifiConfig();
+// {"id":n} stops one effect, anything else stops them all
+void stopEffects(JsonObject doc) {
+    if (doc.containsKey("id")) dmxEffectStop(effects, doc["id"]);
+    else dmxEffectStopAll(effects);
+}
+
+void handleEffectStart(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<400> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    int id = startEffect(doc.as<JsonObject>());
+    if (id < 0) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    char json[40];
+    snprintf(json, sizeof(json), "{\"status\":\"ok\",\"id\":%d}", id);
+    sendJson(client, json);
+}
+
+void handleEffectStop(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<64> doc;
+    deserializeJson(doc, request.body, request.bodyLength);
+    stopEffects(doc.as<JsonObject>());
+    sendOk(client);
+}
+
+// GET /api/stats, append ?reset to start a new measurement window
+void handleStats(WiFiClient& client, HttpRequest& request) {
+    char* json = responseJson;
+    const size_t size = RESPONSE_JSON_SIZE - 1; // Room for the closing brace
+    size_t n = snprintf(json, size,
+                        "{\"uptime\":%lu,\"frames\":%lu,\"slots\":%u,\"stackFree\":%u,\"scheduler\":", millis(),
+                        frameCount, dmxUniverseSlotCount(universe), (unsigned)statsStackFree());
+    if (n < size) n += schedJson(json + n, size - n);
+    if (n < size) n += snprintf(json + n, size - n, ",\"sections\":");
+    if (n < size) n += statsJson(json + n, size - n, true);
+
+    // The appends stop at size - 1, a full buffer means something was cut
+    if (n >= size - 1) {
+        sendStatus(client, 500);
+        return;
+    }
+    json[n++] = '}';
+    json[n] = '\0';
+    sendJson(client, json);
+
+    if (strcmp(request.query, "reset") == 0) statsReset();
+}
+
+// The sections don't fit one MQTT message, each goes to stats/<section>
+void publishStats(StatId id) {
+    char topic[24];
+    snprintf(topic, sizeof(topic), "stats/%s", statsName(id));
+    char json[STATS_SECTION_JSON_MAX + 1];
+    statsSectionJson(id, json, sizeof(json));
+    mqttPublish(topic, json);
+}
+
+void handleMqttConfig(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<400> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength) || !doc.containsKey("broker")) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    MqttConfig config = {};
+    strncpy(config.broker, doc["broker"] | "", sizeof(config.broker) - 1);
+    config.port = doc["port"] | MQTT_DEFAULT_PORT;
+    strncpy(config.username, doc["username"] | "", sizeof(config.username) - 1);
+    strncpy(config.password, doc["password"] | "", sizeof(config.password) - 1);
+    strncpy(config.baseTopic, doc["baseTopic"] | MQTT_DEFAULT_BASE_TOPIC, sizeof(config.baseTopic) - 1);
+
+    saveMqttConfig(config);
+    mqttConfigure(config);
+    sendOk(client);
+}
+
+void handleDemoStart(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<4096> doc;
+    DeserializationError error = deserializeJson(doc, request.body, request.bodyLength);
+    if (error) {
+        LOG_WARN("Demo: JSON parse error - %s", error.c_str());
+        sendStatus(client, 400);
+        return;
+    }
+
+    LOG_INFO("Starting demo mode...");
+
+    JsonArray presets = doc["presets"];
+    if (presets.isNull()) {
+        LOG_WARN("No presets array in request!");
+        sendStatus(client, 400);
+        return;
+    }
+
+    LOG_DEBUG("Number of presets: %u", (unsigned)presets.size());
 
-    if (!BLE.begin()) {
-        Serial.println("Starting BLE failed!");
-        while (1);
-    }
-
-    // Set a more visible device name
-    BLE.setDeviceName("DMX Config");
-    BLE.setLocalName("DMX Config");
-    
-    // Set up the BLE service
-    wifiConfigService.addCharacteristic(ssidCharacteristic);
-    wifiConfigService.addCharacteristic(passwordCharacteristic);
-    
-    // Set up write handlers
-    ssidCharacteristic.setEventHandler(BLEWritten, onSsidCharacteristicWritten);
-    passwordCharacteristic.setEventHandler(BLEWritten, onPasswordCharacteristicWritten);
-    
-    BLE.addService(wifiConfigService);
-
-    // Set initial values
-    ssidCharacteristic.writeValue("Enter SSID");
-    passwordCharacteristic.writeValue("Enter Password");
-
-    // Reset written flags
-    ssidWritten = false;
-    passwordWritten = false;
-
-    // Set up advertising data
-    BLE.setAdvertisedService(wifiConfigService);
-    
-    // Start advertising with higher power for better range
-    BLE.setConnectable(true);
-    BLE.setAdvertisingInterval(100);
-    BLE.advertise();
-    
-    // Print all BLE information
-    printBLEInfo();
-    Serial.println("BLE advertising started. Look for 'DMX Config' device.");
-
-    if (bleConfigMode) {
-        // Stay in config mode until credentials are provided
-        while (bleConfigMode) {
-            BLE.poll();
+    if (presets.size() < 2 || presets.size() > DEMO_MAX_PRESETS) {
+        LOG_WARN("Invalid number of presets!");
+        sendStatus(client, 400);
+        return;
+    }
+
+    // Each entry is {"preset":id} from the bank, or {"values":[...]}
+    DemoPreset values[DEMO_MAX_PRESETS];
+    uint8_t count = 0;
+    for (JsonObject preset : presets) {
+        if (preset.containsKey("preset")) {
+            int id = preset["preset"] | -1;
+            const DmxPreset* stored = id >= 0 && id < PRESET_SLOTS ? &presetBank.presets[id] : nullptr;
+            // The demo values are the web UI's channels 1-11 on universe 1
+            if (stored == nullptr || stored->count < DEMO_PRESET_VALUES || stored->universe != 0 ||
+                stored->channel != 1) {
+                LOG_WARN("Preset %d missing or not channels 1-%d on universe 1!", id, DEMO_PRESET_VALUES);
+                continue;
+            }
+            memcpy(values[count].values, stored->values, DEMO_PRESET_VALUES);
+            count++;
+            continue;
+        }
+        JsonArray presetValues = preset["values"];
+        if (presetValues.size() < DEMO_PRESET_VALUES) {
+            LOG_WARN("Preset values array too small!");
+            continue;
+        }
+        for (int i = 0; i < DEMO_PRESET_VALUES; i++) values[count].values[i] = presetValues[i];
+        count++;
+    }
+
+    // Check first, a rejected demo leaves the running show alone
+    int checked = count < 2 ? 0 : dmxDemoCheck(patch, count);
+    if (checked < 2) {
+        if (checked == DEMO_NOT_PATCHED) {
+            LOG_WARN("Demo needs a moving head as the first fixture on universe 1!");
+        } else if (checked == DEMO_TOO_LONG) {
+            LOG_WARN("Demo does not fit the cue list!");
+        } else {
+            LOG_WARN("Not enough valid presets!");
         }
+        sendStatus(client, 400);
+        return;
+    }
+
+    // The player reads the list in place, stop it before rebuilding
+    dmxCueStop(showPlayer);
+    int stored = dmxDemoBuild(show, patch, values, count, doc["moveDelay"] | 1000UL, doc["holdTime"] | 5000UL);
+    if (stored < 2) {
+        LOG_ERROR("Demo build failed after its check (%d)!", stored);
+        dmxCueLoad(show, nullptr, 0);
+        sendStatus(client, 500);
+        return;
+    }
+    LOG_INFO("Demo compiled from %d presets into %u bytes of cues", stored, show.length);
+
+    dmxCuePlay(showPlayer, 0, frameClockMillis());
+    saveShow(); // Save the new demo
+    sendOk(client);
+}
+
+void handleDemoStop(WiFiClient& client, HttpRequest& request) {
+    dmxCueStop(showPlayer);
+    dmxFadeStopAll(fades);
+    clearShow(); // Clear auto-start
+    sendOk(client);
+}
+
+// Upload a binary cue list (see dmx_cues.h), store it and start playing
+void handleCueUpload(WiFiClient& client, HttpRequest& request) {
+    dmxCueStop(showPlayer);
+    if (!dmxCueLoad(show, (const uint8_t*)request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    dmxCuePlay(showPlayer, 0, frameClockMillis());
+    saveShow();
+    sendOk(client);
+}
+
+// Binary universe write: POST /api/universe?offset=N[&universe=U] with the
+// raw slot values from slot offset N (0-based) as the body, or
+// /api/universe/rle with the run-length/delta encoding of dmxUniverseWriteRle()
+DmxUniverse* universeFromQuery(HttpRequest& request, uint16_t& startChannel) {
+    unsigned long offset = 0;
+    unsigned long index = 1;
+    httpQueryNumber(request, "offset", offset);
+    httpQueryNumber(request, "universe", index);
+    if (offset >= DMX_CHANNELS || index < 1 || index > DMX_UNIVERSES) return nullptr;
+
+    startChannel = offset + 1;
+    return &manualLayers[index - 1];
+}
+
+void handleUniverseWrite(WiFiClient& client, HttpRequest& request) {
+    uint16_t startChannel;
+    DmxUniverse* target = universeFromQuery(request, startChannel);
+    if (target == nullptr || request.bodyLength == 0 ||
+        request.bodyLength > DMX_CHANNELS - startChannel + 1) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    dmxUniverseWrite(*target, startChannel, (const uint8_t*)request.body, request.bodyLength);
+    dmxUniverseCommit(*target);
+    sendOk(client);
+}
+
+void handleUniverseWriteRle(WiFiClient& client, HttpRequest& request) {
+    uint16_t startChannel;
+    DmxUniverse* target = universeFromQuery(request, startChannel);
+    if (target == nullptr ||
+        !dmxUniverseWriteRle(*target, startChannel, (const uint8_t*)request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    dmxUniverseCommit(*target);
+    sendOk(client);
+}
+
+// Trigger: {"cue":n} jumps to cue n, an empty body goes to the next cue
+void handleCueGo(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<64> doc;
+    if (request.bodyLength > 0 && !deserializeJson(doc, request.body, request.bodyLength) &&
+        doc.containsKey("cue")) {
+        dmxCuePlay(showPlayer, doc["cue"], frameClockMillis());
+    } else if (showPlayer.running) {
+        dmxCueGo(showPlayer, frameClockMillis());
     } else {
-        bleConfigStartTime = millis();
-        // Initialize WiFi
-        WiFi.begin(ssid, password);
-        Serial.print("Connecting to WiFi");
-        while (WiFi.status() != WL_CONNECTED) {
-            delay(500);
-            Serial.print(".");
+        dmxCuePlay(showPlayer, 0, frameClockMillis());
+    }
+    sendOk(client);
+}
+
+void handleCueStop(WiFiClient& client, HttpRequest& request) {
+    dmxCueStop(showPlayer);
+    sendOk(client);
+}
+
+// GET /api/rdm: {"uid":"7ff0:1234abcd","discovering":false,"overflow":false,"busy":false,
+//  "devices":[{"uid":"4c55:00000001","model":1,"footprint":11,"address":1},...],
+//  "last":{"uid":"...","command":"get","pid":130,"status":"ack","data":[...]}}
+// address is null for devices without a footprint or not read yet
+void handleRdmGet(WiFiClient& client, HttpRequest& request) {
+    static const char* const statusNames[] = { "none", "ack", "ackTimer", "nack", "timeout", "invalid" };
+    char* json = responseJson;
+    char uid[RDM_UID_TEXT];
+    const RdmDiscovery& discovery = rdmDiscovery();
+    rdmUidFormat(rdmUid(), uid);
+    size_t n = snprintf(json, RESPONSE_JSON_SIZE, "{\"uid\":\"%s\",\"discovering\":%s,\"overflow\":%s,\"busy\":%s,\"devices\":[",
+                        uid, rdmDiscoveryRunning(discovery) ? "true" : "false", discovery.overflow ? "true" : "false",
+                        rdmBusy() ? "true" : "false");
+    for (uint8_t i = 0; i < rdmDeviceCount() && n < RESPONSE_JSON_SIZE; i++) {
+        const RdmDevice& device = rdmDevice(i);
+        rdmUidFormat(device.uid, uid);
+        n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s{\"uid\":\"%s\"", i ? "," : "", uid);
+        if (device.info && n < RESPONSE_JSON_SIZE) {
+            n += snprintf(json + n, RESPONSE_JSON_SIZE - n, ",\"model\":%u,\"footprint\":%u", device.model, device.footprint);
+        }
+        if (n < RESPONSE_JSON_SIZE) {
+            if (device.address == 0xFFFF) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, ",\"address\":null}");
+            else n += snprintf(json + n, RESPONSE_JSON_SIZE - n, ",\"address\":%u}", device.address);
         }
-        Serial.println();
-        Serial.print("IP address: ");
-        Serial.println(WiFi.localIP());
-        
-        // Start web server
-        server.begin();
-    }
-    
-    // Initialize DMX
-    pinMode(DMX_DE_PIN, OUTPUT);
-    digitalWrite(DMX_DE_PIN, LOW);
-    Serial1.begin(250000, SERIAL_8N2);
-    
-    // Set initial DMX values
-    setDMXChannel(2, 128);  // Pan Fine = 128
-    setDMXChannel(4, 128);  // Tilt Fine = 128
-    
-    Serial.println("System ready!");
-
-    loadDemoFromEEPROM(); // Load and auto-start if present
+    }
+
+    const RdmResult& last = rdmLastResult();
+    rdmUidFormat(last.uid, uid);
+    if (n < RESPONSE_JSON_SIZE) {
+        n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "],\"last\":{\"uid\":\"%s\",\"command\":\"%s\",\"pid\":%u,\"status\":\"%s\",\"data\":[",
+                      uid, last.commandClass == RDM_SET_COMMAND ? "set" : "get", last.pid, statusNames[last.status]);
+    }
+    for (uint8_t i = 0; i < last.pdl && n < RESPONSE_JSON_SIZE; i++) {
+        n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "%s%u", i ? "," : "", last.data[i]);
+    }
+    if (n < RESPONSE_JSON_SIZE) n += snprintf(json + n, RESPONSE_JSON_SIZE - n, "]}}");
+
+    if (n >= RESPONSE_JSON_SIZE) {
+        sendStatus(client, 500);
+        return;
+    }
+    sendJson(client, json);
 }
 
-void loop() {
-    // Always poll BLE in the first 60 seconds
-    if (!bleConfigMode && millis() - bleConfigStartTime < 60000) {
-        BLE.poll();
+void handleRdmDiscover(WiFiClient& client, HttpRequest& request) {
+    rdmDiscover();
+    sendOk(client);
+}
+
+// Queue a request to the "uid" in the body
+bool queueRdm(JsonObject doc, uint8_t commandClass, uint16_t pid, const uint8_t* data, uint8_t pdl) {
+    RdmRequest rdm = {};
+    if (!rdmUidParse(doc["uid"].as<const char*>(), rdm.destination) || pdl > sizeof(rdm.data)) return false;
+    rdm.commandClass = commandClass;
+    rdm.pid = pid;
+    rdm.subDevice = doc["subDevice"] | 0;
+    rdm.pdl = pdl;
+    memcpy(rdm.data, data, pdl);
+    return rdmQueue(rdm);
+}
+
+// Generic request: {"uid":"4c55:00000001","command":"get"|"set","pid":130,"data":[...]};
+// the result shows up under "last" in GET /api/rdm
+void handleRdmRequest(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<512> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    uint8_t data[sizeof(RdmRequest::data)];
+    uint8_t pdl = 0;
+    for (JsonVariant value : doc["data"].as<JsonArray>()) {
+        if (pdl >= sizeof(data)) {
+            sendStatus(client, 400);
+            return;
+        }
+        data[pdl++] = value.as<uint8_t>();
+    }
+    const char* command = doc["command"] | "get";
+    uint8_t commandClass = strcmp(command, "set") == 0 ? RDM_SET_COMMAND : RDM_GET_COMMAND;
+    int pid = doc["pid"] | 0;
+    if (pid <= 0 || pid > 0xFFFF || !queueRdm(doc.as<JsonObject>(), commandClass, pid, data, pdl)) {
+        sendStatus(client, 400);
+        return;
+    }
+    sendOk(client);
+}
+
+// {"uid":"4c55:00000001","address":17}
+void handleRdmAddress(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<128> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    int address = doc["address"] | 0;
+    uint8_t data[2] = { (uint8_t)(address >> 8), (uint8_t)address };
+    if (address < 1 || address > DMX_CHANNELS ||
+        !queueRdm(doc.as<JsonObject>(), RDM_SET_COMMAND, RDM_PID_DMX_START_ADDRESS, data, sizeof(data))) {
+        sendStatus(client, 400);
+        return;
+    }
+    sendOk(client);
+}
+
+// {"uid":"4c55:00000001","on":true}
+void handleRdmIdentify(WiFiClient& client, HttpRequest& request) {
+    StaticJsonDocument<128> doc;
+    if (deserializeJson(doc, request.body, request.bodyLength)) {
+        sendStatus(client, 400);
+        return;
+    }
+
+    uint8_t on = doc["on"] | true;
+    if (!queueRdm(doc.as<JsonObject>(), RDM_SET_COMMAND, RDM_PID_IDENTIFY_DEVICE, &on, 1)) {
+        sendStatus(client, 400);
+        return;
+    }
+    sendOk(client);
+}
+
+struct HttpRoute {
+    HttpMethod method;
+    const char* path;
+    void (*handler)(WiFiClient& client, HttpRequest& request);
+};
+
+const HttpRoute httpRoutes[] = {
+    { HTTP_GET,  "/",                   handleRoot },
+    { HTTP_GET,  "/api/stats",          handleStats },
+    { HTTP_POST, "/api/channels",       handleSetChannel },
+    { HTTP_POST, "/api/channels/batch", handleSetChannelsBatch },
+    { HTTP_POST, "/api/universe",       handleUniverseWrite },
+    { HTTP_POST, "/api/universe/rle",   handleUniverseWriteRle },
+    { HTTP_POST, "/api/fade",           handleFade },
+    { HTTP_POST, "/api/attributes",     handleAttributes },
+    { HTTP_GET,  "/api/patch",          handlePatchGet },
+    { HTTP_POST, "/api/patch",          handlePatchSet },
+    { HTTP_GET,  "/api/presets",        handlePresetsGet },
+    { HTTP_POST, "/api/presets",        handlePresetStore },
+    { HTTP_POST, "/api/presets/recall", handlePresetRecall },
+    { HTTP_POST, "/api/presets/delete", handlePresetDelete },
+    { HTTP_POST, "/api/effects",        handleEffectStart },
+    { HTTP_POST, "/api/effects/stop",   handleEffectStop },
+    { HTTP_POST, "/api/dmx/config",     handleDmxConfig },
+    { HTTP_GET,  "/api/dmx/input",      handleInputGet },
+    { HTTP_POST, "/api/dmx/input",      handleInputSet },
+    { HTTP_GET,  "/api/failsafe",       handleFailsafeGet },
+    { HTTP_POST, "/api/failsafe",       handleFailsafeSet },
+    { HTTP_GET,  "/api/merge",          handleMergeGet },
+    { HTTP_POST, "/api/merge",          handleMergeSet },
+    { HTTP_POST, "/api/mqtt/config",    handleMqttConfig },
+    { HTTP_GET,  "/api/rdm",            handleRdmGet },
+    { HTTP_POST, "/api/rdm/discover",   handleRdmDiscover },
+    { HTTP_POST, "/api/rdm/request",    handleRdmRequest },
+    { HTTP_POST, "/api/rdm/address",    handleRdmAddress },
+    { HTTP_POST, "/api/rdm/identify",   handleRdmIdentify },
+    { HTTP_POST, "/api/demo/start",     handleDemoStart },
+    { HTTP_POST, "/api/demo/stop",      handleDemoStop },
+    { HTTP_POST, "/api/cues",           handleCueUpload },
+    { HTTP_POST, "/api/cues/go",        handleCueGo },
+    { HTTP_POST, "/api/cues/stop",      handleCueStop },
+};
+
+void dispatchRequest(WiFiClient& client, HttpRequest& request) {
+    bool pathFound = false;
+    for (const HttpRoute& route : httpRoutes) {
+        if (strcmp(route.path, request.path) != 0) continue;
+        pathFound = true;
+        if (route.method == request.method) {
+            route.handler(client, request);
+            return;
+        }
+    }
+    sendStatus(client, pathFound ? 405 : 404);
+}
+
+// Handle a complete request from the connection pool
+bool handleHttpRequest(WiFiClient& client, HttpRequest& request) {
+    if (strcmp(request.path, "/ws") == 0 && request.wsKey[0] != '\0') {
+        // The socket now belongs to the WebSocket session
+        if (wsAccept(client, request.wsKey)) return true;
+        sendStatus(client, 503);
+        return false;
+    }
+
+    dispatchRequest(client, request);
+    return false;
+}
+
+// <base>/cmd/<command> messages, same JSON as the HTTP API
+void onMqttCommand(const char* command, const uint8_t* payload, unsigned int length) {
+    StaticJsonDocument<400> doc;
+    if (length > 0 && deserializeJson(doc, payload, length)) return;
+
+    if (strcmp(command, "effect") == 0) {
+        startEffect(doc.as<JsonObject>());
+    } else if (strcmp(command, "effect/stop") == 0) {
+        stopEffects(doc.as<JsonObject>());
+    }
+}
+
+void wifiJoin() {
+    LOG_INFO("Connecting to WiFi %s", ssid);
+    WiFi.setTimeout(0); // Return right away, the join is watched from wifiLoop()
+    WiFi.begin(ssid, password);
+    wifiState = WIFI_JOINING;
+    wifiStateTime = millis();
+}
+
+// Start the listeners the first time the link comes up, they survive drops
+void startNetwork() {
+    LOG_INFO("IP address: %s", WiFi.localIP().toString().c_str());
+    if (networkStarted) return;
+
+    server.begin();
+    httpServerBegin(handleHttpRequest);
+    wsBegin(universe, manualLayers[0], showPlayer);
+    dmxNetworkBegin(networkLayers, DMX_UNIVERSES);
+    udpControlBegin(manualLayers, DMX_UNIVERSES, universe, fades, showPlayer, presetBank);
+    networkStarted = true;
+}
+
+void wifiLoop() {
+    if (wifiState == WIFI_OFF) return;
+
+    unsigned long now = millis();
+    if (wifiState == WIFI_DOWN) {
+        if (now - wifiStateTime >= WIFI_RETRY_INTERVAL) wifiJoin();
+        return;
+    }
+
+    if (now - lastWifiStatus < WIFI_STATUS_INTERVAL) return;
+    lastWifiStatus = now;
+
+    bool connected = WiFi.status() == WL_CONNECTED;
+    if (wifiState == WIFI_JOINING) {
+        if (connected) {
+            wifiState = WIFI_UP;
+            startNetwork();
+        } else if (now - wifiStateTime >= WIFI_JOIN_TIMEOUT) {
+            LOG_WARN("WiFi join timed out, retrying in %u s", WIFI_RETRY_INTERVAL / 1000);
+            WiFi.disconnect();
+            wifiState = WIFI_DOWN;
+            wifiStateTime = now;
+        }
+    } else if (!connected) {
+        LOG_WARN("WiFi connection lost, rejoining");
+        wifiJoin();
     }
+}
+
+// Without stored credentials there is no network to lose
+bool networkOk() {
+    return bleConfigMode || wifiState == WIFI_UP;
+}
+
+// Frame tick: the show advances on the frame clock, then every universe is
+// merged and goes out. A port still sending the previous frame skips the
+// tick. With an automatic frame rate the clock follows the longest frame.
+// Whatever changed is copied to retained RAM for the next boot.
+void frameTick() {
+    uint32_t now = frameClockMillis();
+    uint32_t t = statsStart();
+    dmxCueTick(showPlayer, now);
+    dmxFadeTick(fades, showLayer, now);
+    dmxEffectsTick(effects, showLayer, now);
+    dmxFailsafeTick(failsafe, networkOk(), failsafeLayers, networkLayers, universes, DMX_UNIVERSES, presetBank, now);
+    statsEnd(STAT_SHOW, t);
+
+    // Switch port 1 between output and input while it is idle
+    bool input = inputConfig.enabled != 0;
+    if (dmxPorts[0].isInput() != input && dmxPorts[0].frameDone()) dmxPorts[0].setInput(input, inputStorage);
 
-    // Continue sending DMX frames at 40Hz
     unsigned long currentTime = micros();
-    if (currentTime - lastFrameTime >= DMX_FRAME_TIME) {
-        sendDMXFrame();
-        lastFrameTime = currentTime;
+    uint32_t longestFrame = 0;
+    bool changed = false;
+    for (uint8_t i = 0; i < DMX_UNIVERSES; i++) {
+        DmxPort& port = dmxPorts[i];
+        t = statsStart();
+        if (dmxMergeTick(merges[i], port.universe(), millis())) changed = true;
+        statsEnd(STAT_MERGE, t);
+
+        // An input port still sets the pace, as if it were sending
+        if (port.frameTime() > longestFrame) longestFrame = port.frameTime();
+        if (port.isInput()) continue;
+        if (!port.sendFrame()) continue;
+        frameCount++;
+    }
+
+    if (changed) dmxRetainedStore(retainedScene, universes, DMX_UNIVERSES, dmxPorts[0].isInput() ? 1 : 0);
+
+    if (dmxPorts[0].frames() > 1) statsRecordUs(STAT_FRAME_INTERVAL, currentTime - lastFrameTime);
+    lastFrameTime = currentTime;
+    // RDM needs a gap between frames while it has work, which slows the rate
+    if (frameRateAuto) frameClockSetPeriod(longestFrame + FRAME_AUTO_MARGIN + rdmWindowUs());
+}
+
+// The frame goes out by interrupt, so with their budgets the (blocking)
+// data flash writes and BLE time slices land in the gap right after it
+void bleTask() {
+    bleLoop(bleConfigMode || wifiState != WIFI_UP);
+}
+
+void mqttTask() {
+    mqttLoop();
+    if (millis() - lastStatsPublish >= STATS_PUBLISH_INTERVAL) {
+        lastStatsPublish = millis();
+        statsPublishNext = 0;
     }
-    
-    if (demoMode) {
-        processDemo();
+    // One section per pass, so publishing doesn't hold up the loop
+    if (statsPublishNext < STAT_COUNT) publishStats((StatId)statsPublishNext++);
+}
+
+// Publish what the console sends: changes at most every interval, now and
+// then the full universe. Full updates go out from the bridge's copy, the
+// receive buffer may flip while they are being written.
+void inputTask() {
+    uint16_t slots = 0;
+    const uint8_t* values = dmxPorts[0].inputFrame(slots);
+    if (values == nullptr || !dmxPorts[0].inputSignal()) return;
+    bool toMqtt = inputConfig.mqtt && mqttConnected();
+    bool toUdp = networkStarted && inputConfig.udpAddress != 0 && inputConfig.udpPort != 0;
+    if (!toMqtt && !toUdp) return;
+
+    uint16_t length = 0;
+    DmxBridgeUpdate update = dmxBridgeUpdate(inputBridge, values, slots, millis(), inputDelta, sizeof(inputDelta),
+                                             length);
+    uint8_t params[3] = { inputConfig.udpUniverse, 0, 1 }; // Universe, then channel 1 for UDP_OP_SET
+    if (update == BRIDGE_DELTA) {
+        if (toMqtt) mqttPublish("input/delta", inputDelta, length);
+        if (toUdp) udpControlSend(inputConfig.udpAddress, inputConfig.udpPort, UDP_OP_DELTA, params, 1, inputDelta,
+                                  length);
+    } else if (update == BRIDGE_FULL) {
+        if (toMqtt) mqttPublish("input/slots", inputBridge.sent, length, true);
+        if (toUdp) udpControlSend(inputConfig.udpAddress, inputConfig.udpPort, UDP_OP_SET, params, sizeof(params),
+                                  inputBridge.sent, length);
     }
-    
-    // Handle web clients
+}
+
+// Handle web clients, each pass only advances every connection a little
+void httpTask() {
+    if (!networkStarted) return;
     WiFiClient client = server.available();
-    if (client) {
-        handleWebRequest(client);
+    if (client && !wsOwnsClient(client)) {
+        httpServerAccept(client);
+    }
+    httpServerLoop();
+}
+
+// After a reset the output from before goes straight back out, ahead of the
+// frame clock (the one place a universe is written directly). The fail-safe
+// layers hold it until the network is back; the show and BLE take over any
+// slot they change.
+void resumeScene() {
+    for (uint8_t u = 0; u < DMX_UNIVERSES; u++) {
+        uint16_t slots = retainedScene.slots[u];
+        if (slots == 0) continue;
+        memcpy(dmxUniverseReserve(failsafeLayers[u], 1, slots), retainedScene.values[u], slots);
+        dmxUniverseCommit(failsafeLayers[u]);
+        dmxUniverseWrite(universes[u], 1, retainedScene.values[u], slots);
+        dmxUniverseCommit(universes[u]);
+        dmxPorts[u].sendFrame();
+    }
+    dmxFailsafeResume(failsafe, retainedScene.slots, DMX_UNIVERSES, frameClockMillis());
+    sceneResumed = true;
+    LOG_INFO("Resumed the output from before the reset");
+}
+
+void setup() {
+    statsBegin();
+
+    // Lights first: the stored show is running before anything else starts.
+    // Nothing here waits for USB serial or the network.
+    Serial.begin(115200);
+    LOG_INFO("Arduino R4 DMX Web Controller");
+
+    // Armed before anything that could hang; loop() keeps it fed
+    watchdogReset = R_SYSTEM->RSTSR1 & R_SYSTEM_RSTSR1_WDTRF_Msk;
+    R_SYSTEM->RSTSR1 &= (uint8_t)~R_SYSTEM_RSTSR1_WDTRF_Msk;
+    if (watchdogReset) LOG_WARN("Reset by the watchdog");
+    if (!WDT.begin(WATCHDOG_TIMEOUT)) LOG_WARN("Watchdog unavailable");
+
+    for (uint8_t u = 0; u < DMX_UNIVERSES; u++) {
+        dmxUniverseInit(universes[u], universeStorage[u]);
+        dmxUniverseInit(manualLayers[u], layerStorage[2 * u], true);
+        dmxUniverseInit(networkLayers[u], layerStorage[2 * u + 1], true);
+        dmxMergeInit(merges[u]);
+        dmxMergeAddSource(merges[u], manualLayers[u], MERGE_LTP, MERGE_DEFAULT_PRIORITY, 0);
+        dmxMergeAddSource(merges[u], networkLayers[u], MERGE_LTP, MERGE_DEFAULT_PRIORITY, NET_SOURCE_TIMEOUT);
+        dmxPorts[u].begin();
+    }
+    dmxUniverseInit(showLayer, layerStorage[2 * DMX_UNIVERSES], true);
+    dmxMergeAddSource(merges[0], showLayer, MERGE_LTP, MERGE_DEFAULT_PRIORITY, 0);
+    // Only live while the fail-safe commits it, every frame
+    dmxFailsafeInit(failsafe);
+    for (uint8_t u = 0; u < DMX_UNIVERSES; u++) {
+        dmxUniverseInit(failsafeLayers[u], layerStorage[2 * DMX_UNIVERSES + 1 + u], true);
+        dmxMergeAddSource(merges[u], failsafeLayers[u], MERGE_LTP, MERGE_DEFAULT_PRIORITY, 1);
+    }
+    if (dmxRetainedValid(retainedScene)) resumeScene();
+    rdmBegin(dmxPorts[0]);
+    dmxFadeInit(fades);
+    dmxEffectsInit(effects);
+    dmxCueBegin(showPlayer, show, fades, universe);
+
+    // Every patched attribute starts at its home value, unless the output
+    // from before a reset is back
+    journalBegin();
+    loadPatch();
+    loadPresets();
+    loadInputConfig();
+    loadFailsafeConfig();
+    if (!sceneResumed) {
+        dmxPatchHome(patch, manualLayers, DMX_UNIVERSES);
+        for (DmxUniverse& u : manualLayers) dmxUniverseCommit(u);
     }
+
+    loadShow(); // Load and auto-start if present
+    WDT.refresh();
+
+    // MQTT connects from loop() once WiFi is up
+    mqttBegin(manualLayers, DMX_UNIVERSES, universe, fades, patch, presetBank);
+    mqttOnCommand(onMqttCommand);
+    loadMqttConfig();
+
+    // BLE advertises for the first minute, and for as long as there are no
+    // credentials or WiFi is down
+    loadWifiConfig();
+    bleBegin(manualLayers[0], saveWifiConfig);
+    WDT.refresh();
+    if (!bleConfigMode) wifiJoin();
+
+    // Frames on the clock tick; the rest by priority in the time between
+    // them. Budgets are roughly the worst cases seen in /api/stats.
+    schedSetFrameTask(frameTick, STAT_FRAME);
+    schedAdd("udp", udpControlLoop, STAT_UDP, 70, 1000);
+    schedAdd("rdm", rdmLoop, STAT_RDM, 65, 300);
+    schedAdd("network", dmxNetworkLoop, STAT_NETWORK, 60, 3000);
+    schedAdd("input", inputTask, STAT_INPUT, 55, 2000);
+    schedAdd("websocket", wsLoop, STAT_WEBSOCKET, 50, 2000);
+    schedAdd("mqtt", mqttTask, STAT_MQTT, 40, 3000);
+    schedAdd("http", httpTask, STAT_HTTP, 30, 3000);
+    schedAdd("journal", journalLoop, STAT_JOURNAL, 20, 5000);
+    schedAdd("wifi", wifiLoop, STAT_WIFI, 20, 2000);
+    schedAdd("ble", bleTask, STAT_BLE, 10, 4000);
+    schedAdd("log", logLoop, STAT_LOG, 0, 300);
+    frameClockBegin(1000000UL / FRAME_RATE_DEFAULT);
+
+    LOG_INFO("System ready!");
+}
+
+void loop() {
+    uint32_t loopStart = statsStart();
+    schedLoop();
+    WDT.refresh();
+    statsEnd(STAT_LOOP, loopStart);
 }
@@ -0,0 +1,293 @@
+#include "mqtt_control.h"
+#include <WiFiS3.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+#include "log.h"
+#include "frame_clock.h"
+#include "dmx_bridge.h"
+
+static WiFiClient mqttNet;
+static PubSubClient mqtt(mqttNet);
+
+static DmxUniverse* mqttUniverses = nullptr;
+static uint8_t mqttUniverseCount = 0;
+static const DmxUniverse* mqttFadeStart = nullptr;
+static DmxFadeEngine* mqttFades = nullptr;
+static const DmxPatch* mqttPatch = nullptr;
+static const DmxPresetBank* mqttPresets = nullptr;
+static MqttCommandHandler commandHandler = nullptr;
+static MqttConfig mqttConfig;
+static bool mqttEnabled = false;
+static char statusTopic[48];
+static size_t baseTopicLength = 0;
+
+static unsigned long lastConnectAttempt = 0;
+static unsigned long retryInterval = MQTT_RETRY_MIN;
+static bool socketOpen = false;  // TCP is up, the handshake is next
+static bool session = false;     // Connected; saves asking the modem every pass
+
+// Parse a decimal number at *p and advance past it; false if there is none
+static bool parseNumber(const char*& p, unsigned long& value) {
+    char* end;
+    value = strtoul(p, &end, 10);
+    if (end == p) return false;
+    p = end;
+    return true;
+}
+
+static uint8_t parseValue(const byte* payload, unsigned int length) {
+    unsigned int value = 0;
+    for (unsigned int i = 0; i < length && i < 3; i++) {
+        if (payload[i] < '0' || payload[i] > '9') break;
+        value = value * 10 + (payload[i] - '0');
+    }
+    return value > 255 ? 255 : value;
+}
+
+static void applyBatch(DmxUniverse& universe, const byte* payload, unsigned int length) {
+    StaticJsonDocument<1024> doc;
+    if (deserializeJson(doc, payload, length)) return;
+
+    for (JsonObject update : doc["updates"].as<JsonArray>()) {
+        int channel = update["channel"];
+        int value = update["value"];
+        if (value >= 0 && value <= 255) {
+            dmxUniverseSet(universe, channel, value);
+        }
+    }
+}
+
+struct FadeCommand {
+    unsigned long value;
+    unsigned long duration;
+    const char* curve;
+};
+
+// "<value> [ms] [curve]", text must hold at least 32 bytes
+static bool parseFade(const byte* payload, unsigned int length, char* text, FadeCommand& command) {
+    if (length >= 32) return false;
+    memcpy(text, payload, length);
+    text[length] = '\0';
+
+    char* p = text;
+    command.value = strtoul(p, &p, 10);
+    command.duration = strtoul(p, &p, 10);
+    while (*p == ' ') p++;
+    command.curve = p;
+    return true;
+}
+
+static void applyFade(unsigned long channel, bool fine, const byte* payload, unsigned int length) {
+    char text[32];
+    FadeCommand command;
+    if (!parseFade(payload, length, text, command)) return;
+    dmxFadeStart(*mqttFades, *mqttFadeStart, channel, min(command.value, fine ? 65535UL : 255UL),
+                 command.duration, dmxFadeCurveFromName(command.curve), fine, frameClockMillis());
+}
+
+// Attributes on the first universe can fade, the others are set right away
+static void applyAttribute(const char* path, const byte* payload, unsigned int length) {
+    PatchTarget target;
+    char text[32];
+    FadeCommand command;
+    if (mqttPatch == nullptr || !dmxPatchResolve(*mqttPatch, path, target) || target.universe >= mqttUniverseCount ||
+        !parseFade(payload, length, text, command)) return;
+
+    uint16_t value = min(command.value, target.fine ? 65535UL : 255UL);
+    if (command.duration > 0 && target.universe == 0) {
+        dmxFadeStart(*mqttFades, *mqttFadeStart, target.channel, value, command.duration,
+                     dmxFadeCurveFromName(command.curve), target.fine, frameClockMillis());
+        return;
+    }
+    dmxPatchWrite(mqttUniverses[target.universe], target, value);
+    dmxUniverseCommit(mqttUniverses[target.universe]);
+}
+
+// "<id> [ms] [curve]", parsed like a fade with the id as the value
+static void applyRecall(const byte* payload, unsigned int length) {
+    char text[32];
+    FadeCommand command;
+    if (mqttPresets == nullptr || !parseFade(payload, length, text, command) || command.value >= PRESET_SLOTS) return;
+    dmxPresetRecall(*mqttPresets, command.value, mqttUniverses, mqttUniverseCount, *mqttFades, *mqttFadeStart,
+                    command.duration, dmxFadeCurveFromName(command.curve), frameClockMillis());
+}
+
+static void onMqttMessage(char* topic, byte* payload, unsigned int length) {
+    if (strncmp(topic, mqttConfig.baseTopic, baseTopicLength) != 0 || topic[baseTopicLength] != '/') return;
+
+    const char* p = topic + baseTopicLength + 1;
+    if (strncmp(p, "cmd/", 4) == 0) {
+        if (commandHandler != nullptr) commandHandler(p + 4, payload, length);
+        return;
+    }
+    if (strncmp(p, "attr/", 5) == 0) {
+        applyAttribute(p + 5, payload, length);
+        return;
+    }
+    if (strcmp(p, "recall") == 0) {
+        applyRecall(payload, length);
+        return;
+    }
+
+    unsigned long universeIndex;
+    if (!parseNumber(p, universeIndex) || universeIndex < 1 || universeIndex > mqttUniverseCount || *p++ != '/') return;
+    DmxUniverse& universe = mqttUniverses[universeIndex - 1];
+
+    unsigned long channel = 1;
+    if (strncmp(p, "channel/", 8) == 0) {
+        p += 8;
+        if (!parseNumber(p, channel) || *p != '\0') return;
+        dmxUniverseSet(universe, channel, parseValue(payload, length));
+    } else if (strncmp(p, "slots", 5) == 0) {
+        p += 5;
+        if (*p == '/') {
+            p++;
+            if (!parseNumber(p, channel)) return;
+        }
+        if (*p != '\0') return;
+        dmxUniverseWrite(universe, channel, payload, length);
+    } else if (strcmp(p, "delta") == 0) {
+        if (!dmxDiffApply(universe, payload, length)) return;
+    } else if (strcmp(p, "batch") == 0) {
+        applyBatch(universe, payload, length);
+    } else if (universeIndex == 1 && (strncmp(p, "fade/", 5) == 0 || strncmp(p, "fade16/", 7) == 0)) {
+        // Fades are written and committed by the engine each frame
+        bool fine = p[4] == '1';
+        p += fine ? 7 : 5;
+        if (!parseNumber(p, channel) || *p != '\0') return;
+        applyFade(channel, fine, payload, length);
+        return;
+    } else {
+        return;
+    }
+
+    dmxUniverseCommit(universe);
+}
+
+static void subscribe(const char* format, unsigned long universe = 0) {
+    char filter[48];
+    snprintf(filter, sizeof(filter), format, mqttConfig.baseTopic, universe);
+    mqtt.subscribe(filter);
+}
+
+// MQTT handshake on the socket opened by the previous pass (PubSubClient
+// skips its own connect when the client is already connected)
+static bool mqttConnect() {
+    char clientId[24];
+    snprintf(clientId, sizeof(clientId), "mqtt2dmx-%08lx", (unsigned long)random(0x7fffffff));
+
+    const char* user = mqttConfig.username[0] ? mqttConfig.username : nullptr;
+    const char* pass = mqttConfig.password[0] ? mqttConfig.password : nullptr;
+    if (!mqtt.connect(clientId, user, pass, statusTopic, 0, true, "offline")) {
+        return false;
+    }
+
+    // Only the input topics, so our own stats and input/... publishes are
+    // not sent back to us
+    for (unsigned long u = 1; u <= mqttUniverseCount; u++) subscribe("%s/%lu/#", u);
+    subscribe("%s/attr/#");
+    subscribe("%s/recall");
+    subscribe("%s/cmd/#");
+    mqtt.publish(statusTopic, "online", true);
+    return true;
+}
+
+void mqttBegin(DmxUniverse* layers, uint8_t count, const DmxUniverse& fadeStart, DmxFadeEngine& fades,
+               const DmxPatch& patch, const DmxPresetBank& presets) {
+    mqttPatch = &patch;
+    mqttPresets = &presets;
+    mqttUniverses = layers;
+    mqttUniverseCount = count;
+    mqttFadeStart = &fadeStart;
+    mqttFades = &fades;
+    mqttNet.setConnectionTimeout(MQTT_CONNECT_TIMEOUT);
+    mqtt.setBufferSize(MQTT_BUFFER_SIZE);
+    mqtt.setKeepAlive(MQTT_KEEPALIVE);
+    mqtt.setSocketTimeout(1);
+    mqtt.setCallback(onMqttMessage);
+}
+
+void mqttOnCommand(MqttCommandHandler handler) {
+    commandHandler = handler;
+}
+
+void mqttConfigure(const MqttConfig& config) {
+    if (session) mqtt.disconnect();
+    else if (socketOpen) mqttNet.stop();
+    session = false;
+    socketOpen = false;
+
+    mqttConfig = config;
+    mqttConfig.broker[sizeof(mqttConfig.broker) - 1] = '\0';
+    mqttConfig.username[sizeof(mqttConfig.username) - 1] = '\0';
+    mqttConfig.password[sizeof(mqttConfig.password) - 1] = '\0';
+    mqttConfig.baseTopic[sizeof(mqttConfig.baseTopic) - 1] = '\0';
+    if (mqttConfig.baseTopic[0] == '\0') {
+        strcpy(mqttConfig.baseTopic, MQTT_DEFAULT_BASE_TOPIC);
+    }
+    baseTopicLength = strlen(mqttConfig.baseTopic);
+    snprintf(statusTopic, sizeof(statusTopic), "%s/status", mqttConfig.baseTopic);
+
+    mqttEnabled = mqttConfig.broker[0] != '\0';
+    mqtt.setServer(mqttConfig.broker, mqttConfig.port ? mqttConfig.port : MQTT_DEFAULT_PORT);
+
+    // Connect on the next loop pass
+    retryInterval = MQTT_RETRY_MIN;
+    lastConnectAttempt = millis() - retryInterval;
+}
+
+void mqttLoop() {
+    if (!mqttEnabled || mqttUniverses == nullptr) return;
+
+    if (session) {
+        if (mqtt.loop()) return;
+        session = false;
+        LOG_WARN("MQTT connection lost, state %d", mqtt.state());
+    }
+
+    if (socketOpen) {
+        socketOpen = false;
+        session = mqttConnect();
+        if (session) {
+            LOG_INFO("MQTT connected to %s", mqttConfig.broker);
+            retryInterval = MQTT_RETRY_MIN;
+            return;
+        }
+        LOG_WARN("MQTT handshake failed, state %d", mqtt.state());
+        mqttNet.stop();
+        retryInterval = min(retryInterval * 2, (unsigned long)MQTT_RETRY_MAX);
+        return;
+    }
+
+    // Cheap check first, WiFi.status() is a round trip to the modem
+    unsigned long now = millis();
+    if (now - lastConnectAttempt < retryInterval) return;
+    if (WiFi.status() != WL_CONNECTED) return;
+    lastConnectAttempt = now;
+
+    socketOpen = mqttNet.connect(mqttConfig.broker, mqttConfig.port ? mqttConfig.port : MQTT_DEFAULT_PORT);
+    if (!socketOpen) {
+        LOG_WARN("MQTT broker %s unreachable", mqttConfig.broker);
+        retryInterval = min(retryInterval * 2, (unsigned long)MQTT_RETRY_MAX);
+    }
+}
+
+bool mqttConnected() {
+    return session;
+}
+
+bool mqttPublish(const char* subtopic, const char* payload, bool retained) {
+    if (!session) return false;
+
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s/%s", mqttConfig.baseTopic, subtopic);
+    return mqtt.publish(topic, payload, retained);
+}
+
+bool mqttPublish(const char* subtopic, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!session) return false;
+
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s/%s", mqttConfig.baseTopic, subtopic);
+    return mqtt.publish(topic, payload, length, retained);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+#include "dmx_universe.h"
+#include "dmx_fade.h"
+#include "dmx_patch.h"
+#include "dmx_presets.h"
+
+// MQTT control channel. One persistent broker connection replaces the per-change
+// HTTP requests. Topics (universe index u runs from 1 to the universe count):
+//   <base>/<u>/channel/<n>   text value "0".."255" for channel n
+//   <base>/<u>/slots         binary, raw slot values starting at channel 1
+//   <base>/<u>/slots/<n>     binary, raw slot values starting at channel n
+//   <base>/<u>/delta         binary, changed-slot runs as in dmx_bridge.h
+//   <base>/<u>/batch         JSON {"updates":[{"channel":1,"value":255},...]}
+//   <base>/1/fade/<n>        text "<value> [ms] [linear|in|out|inout]", fades channel n
+//   <base>/1/fade16/<n>      same with a 0-65535 value over channels n and n+1
+//                            (the fade engine runs on universe 1 only)
+//   <base>/attr/<fixture>.<attribute>
+//                            text "<value> [ms] [curve]", sets a patched attribute
+//                            (0-65535 for 16-bit ones), or fades it when ms is given
+//   <base>/recall            text "<id> [ms] [curve]", recalls a stored preset, fading
+//                            to it when ms is given (universe 1 presets only)
+//   <base>/cmd/<command>     JSON command, passed to the command handler
+//   <base>/status            retained "online"/"offline" (last will)
+//   <base>/stats             loop timing JSON, published periodically by main
+//   <base>/input/slots       retained, the DMX input's full universe, and
+//   <base>/input/delta       its changes as runs, both published by main
+// Every message is applied as one commit.
+
+#define MQTT_DEFAULT_PORT 1883
+#define MQTT_DEFAULT_BASE_TOPIC "mqtt2dmx"
+#define MQTT_BUFFER_SIZE 768       // Full universe payload plus topic and header
+#define MQTT_KEEPALIVE 15          // Seconds
+#define MQTT_RETRY_MIN 1000        // Reconnect backoff, ms
+#define MQTT_RETRY_MAX 30000
+#define MQTT_CONNECT_TIMEOUT 10    // TCP connect timeout, ms, well inside a frame period
+
+struct MqttConfig {
+  uint32_t magic;
+  char broker[64];
+  uint16_t port;
+  char username[32];
+  char password[32];
+  char baseTopic[32];
+};
+
+// Route incoming messages into layers[u - 1]. Fades start from the values in
+// fadeStart (what universe 1 is sending) and run on the fade engine. Attribute
+// topics are resolved through patch, recalls through presets.
+void mqttBegin(DmxUniverse* layers, uint8_t count, const DmxUniverse& fadeStart, DmxFadeEngine& fades,
+               const DmxPatch& patch, const DmxPresetBank& presets);
+
+// Receives <base>/cmd/<command> messages, so commands can share their JSON
+// handling with the HTTP API
+typedef void (*MqttCommandHandler)(const char* command, const uint8_t* payload, unsigned int length);
+void mqttOnCommand(MqttCommandHandler handler);
+
+// Apply a broker configuration; drops the current connection if any
+void mqttConfigure(const MqttConfig& config);
+
+// Call every loop(). Services the socket and retries the connection with
+// exponential backoff. A connect takes two passes: the TCP connect, capped at
+// MQTT_CONNECT_TIMEOUT, then the MQTT handshake on the open socket, which
+// only waits for the broker's CONNACK (a LAN round trip; PubSubClient gives
+// up after its 1 s socket timeout if a broker accepts TCP but never answers).
+void mqttLoop();
+
+bool mqttConnected();
+
+// Publish to <base>/<subtopic>; false if not connected or it does not fit
+bool mqttPublish(const char* subtopic, const char* payload, bool retained = false);
+bool mqttPublish(const char* subtopic, const uint8_t* payload, unsigned int length, bool retained = false);
@@ -0,0 +1,187 @@
+#include "rdm.h"
+#include <string.h>
+
+#define UID_BITS 48
+
+static void putUid(uint8_t* p, RdmUid uid) {
+    for (int i = 0; i < 6; i++) p[i] = (uint8_t)(uid >> (40 - 8 * i));
+}
+
+static RdmUid getUid(const uint8_t* p) {
+    RdmUid uid = 0;
+    for (int i = 0; i < 6; i++) uid = (uid << 8) | p[i];
+    return uid;
+}
+
+static uint16_t checksum(const uint8_t* data, uint16_t length) {
+    uint16_t sum = 0;
+    for (uint16_t i = 0; i < length; i++) sum += data[i];
+    return sum;
+}
+
+uint16_t rdmEncode(uint8_t* out, const RdmRequest& request, RdmUid source, uint8_t transaction) {
+    uint8_t pdl = request.pdl > sizeof(request.data) ? sizeof(request.data) : request.pdl;
+    out[0] = RDM_START_CODE;
+    out[1] = RDM_SUB_START_CODE;
+    out[2] = RDM_HEADER_SIZE + pdl;
+    putUid(out + 3, request.destination);
+    putUid(out + 9, source);
+    out[15] = transaction;
+    out[16] = 1;  // Port ID
+    out[17] = 0;  // Message count
+    out[18] = request.subDevice >> 8;
+    out[19] = request.subDevice & 0xFF;
+    out[20] = request.commandClass;
+    out[21] = request.pid >> 8;
+    out[22] = request.pid & 0xFF;
+    out[23] = pdl;
+    memcpy(out + RDM_HEADER_SIZE, request.data, pdl);
+
+    uint16_t length = RDM_HEADER_SIZE + pdl;
+    uint16_t sum = checksum(out, length);
+    out[length++] = sum >> 8;
+    out[length++] = sum & 0xFF;
+    return length;
+}
+
+bool rdmDecode(const uint8_t* packet, uint16_t length, RdmResponse& response) {
+    if (length < RDM_HEADER_SIZE + 2 || packet[0] != RDM_START_CODE || packet[1] != RDM_SUB_START_CODE) return false;
+    uint8_t messageLength = packet[2];
+    if (messageLength < RDM_HEADER_SIZE || length < messageLength + 2 ||
+        messageLength != RDM_HEADER_SIZE + packet[23]) return false;
+    if (checksum(packet, messageLength) != ((packet[messageLength] << 8) | packet[messageLength + 1])) return false;
+
+    response.source = getUid(packet + 9);
+    response.transaction = packet[15];
+    response.responseType = packet[16];
+    response.commandClass = packet[20];
+    response.pid = (packet[21] << 8) | packet[22];
+    response.pdl = packet[23];
+    response.data = packet + RDM_HEADER_SIZE;
+    return true;
+}
+
+bool rdmDecodeDiscovery(const uint8_t* data, uint16_t length, RdmUid& uid) {
+    uint16_t i = 0;
+    while (i < length && i < 7 && data[i] == 0xFE) i++;
+    if (i >= length || data[i] != 0xAA || length - i - 1 < 16) return false;
+    const uint8_t* e = data + i + 1;
+
+    // Each byte comes as (b | 0xAA, b | 0x55); a collision breaks the pattern
+    uint8_t bytes[8];
+    for (int j = 0; j < 8; j++) {
+        if ((e[2 * j] & 0xAA) != 0xAA || (e[2 * j + 1] & 0x55) != 0x55) return false;
+        bytes[j] = e[2 * j] & e[2 * j + 1];
+    }
+    if (checksum(e, 12) != ((bytes[6] << 8) | bytes[7])) return false;
+
+    uid = getUid(bytes);
+    return true;
+}
+
+void rdmDiscoveryStart(RdmDiscovery& discovery) {
+    memset(&discovery, 0, sizeof(discovery));
+    discovery.step = RDM_DISCOVERY_UNMUTE;
+}
+
+static inline RdmUid branchSize(uint8_t depth) {
+    return (RdmUid)1 << (UID_BITS - depth);
+}
+
+// Go to the next subtree in UID order, or finish
+static void advance(RdmDiscovery& d) {
+    while (d.depth > 0 && (d.lower & branchSize(d.depth))) {
+        d.lower -= branchSize(d.depth);
+        d.depth--;
+    }
+    if (d.depth == 0) {
+        d.step = RDM_DISCOVERY_DONE;
+        return;
+    }
+    d.lower += branchSize(d.depth);
+    d.step = RDM_DISCOVERY_BRANCH;
+}
+
+// Several devices in the branch: split it, unless it is down to one UID
+static void split(RdmDiscovery& d) {
+    if (d.depth < UID_BITS) {
+        d.depth++;
+        d.step = RDM_DISCOVERY_BRANCH;
+    } else {
+        advance(d);
+    }
+}
+
+bool rdmDiscoveryRequest(const RdmDiscovery& discovery, RdmRequest& request, bool& expectReply, bool& discoveryReply) {
+    memset(&request, 0, sizeof(request));
+    request.destination = RDM_UID_BROADCAST;
+    request.commandClass = RDM_DISCOVERY_COMMAND;
+    expectReply = true;
+    discoveryReply = false;
+
+    switch (discovery.step) {
+        case RDM_DISCOVERY_UNMUTE:
+            request.pid = RDM_PID_DISC_UN_MUTE;
+            expectReply = false;
+            return true;
+        case RDM_DISCOVERY_BRANCH:
+            request.pid = RDM_PID_DISC_UNIQUE_BRANCH;
+            request.pdl = 12;
+            putUid(request.data, discovery.lower);
+            putUid(request.data + 6, discovery.lower + branchSize(discovery.depth) - 1);
+            discoveryReply = true;
+            return true;
+        case RDM_DISCOVERY_MUTE:
+            request.destination = discovery.candidate;
+            request.pid = RDM_PID_DISC_MUTE;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void rdmDiscoveryReply(RdmDiscovery& discovery, const uint8_t* data, uint16_t length) {
+    RdmDiscovery& d = discovery;
+    switch (d.step) {
+        case RDM_DISCOVERY_UNMUTE:
+            d.step = RDM_DISCOVERY_BRANCH;
+            break;
+
+        case RDM_DISCOVERY_BRANCH: {
+            RdmUid uid;
+            if (length == 0) {
+                advance(d);
+            } else if (rdmDecodeDiscovery(data, length, uid) && uid >= d.lower &&
+                       uid < d.lower + branchSize(d.depth)) {
+                d.candidate = uid;
+                d.step = RDM_DISCOVERY_MUTE;
+            } else {
+                split(d);
+            }
+            break;
+        }
+
+        case RDM_DISCOVERY_MUTE: {
+            RdmResponse response;
+            if (!rdmDecode(data, length, response) || response.source != d.candidate ||
+                response.commandClass != RDM_DISCOVERY_COMMAND_RESPONSE || response.pid != RDM_PID_DISC_MUTE) {
+                // The "single" reply was probably two that happened to decode
+                split(d);
+                break;
+            }
+            bool known = false;
+            for (uint8_t i = 0; i < d.count; i++) known = known || d.found[i] == d.candidate;
+            if (!known && d.count >= RDM_MAX_DEVICES) {
+                d.overflow = true;
+                d.step = RDM_DISCOVERY_DONE;
+                break;
+            }
+            if (!known) d.found[d.count++] = d.candidate;
+            d.step = RDM_DISCOVERY_BRANCH; // Ask the same branch again
+            break;
+        }
+
+        default:
+            break;
+    }
+}
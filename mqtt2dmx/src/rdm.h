@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+
+// RDM (ANSI E1.20) packets and discovery, independent of the line driver.
+// A UID is the 16-bit manufacturer ID and 32-bit device ID packed into the
+// low 48 bits of a uint64_t, so comparing UIDs is comparing numbers.
+
+typedef uint64_t RdmUid;
+#define RDM_UID_MAX 0xFFFFFFFFFFFFULL
+#define RDM_UID_BROADCAST RDM_UID_MAX
+#define RDM_UID_MANUFACTURER(uid) ((uint16_t)((uid) >> 32))
+
+#define RDM_START_CODE 0xCC
+#define RDM_SUB_START_CODE 0x01
+#define RDM_HEADER_SIZE 24        // Start code up to and including the PDL
+#define RDM_MAX_PDL 231
+#define RDM_MAX_PACKET (RDM_HEADER_SIZE + RDM_MAX_PDL + 2)
+
+// Command classes
+#define RDM_DISCOVERY_COMMAND 0x10
+#define RDM_DISCOVERY_COMMAND_RESPONSE 0x11
+#define RDM_GET_COMMAND 0x20
+#define RDM_GET_COMMAND_RESPONSE 0x21
+#define RDM_SET_COMMAND 0x30
+#define RDM_SET_COMMAND_RESPONSE 0x31
+
+// Response types
+#define RDM_RESPONSE_ACK 0x00
+#define RDM_RESPONSE_ACK_TIMER 0x01
+#define RDM_RESPONSE_NACK_REASON 0x02
+#define RDM_RESPONSE_ACK_OVERFLOW 0x03
+
+// Parameter IDs used here
+#define RDM_PID_DISC_UNIQUE_BRANCH 0x0001
+#define RDM_PID_DISC_MUTE 0x0002
+#define RDM_PID_DISC_UN_MUTE 0x0003
+#define RDM_PID_DEVICE_INFO 0x0060
+#define RDM_PID_DEVICE_LABEL 0x0082
+#define RDM_PID_DMX_START_ADDRESS 0x00F0
+#define RDM_PID_IDENTIFY_DEVICE 0x1000
+
+struct RdmRequest {
+    RdmUid destination;
+    uint8_t commandClass;
+    uint16_t pid;
+    uint16_t subDevice;
+    uint8_t pdl;
+    uint8_t data[32];         // Enough for every request sent here
+};
+
+struct RdmResponse {
+    RdmUid source;
+    uint8_t transaction;
+    uint8_t responseType;
+    uint8_t commandClass;
+    uint16_t pid;
+    uint8_t pdl;
+    const uint8_t* data;      // Points into the received packet
+};
+
+// Encode request into out (RDM_MAX_PACKET bytes), start code first and
+// checksum last. Returns the length.
+uint16_t rdmEncode(uint8_t* out, const RdmRequest& request, RdmUid source, uint8_t transaction);
+
+// Decode a received response; false if it is malformed or the checksum is
+// wrong. response.data points into packet.
+bool rdmDecode(const uint8_t* packet, uint16_t length, RdmResponse& response);
+
+// Decode the reply to DISC_UNIQUE_BRANCH: optional 0xFE preamble, 0xAA, the
+// UID with every byte sent twice (| 0xAA, | 0x55) and the same for the
+// checksum. False for nothing or a collision of several replies.
+bool rdmDecodeDiscovery(const uint8_t* data, uint16_t length, RdmUid& uid);
+
+// Binary-search discovery over the UID space without a stack: the current
+// branch is (lower, depth), a subtree of 2^(48 - depth) UIDs. A collision
+// descends into the lower half, a silent or finished branch moves on to the
+// next subtree in order. A UID that answers alone is muted and the same
+// branch asked again, since more devices may sit in it.
+
+#define RDM_MAX_DEVICES 16
+
+enum RdmDiscoveryStep : uint8_t {
+    RDM_DISCOVERY_IDLE,
+    RDM_DISCOVERY_UNMUTE,     // Broadcast un-mute, no reply
+    RDM_DISCOVERY_BRANCH,     // DISC_UNIQUE_BRANCH over the current branch
+    RDM_DISCOVERY_MUTE,       // Mute the UID that answered
+    RDM_DISCOVERY_DONE
+};
+
+struct RdmDiscovery {
+    RdmDiscoveryStep step;
+    uint8_t depth;
+    RdmUid lower;
+    RdmUid candidate;         // Answered the last branch, being muted
+    RdmUid found[RDM_MAX_DEVICES];
+    uint8_t count;
+    bool overflow;            // More devices answered than fit in found
+};
+
+void rdmDiscoveryStart(RdmDiscovery& discovery);
+inline bool rdmDiscoveryRunning(const RdmDiscovery& discovery) {
+    return discovery.step != RDM_DISCOVERY_IDLE && discovery.step != RDM_DISCOVERY_DONE;
+}
+
+// The next request to send; false if discovery is not running. expectReply
+// is false for broadcasts, discoveryReply true when the answer comes without
+// a break (DISC_UNIQUE_BRANCH).
+bool rdmDiscoveryRequest(const RdmDiscovery& discovery, RdmRequest& request, bool& expectReply, bool& discoveryReply);
+
+// Feed what came back for that request, length 0 if nothing did
+void rdmDiscoveryReply(RdmDiscovery& discovery, const uint8_t* data, uint16_t length);
@@ -0,0 +1,289 @@
+#include "rdm_controller.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "frame_clock.h"
+#include "log.h"
+
+enum RdmTransaction : uint8_t {
+    RDM_IDLE,
+    RDM_DISCOVERY_STEP,
+    RDM_QUEUED_REQUEST,
+    RDM_DEVICE_INFO
+};
+
+static DmxPort* rdmPort = nullptr;
+static RdmUid controllerUid = 0;
+static uint8_t transactionNumber = 0;
+
+static RdmDiscovery discovery;
+static RdmDevice devices[RDM_MAX_DEVICES];
+static uint8_t deviceCount = 0;
+
+static RdmRequest queue[RDM_QUEUE_SIZE];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+static RdmResult lastResult;
+
+// Transaction in flight
+static RdmTransaction inFlight = RDM_IDLE;
+static RdmRequest current;
+static uint8_t infoDevice = 0;
+static uint8_t txPacket[RDM_HEADER_SIZE + sizeof(RdmRequest::data) + 2];
+static uint8_t rxPacket[RDM_MAX_PACKET];
+static unsigned long waitingSince = 0; // millis() when work started waiting for a gap, 0 if none
+static uint32_t inFlightWindow = 0;
+
+#define RDM_SLOT_US 44              // One byte at 250 kbaud
+#define RDM_DISCOVERY_REPLY_SIZE 24 // Preamble, delimiter, encoded UID and checksum
+
+// The next thing to do, without taking it yet
+static RdmTransaction nextWork(uint8_t& device) {
+    if (rdmDiscoveryRunning(discovery)) return RDM_DISCOVERY_STEP;
+    if (queueCount > 0) return RDM_QUEUED_REQUEST;
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        if (!devices[i].info && devices[i].infoTries < RDM_INFO_TRIES) {
+            device = i;
+            return RDM_DEVICE_INFO;
+        }
+    }
+    return RDM_IDLE;
+}
+
+static void discoveryFinished() {
+    deviceCount = discovery.count;
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        devices[i] = {};
+        devices[i].uid = discovery.found[i];
+        devices[i].address = 0xFFFF;
+    }
+    LOG_INFO("RDM: discovery found %u devices%s", deviceCount, discovery.overflow ? " (table full)" : "");
+}
+
+static RdmDevice* findDevice(RdmUid uid) {
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        if (devices[i].uid == uid) return &devices[i];
+    }
+    return nullptr;
+}
+
+static void finishDeviceInfo(uint16_t length) {
+    RdmDevice& device = devices[infoDevice];
+    RdmResponse response;
+    device.infoTries++;
+    if (!rdmDecode(rxPacket, length, response) || response.source != device.uid ||
+        response.responseType != RDM_RESPONSE_ACK || response.pid != RDM_PID_DEVICE_INFO || response.pdl < 19) {
+        return;
+    }
+    const uint8_t* d = response.data;
+    device.model = (d[2] << 8) | d[3];
+    device.footprint = (d[10] << 8) | d[11];
+    device.address = (d[14] << 8) | d[15];
+    device.info = true;
+}
+
+static void finishRequest(uint16_t length) {
+    RdmResponse response;
+    lastResult = {};
+    lastResult.uid = current.destination;
+    lastResult.commandClass = current.commandClass;
+    lastResult.pid = current.pid;
+    if (current.destination == RDM_UID_BROADCAST) {
+        lastResult.status = RDM_RESULT_ACK; // Broadcasts get no reply
+        return;
+    }
+    if (length == 0) {
+        lastResult.status = RDM_RESULT_TIMEOUT;
+        return;
+    }
+    if (!rdmDecode(rxPacket, length, response) || response.source != current.destination ||
+        response.transaction != transactionNumber || response.pid != current.pid) {
+        lastResult.status = RDM_RESULT_INVALID;
+        return;
+    }
+
+    switch (response.responseType) {
+        case RDM_RESPONSE_ACK:
+        case RDM_RESPONSE_ACK_OVERFLOW: lastResult.status = RDM_RESULT_ACK; break;
+        case RDM_RESPONSE_ACK_TIMER: lastResult.status = RDM_RESULT_ACK_TIMER; break;
+        case RDM_RESPONSE_NACK_REASON: lastResult.status = RDM_RESULT_NACK; break;
+        default: lastResult.status = RDM_RESULT_INVALID; break;
+    }
+    lastResult.pdl = min(response.pdl, (uint8_t)sizeof(lastResult.data));
+    memcpy(lastResult.data, response.data, lastResult.pdl);
+
+    // Keep the device table in step with a new address
+    RdmDevice* device = findDevice(current.destination);
+    if (device != nullptr && lastResult.status == RDM_RESULT_ACK && current.pid == RDM_PID_DMX_START_ADDRESS &&
+        current.commandClass == RDM_SET_COMMAND && current.pdl == 2) {
+        device->address = (current.data[0] << 8) | current.data[1];
+    }
+}
+
+static void finishTransaction() {
+    uint16_t length = rdmPort->rdmReplyLength();
+    switch (inFlight) {
+        case RDM_DISCOVERY_STEP:
+            rdmDiscoveryReply(discovery, rxPacket, length);
+            if (discovery.step == RDM_DISCOVERY_DONE) discoveryFinished();
+            break;
+        case RDM_QUEUED_REQUEST:
+            finishRequest(length);
+            break;
+        case RDM_DEVICE_INFO:
+            finishDeviceInfo(length);
+            break;
+        default:
+            break;
+    }
+    inFlight = RDM_IDLE;
+}
+
+// The request for work, without taking it off the queue
+static void prepare(RdmTransaction work, uint8_t device, RdmRequest& request, bool& expectReply,
+                    bool& discoveryReply) {
+    expectReply = true;
+    discoveryReply = false;
+    switch (work) {
+        case RDM_DISCOVERY_STEP:
+            rdmDiscoveryRequest(discovery, request, expectReply, discoveryReply);
+            break;
+        case RDM_QUEUED_REQUEST:
+            request = queue[queueHead];
+            expectReply = request.destination != RDM_UID_BROADCAST;
+            break;
+        default:
+            request = {};
+            request.destination = devices[device].uid;
+            request.commandClass = RDM_GET_COMMAND;
+            request.pid = RDM_PID_DEVICE_INFO;
+            break;
+    }
+}
+
+// Line time for the request, and for a reply if one is due: the full reply
+// timeout, so a silent device still fits, then RDM_REPLY_PDL bytes of data
+static uint32_t windowUs(const RdmRequest& request, bool expectReply, bool discoveryReply) {
+    uint32_t us = RDM_BREAK_TIME + RDM_MAB_TIME + (RDM_HEADER_SIZE + request.pdl + 2) * RDM_SLOT_US;
+    if (!expectReply) return us;
+    us += RDM_REPLY_TIMEOUT;
+    if (discoveryReply) return us + RDM_DISCOVERY_REPLY_SIZE * RDM_SLOT_US;
+    return us + RDM_BREAK_TIME + RDM_MAB_TIME + (RDM_HEADER_SIZE + RDM_REPLY_PDL + 2) * RDM_SLOT_US;
+}
+
+// Room for a transaction of window us before the next tick, or waited long enough
+static bool gapAvailable(uint32_t window) {
+    if (!rdmPort->frameDone()) return false;
+    if (frameClockRemaining() > window) return true;
+    if (waitingSince == 0) waitingSince = millis() | 1;
+    return millis() - waitingSince > RDM_MAX_WAIT;
+}
+
+void rdmBegin(DmxPort& port) {
+    rdmPort = &port;
+    const bsp_unique_id_t* id = R_BSP_UniqueIdGet();
+    uint32_t device = id->unique_id_words[0] ^ id->unique_id_words[1] ^ id->unique_id_words[2] ^
+                      id->unique_id_words[3];
+    controllerUid = ((RdmUid)RDM_MANUFACTURER_ID << 32) | device;
+    discovery = {};
+}
+
+void rdmDiscover() {
+    rdmDiscoveryStart(discovery);
+}
+
+bool rdmQueue(const RdmRequest& request) {
+    if (queueCount >= RDM_QUEUE_SIZE) return false;
+    queue[(queueHead + queueCount) % RDM_QUEUE_SIZE] = request;
+    queueCount++;
+    return true;
+}
+
+bool rdmBusy() {
+    uint8_t device;
+    return rdmPort != nullptr && !rdmPort->isInput() && (inFlight != RDM_IDLE || nextWork(device) != RDM_IDLE);
+}
+
+uint32_t rdmWindowUs() {
+    if (rdmPort == nullptr || rdmPort->isInput()) return 0;
+    if (inFlight != RDM_IDLE) return inFlightWindow;
+
+    uint8_t device = 0;
+    RdmTransaction work = nextWork(device);
+    if (work == RDM_IDLE) return 0;
+    RdmRequest request;
+    bool expectReply, discoveryReply;
+    prepare(work, device, request, expectReply, discoveryReply);
+    return windowUs(request, expectReply, discoveryReply);
+}
+
+void rdmLoop() {
+    if (rdmPort == nullptr) return;
+    if (inFlight != RDM_IDLE) {
+        if (!rdmPort->rdmPoll()) return;
+        finishTransaction();
+    }
+    if (rdmPort->isInput()) return; // The line belongs to a console
+
+    uint8_t device = 0;
+    RdmTransaction work = nextWork(device);
+    if (work == RDM_IDLE) {
+        waitingSince = 0;
+        return;
+    }
+    RdmRequest request;
+    bool expectReply, discoveryReply;
+    prepare(work, device, request, expectReply, discoveryReply);
+    uint32_t window = windowUs(request, expectReply, discoveryReply);
+    if (!gapAvailable(window)) return;
+
+    current = request;
+    if (work == RDM_QUEUED_REQUEST) {
+        queueHead = (queueHead + 1) % RDM_QUEUE_SIZE;
+        queueCount--;
+    } else if (work == RDM_DEVICE_INFO) {
+        infoDevice = device;
+    }
+
+    uint16_t length = rdmEncode(txPacket, current, controllerUid, ++transactionNumber);
+    DmxRdmReply expect = !expectReply ? RDM_NO_REPLY : discoveryReply ? RDM_DISCOVERY_REPLY : RDM_REPLY;
+    if (!rdmPort->sendRdm(txPacket, length, rxPacket, sizeof(rxPacket), expect)) return;
+    inFlight = work;
+    inFlightWindow = window;
+    waitingSince = 0;
+}
+
+RdmUid rdmUid() {
+    return controllerUid;
+}
+
+const RdmDiscovery& rdmDiscovery() {
+    return discovery;
+}
+
+uint8_t rdmDeviceCount() {
+    return deviceCount;
+}
+
+const RdmDevice& rdmDevice(uint8_t index) {
+    return devices[index];
+}
+
+const RdmResult& rdmLastResult() {
+    return lastResult;
+}
+
+void rdmUidFormat(RdmUid uid, char* out) {
+    snprintf(out, RDM_UID_TEXT, "%04x:%08lx", RDM_UID_MANUFACTURER(uid), (unsigned long)(uid & 0xFFFFFFFF));
+}
+
+bool rdmUidParse(const char* text, RdmUid& uid) {
+    if (text == nullptr) return false;
+    char* end;
+    unsigned long manufacturer = strtoul(text, &end, 16);
+    if (end == text || *end != ':' || manufacturer > 0xFFFF) return false;
+    const char* p = end + 1;
+    unsigned long device = strtoul(p, &end, 16);
+    if (end == p || *end != '\0') return false;
+    uid = ((RdmUid)manufacturer << 32) | device;
+    return true;
+}
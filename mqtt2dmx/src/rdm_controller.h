@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+#include "dmx_output.h"
+#include "rdm.h"
+
+// RDM controller on one DMX port. Every transaction takes the place of a gap
+// between two frames: it only starts once the frame is out and the line time
+// it needs (rdmWindowUs(): the request, plus the reply timeout and a reply of
+// RDM_REPLY_PDL bytes if one is due, 1.3-8.3 ms) is left before the next tick.
+// At the automatic rate there is no such gap, so while RDM has work the
+// period is stretched by that window: a full universe drops from about 44 to
+// about 34 frames/s during discovery or a GET, and returns once the work is
+// done. A fixed rate keeps its period; if it leaves no gap for RDM_MAX_WAIT,
+// one transaction goes out anyway and delays a single frame.
+//
+// Discovery finds the devices on the line, then their DEVICE_INFO is read
+// for model, footprint and start address. GET/SET requests are queued and
+// run one per gap; the latest result can be read back.
+
+#define RDM_MANUFACTURER_ID 0x7FF0  // ESTA prototyping range
+#define RDM_REPLY_PDL 32            // Reply data allowed for, longer ones delay a frame
+#define RDM_MAX_WAIT 1000           // ms
+#define RDM_QUEUE_SIZE 4
+#define RDM_INFO_TRIES 3
+
+struct RdmDevice {
+    RdmUid uid;
+    uint16_t model;
+    uint16_t footprint;
+    uint16_t address;     // DMX start address, 0xFFFF if it has none
+    uint8_t infoTries;
+    bool info;            // DEVICE_INFO was read
+};
+
+enum RdmResultStatus : uint8_t {
+    RDM_RESULT_NONE,
+    RDM_RESULT_ACK,
+    RDM_RESULT_ACK_TIMER,
+    RDM_RESULT_NACK,
+    RDM_RESULT_TIMEOUT,
+    RDM_RESULT_INVALID
+};
+
+struct RdmResult {
+    RdmUid uid;
+    uint8_t commandClass;
+    uint16_t pid;
+    RdmResultStatus status;
+    uint8_t pdl;
+    uint8_t data[32];     // Reply data, the NACK reason for a NACK
+};
+
+void rdmBegin(DmxPort& port);
+
+// Start (or restart) full discovery
+void rdmDiscover();
+
+// Queue a GET or SET; false if the queue is full
+bool rdmQueue(const RdmRequest& request);
+
+// Work is waiting for a frame gap
+bool rdmBusy();
+
+// Gap the transaction in flight or the next one needs, in us; 0 if idle
+uint32_t rdmWindowUs();
+
+// Start and finish transactions, call every loop()
+void rdmLoop();
+
+RdmUid rdmUid();
+const RdmDiscovery& rdmDiscovery();
+uint8_t rdmDeviceCount();
+const RdmDevice& rdmDevice(uint8_t index);
+const RdmResult& rdmLastResult();
+
+// "7ff0:12345678"; out holds RDM_UID_TEXT bytes
+#define RDM_UID_TEXT 14
+void rdmUidFormat(RdmUid uid, char* out);
+bool rdmUidParse(const char* text, RdmUid& uid);
@@ -0,0 +1,91 @@
+#include "scheduler.h"
+#include <Arduino.h>
+#include "frame_clock.h"
+
+struct SchedTask {
+    const char* name;
+    SchedTaskFunction run;
+    StatId stat;
+    uint8_t priority;
+    uint16_t budgetUs;
+    uint16_t intervalMs;
+    bool waiting;         // Deferred for lack of time...
+    uint32_t waitingSince; // ...since this frame
+    uint32_t lastRun;     // millis()
+    uint32_t overruns;
+};
+
+static SchedTask tasks[SCHED_MAX_TASKS];
+static uint8_t taskCount = 0;
+static SchedTaskFunction frameTask = nullptr;
+static StatId frameStat = STAT_FRAME;
+static uint32_t frames = 0;
+static uint32_t missedFrames = 0;
+
+static void runFrame() {
+    uint32_t due = frameClockTake();
+    if (due == 0 || frameTask == nullptr) return;
+    frames += due;
+    missedFrames += due - 1;
+
+    uint32_t t = statsStart();
+    frameTask();
+    statsEnd(frameStat, t);
+}
+
+void schedSetFrameTask(SchedTaskFunction run, StatId stat) {
+    frameTask = run;
+    frameStat = stat;
+}
+
+bool schedAdd(const char* name, SchedTaskFunction run, StatId stat, uint8_t priority, uint16_t budgetUs,
+              uint16_t intervalMs) {
+    if (taskCount >= SCHED_MAX_TASKS) return false;
+
+    // Keep the table in priority order, equal priorities in the order added
+    uint8_t i = taskCount++;
+    while (i > 0 && tasks[i - 1].priority < priority) {
+        tasks[i] = tasks[i - 1];
+        i--;
+    }
+    tasks[i] = { name, run, stat, priority, budgetUs, intervalMs, false, 0, 0, 0 };
+    return true;
+}
+
+void schedLoop() {
+    runFrame();
+
+    for (uint8_t i = 0; i < taskCount; i++) {
+        SchedTask& task = tasks[i];
+        unsigned long now = millis();
+        if (task.intervalMs != 0 && now - task.lastRun < task.intervalMs) continue;
+
+        if (task.budgetUs > frameClockRemaining()) {
+            if (!task.waiting) {
+                task.waiting = true;
+                task.waitingSince = frames;
+            }
+            if (frames - task.waitingSince < SCHED_STARVE_FRAMES) continue;
+        }
+        task.waiting = false;
+        task.lastRun = now;
+
+        uint32_t t = statsStart();
+        task.run();
+        if (statsElapsedUs(t) > task.budgetUs) task.overruns++;
+        statsEnd(task.stat, t);
+
+        runFrame();
+    }
+}
+
+size_t schedJson(char* buffer, size_t size) {
+    size_t n = snprintf(buffer, size, "{\"rate\":%u,\"missed\":%lu,\"overruns\":{", frameClockRate(),
+                        (unsigned long)missedFrames);
+    for (uint8_t i = 0; i < taskCount && n < size; i++) {
+        n += snprintf(buffer + n, size - n, "%s\"%s\":%lu", i ? "," : "", tasks[i].name,
+                      (unsigned long)tasks[i].overruns);
+    }
+    if (n < size) n += snprintf(buffer + n, size - n, "}}");
+    return n < size ? n : size - 1;
+}
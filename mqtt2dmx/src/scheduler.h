@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "loop_stats.h"
+
+// Cooperative scheduler locked to the frame clock. Every call to schedLoop()
+// is one round: the frame task runs whenever a tick is due, checked again
+// between tasks, and the other tasks run once each in priority order. A task
+// only starts if its budget fits in the time left before the next tick;
+// otherwise it waits for a later round, right after a frame, where the most
+// time is left. A task that has waited for SCHED_STARVE_FRAMES frames runs
+// anyway so nothing starves.
+//
+// Tasks taking longer than their budget count as overruns; a frame task that
+// finds more than one tick due counts the extra ones as missed frames.
+
+#define SCHED_MAX_TASKS 12
+#define SCHED_STARVE_FRAMES 4
+
+typedef void (*SchedTaskFunction)();
+
+void schedSetFrameTask(SchedTaskFunction run, StatId stat);
+
+// Higher priorities run first. intervalMs spaces out runs, 0 = every round.
+// Returns false if the table is full.
+bool schedAdd(const char* name, SchedTaskFunction run, StatId stat, uint8_t priority, uint16_t budgetUs,
+              uint16_t intervalMs = 0);
+
+void schedLoop();
+
+// {"rate":40,"missed":0,"overruns":{"task":n,...}}; returns the length
+// written, truncated to size - 1
+size_t schedJson(char* buffer, size_t size);
@@ -0,0 +1,239 @@
+#include "udp_control.h"
+#include <WiFiS3.h>
+#include "frame_clock.h"
+
+struct UdpSender {
+    uint32_t address;
+    uint16_t port;
+    uint16_t sequence;   // Last one applied
+    uint8_t status;      // Its result, repeated for retransmits
+    bool active;
+    unsigned long lastSeen;
+};
+
+static WiFiUDP udp;
+static DmxUniverse* udpLayers = nullptr;
+static uint8_t udpLayerCount = 0;
+static const DmxUniverse* udpFadeStart = nullptr;
+static DmxFadeEngine* udpFades = nullptr;
+static CuePlayer* udpPlayer = nullptr;
+static const DmxPresetBank* udpPresets = nullptr;
+static UdpSender senders[UDP_MAX_SENDERS];
+static uint16_t sendSequence = 0;
+
+static inline uint16_t readU16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8) | p[1];
+}
+
+static inline uint32_t readU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// The sender's slot, a new one if it is unknown; nullptr if all are busy
+static UdpSender* findSender(uint32_t address, uint16_t port) {
+    unsigned long now = millis();
+    UdpSender* freeSlot = nullptr;
+    for (UdpSender& s : senders) {
+        if (s.active && now - s.lastSeen > UDP_SENDER_TIMEOUT) s.active = false;
+        if (s.active && s.address == address && s.port == port) return &s;
+        if (!s.active && freeSlot == nullptr) freeSlot = &s;
+    }
+    if (freeSlot != nullptr) {
+        *freeSlot = { address, port, 0, UDP_STATUS_OK, true, now };
+    }
+    return freeSlot;
+}
+
+static void sendAck(const uint8_t* header, uint8_t status) {
+    uint8_t reply[UDP_HEADER_SIZE + 1];
+    memcpy(reply, header, UDP_HEADER_SIZE);
+    reply[2] = UDP_FLAG_REPLY;
+    reply[UDP_HEADER_SIZE] = status;
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write(reply, sizeof(reply));
+    udp.endPacket();
+}
+
+static uint8_t handleSet(uint16_t length) {
+    uint8_t params[3];
+    if (length < sizeof(params) + 1 || udp.read(params, sizeof(params)) != sizeof(params)) {
+        return UDP_STATUS_BAD_REQUEST;
+    }
+    length -= sizeof(params);
+
+    uint8_t universe = params[0];
+    uint16_t start = readU16(&params[1]);
+    if (universe < 1 || universe > udpLayerCount || start < 1 || start > DMX_CHANNELS ||
+        length > DMX_CHANNELS - start + 1) {
+        return UDP_STATUS_BAD_REQUEST;
+    }
+
+    // Only the slots that change are written, see dmxUniverseTakeTouched()
+    DmxUniverse& layer = udpLayers[universe - 1];
+    if (udp.read(dmxScratch, length) != (int)length) return UDP_STATUS_BAD_REQUEST;
+    dmxUniverseWrite(layer, start, dmxScratch, length);
+    dmxUniverseCommit(layer);
+    return UDP_STATUS_OK;
+}
+
+static uint8_t handleFade(uint16_t length) {
+    uint8_t params[10];
+    if (length != sizeof(params) || udp.read(params, sizeof(params)) != sizeof(params)) {
+        return UDP_STATUS_BAD_REQUEST;
+    }
+
+    bool fine = params[2] != 0;
+    uint16_t value = readU16(&params[4]);
+    if (params[3] > FADE_EASE_IN_OUT || (!fine && value > 255)) return UDP_STATUS_BAD_REQUEST;
+    return dmxFadeStart(*udpFades, *udpFadeStart, readU16(&params[0]), value, readU32(&params[6]),
+                        (DmxFadeCurve)params[3], fine, frameClockMillis())
+               ? UDP_STATUS_OK : UDP_STATUS_FAILED;
+}
+
+static uint8_t handleCue(uint16_t length) {
+    uint8_t cue;
+    if (length != 1 || udp.read(&cue, 1) != 1) return UDP_STATUS_BAD_REQUEST;
+
+    if (cue == UDP_CUE_NEXT && udpPlayer->running) {
+        dmxCueGo(*udpPlayer, frameClockMillis());
+        return UDP_STATUS_OK;
+    }
+    if (cue == UDP_CUE_NEXT) cue = 0;
+    if (udpPlayer->list == nullptr || cue >= udpPlayer->list->count) return UDP_STATUS_FAILED;
+    dmxCuePlay(*udpPlayer, cue, frameClockMillis());
+    return UDP_STATUS_OK;
+}
+
+static uint8_t handleRecall(uint16_t length) {
+    uint8_t params[6] = {};
+    if ((length != 1 && length != 5 && length != sizeof(params)) || udp.read(params, length) != length) {
+        return UDP_STATUS_BAD_REQUEST;
+    }
+
+    uint32_t fadeMs = length > 1 ? readU32(&params[1]) : 0;
+    if (params[0] >= PRESET_SLOTS || params[5] > FADE_EASE_IN_OUT) return UDP_STATUS_BAD_REQUEST;
+    return dmxPresetRecall(*udpPresets, params[0], udpLayers, udpLayerCount, *udpFades, *udpFadeStart, fadeMs,
+                           (DmxFadeCurve)params[5], frameClockMillis())
+               ? UDP_STATUS_OK : UDP_STATUS_FAILED;
+}
+
+static uint8_t handleDelta(uint16_t length) {
+    uint8_t universe;
+    if (length < 4 || udp.read(&universe, 1) != 1 || universe < 1 || universe > udpLayerCount) {
+        return UDP_STATUS_BAD_REQUEST;
+    }
+    length--;
+
+    // Run by run from the socket into the layer, each checked before it is read
+    DmxUniverse& layer = udpLayers[universe - 1];
+    uint8_t status = UDP_STATUS_OK;
+    bool written = false;
+    while (length > 0) {
+        uint8_t run[3];
+        if (length < sizeof(run) || udp.read(run, sizeof(run)) != sizeof(run)) {
+            status = UDP_STATUS_BAD_REQUEST;
+            break;
+        }
+        length -= sizeof(run);
+        uint16_t start = readU16(run);
+        uint8_t count = run[2];
+        if (start < 1 || count == 0 || start + count - 1 > DMX_CHANNELS || count > length) {
+            status = UDP_STATUS_BAD_REQUEST;
+            break;
+        }
+        if (udp.read(dmxScratch, count) != count) {
+            status = UDP_STATUS_BAD_REQUEST;
+            break;
+        }
+        dmxUniverseWrite(layer, start, dmxScratch, count);
+        length -= count;
+        written = true;
+    }
+    if (written) dmxUniverseCommit(layer);
+    return status;
+}
+
+static uint8_t execute(uint8_t opcode, uint16_t length) {
+    switch (opcode) {
+        case UDP_OP_SET:
+            return handleSet(length);
+        case UDP_OP_FADE:
+            return handleFade(length);
+        case UDP_OP_CUE:
+            return handleCue(length);
+        case UDP_OP_CUE_STOP:
+            dmxCueStop(*udpPlayer);
+            return UDP_STATUS_OK;
+        case UDP_OP_RECALL:
+            return handleRecall(length);
+        case UDP_OP_DELTA:
+            return handleDelta(length);
+        default:
+            return UDP_STATUS_BAD_REQUEST;
+    }
+}
+
+static void handlePacket(int size) {
+    uint8_t header[UDP_HEADER_SIZE];
+    if (size < UDP_HEADER_SIZE || udp.read(header, UDP_HEADER_SIZE) != UDP_HEADER_SIZE) return;
+    if (header[0] != 'D' || header[1] != 'X' || (header[2] & UDP_FLAG_REPLY)) return;
+
+    uint16_t sequence = readU16(&header[3]);
+    bool ack = header[2] & UDP_FLAG_ACK;
+    UdpSender* sender = nullptr;
+    if (sequence != 0) {
+        sender = findSender(udp.remoteIP(), udp.remotePort());
+        if (sender == nullptr) return;
+        sender->lastSeen = millis();
+
+        int16_t diff = (int16_t)(sequence - sender->sequence);
+        if (sender->sequence != 0 && diff == 0) {
+            if (ack) sendAck(header, sender->status); // Retransmit, the ack got lost
+            return;
+        }
+        if (sender->sequence != 0 && diff < 0 && diff > -UDP_SEQUENCE_WINDOW) return;
+    }
+
+    uint8_t status = execute(header[5], size - UDP_HEADER_SIZE);
+    if (sender != nullptr) {
+        sender->sequence = sequence;
+        sender->status = status;
+    }
+    if (ack) sendAck(header, status);
+}
+
+void udpControlBegin(DmxUniverse* layers, uint8_t count, const DmxUniverse& fadeStart, DmxFadeEngine& fades,
+                     CuePlayer& player, const DmxPresetBank& presets) {
+    udpLayers = layers;
+    udpLayerCount = count;
+    udpFadeStart = &fadeStart;
+    udpFades = &fades;
+    udpPlayer = &player;
+    udpPresets = &presets;
+    memset(senders, 0, sizeof(senders));
+    udp.begin(UDP_CONTROL_PORT);
+}
+
+void udpControlLoop() {
+    if (udpLayers == nullptr) return;
+
+    for (int i = 0; i < UDP_MAX_PACKETS_PER_LOOP; i++) {
+        int size = udp.parsePacket();
+        if (size <= 0) break;
+        handlePacket(size);
+    }
+}
+
+bool udpControlSend(uint32_t address, uint16_t port, uint8_t opcode, const uint8_t* params, uint8_t paramsLength,
+                    const uint8_t* data, uint16_t length) {
+    if (udpLayers == nullptr) return false;
+
+    if (++sendSequence == 0) sendSequence = 1; // 0 would be unsequenced
+    uint8_t header[UDP_HEADER_SIZE] = { 'D', 'X', 0, (uint8_t)(sendSequence >> 8), (uint8_t)(sendSequence & 0xFF),
+                                        opcode };
+    if (!udp.beginPacket(IPAddress(address), port)) return false;
+    udp.write(header, sizeof(header));
+    if (paramsLength > 0) udp.write(params, paramsLength);
+    if (length > 0) udp.write(data, length);
+    return udp.endPacket();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include "dmx_universe.h"
+#include "dmx_fade.h"
+#include "dmx_cues.h"
+#include "dmx_presets.h"
+
+// Fire-and-forget binary control over UDP, for event triggers that cannot
+// wait for a TCP handshake. Every datagram is one command, handled as it is
+// read from the socket with no allocation; changes go out with the next
+// frame.
+//
+// Datagram: [0x44 'D'] [0x58 'X'] [flags] [sequence u16] [opcode] [payload]
+// Multi-byte fields are big endian.
+//   UDP_OP_SET       [universe] [start channel u16] [value] ...
+//   UDP_OP_FADE      [channel u16] [fine] [curve] [value u16] [time ms u32]
+//                    on universe 1; curve as in DmxFadeCurve, value 0-65535
+//                    when fine is 1
+//   UDP_OP_CUE       [cue], UDP_CUE_NEXT for the next cue
+//   UDP_OP_CUE_STOP
+//   UDP_OP_RECALL    [preset id] [fade ms u32] [curve], the fade fields
+//                    optional; fades are on universe 1 only
+//   UDP_OP_DELTA     [universe] then changed-slot runs as in dmx_bridge.h;
+//                    runs up to a malformed one are applied
+//
+// The DMX input bridge sends the same datagrams (UDP_OP_SET for the full
+// universe, UDP_OP_DELTA for changes), so one unit can feed another.
+//
+// Sequence 0 means unsequenced. Otherwise a repeat of the last sequence from
+// the same sender is not applied again, and anything older within
+// UDP_SEQUENCE_WINDOW is dropped, so senders can safely retransmit until they
+// see the ack. With UDP_FLAG_ACK set the reply is
+//   [0x44] [0x58] [UDP_FLAG_REPLY] [sequence u16] [opcode] [status]
+
+#define UDP_CONTROL_PORT 6460
+#define UDP_HEADER_SIZE 6
+#define UDP_MAX_SENDERS 4
+#define UDP_SEQUENCE_WINDOW 32
+#define UDP_SENDER_TIMEOUT 10000    // ms before a sender slot is reused
+#define UDP_MAX_PACKETS_PER_LOOP 4
+
+#define UDP_FLAG_ACK 0x01
+#define UDP_FLAG_REPLY 0x80
+
+#define UDP_OP_SET 0x01
+#define UDP_OP_FADE 0x02
+#define UDP_OP_CUE 0x03
+#define UDP_OP_CUE_STOP 0x04
+#define UDP_OP_RECALL 0x05
+#define UDP_OP_DELTA 0x06
+
+#define UDP_CUE_NEXT 0xFF
+
+#define UDP_STATUS_OK 0
+#define UDP_STATUS_BAD_REQUEST 1
+#define UDP_STATUS_FAILED 2         // Valid, but could not be carried out
+
+// Commands for universe u land in layers[u - 1]; fades start from fadeStart
+// as over MQTT. Call once the network is up.
+void udpControlBegin(DmxUniverse* layers, uint8_t count, const DmxUniverse& fadeStart, DmxFadeEngine& fades,
+                     CuePlayer& player, const DmxPresetBank& presets);
+
+// Handle pending datagrams, call every loop()
+void udpControlLoop();
+
+// Send one sequenced datagram without ack to address:port, the payload being
+// params then data. False before udpControlBegin() or if it cannot be sent.
+bool udpControlSend(uint32_t address, uint16_t port, uint8_t opcode, const uint8_t* params, uint8_t paramsLength,
+                    const uint8_t* data, uint16_t length);
@@ -0,0 +1,330 @@
+#include "websocket.h"
+#include "dmx_bridge.h"
+
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT 0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+struct WsClient {
+    WiFiClient client;
+    bool active;
+    uint8_t rx[WS_RX_BUFFER];
+    uint16_t rxLength;
+    unsigned long lastReceive;
+    unsigned long lastPing;
+};
+
+static WsClient wsClients[WS_MAX_CLIENTS];
+static uint8_t wsTxBuffer[WS_RX_BUFFER + 4];
+static const DmxUniverse* wsOutput = nullptr;
+static DmxUniverse* wsUniverse = nullptr;
+static const CuePlayer* wsPlayer = nullptr;
+
+// What every client was sent last, so pushes only carry the changes
+static uint8_t wsShadow[DMX_CHANNELS];
+static uint8_t wsStatus[4];
+static uint8_t wsMessage[3 + DMX_CHANNELS];
+static unsigned long lastPush = 0;
+
+// SHA-1, only used for the handshake
+static inline uint32_t rol32(uint32_t value, uint8_t bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1Block(uint32_t state[5], const uint8_t block[64]) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20)      { f = (b & c) | (~b & d);           k = 0x5A827999; }
+        else if (i < 40) { f = b ^ c ^ d;                    k = 0x6ED9EBA1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d);  k = 0x8F1BBCDC; }
+        else             { f = b ^ c ^ d;                    k = 0xCA62C1D6; }
+        uint32_t temp = rol32(a, 5) + f + e + k + w[i];
+        e = d; d = c; c = rol32(b, 30); b = a; a = temp;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+static void sha1(const uint8_t* data, size_t length, uint8_t digest[20]) {
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t block[64];
+    size_t offset = 0;
+
+    while (length - offset >= 64) {
+        sha1Block(state, data + offset);
+        offset += 64;
+    }
+
+    size_t rest = length - offset;
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + offset, rest);
+    block[rest] = 0x80;
+    if (rest >= 56) {
+        sha1Block(state, block);
+        memset(block, 0, sizeof(block));
+    }
+    uint64_t bits = (uint64_t)length * 8;
+    for (int i = 0; i < 8; i++) {
+        block[63 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    sha1Block(state, block);
+
+    for (int i = 0; i < 20; i++) {
+        digest[i] = (uint8_t)(state[i / 4] >> (24 - (i % 4) * 8));
+    }
+}
+
+static void base64Encode(const uint8_t* data, size_t length, char* out) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t n = (uint32_t)data[i] << 16;
+        if (i + 1 < length) n |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < length) n |= data[i + 2];
+        out[o++] = alphabet[(n >> 18) & 0x3F];
+        out[o++] = alphabet[(n >> 12) & 0x3F];
+        out[o++] = i + 1 < length ? alphabet[(n >> 6) & 0x3F] : '=';
+        out[o++] = i + 2 < length ? alphabet[n & 0x3F] : '=';
+    }
+    out[o] = '\0';
+}
+
+// Server frames are never masked and always fit in one TCP write
+static void wsSendFrame(WsClient& ws, uint8_t opcode, const uint8_t* payload, uint16_t length) {
+    if (length > WS_RX_BUFFER) return;
+
+    size_t header;
+    wsTxBuffer[0] = 0x80 | opcode;
+    if (length < 126) {
+        wsTxBuffer[1] = length;
+        header = 2;
+    } else {
+        wsTxBuffer[1] = 126;
+        wsTxBuffer[2] = length >> 8;
+        wsTxBuffer[3] = length & 0xFF;
+        header = 4;
+    }
+    if (length > 0) memcpy(wsTxBuffer + header, payload, length);
+    ws.client.write(wsTxBuffer, header + length);
+}
+
+static void wsClose(WsClient& ws) {
+    ws.client.stop();
+    ws.active = false;
+    ws.rxLength = 0;
+}
+
+static void wsBroadcast(const uint8_t* payload, uint16_t length) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (wsClients[i].active) wsSendFrame(wsClients[i], WS_OP_BINARY, payload, length);
+    }
+}
+
+// The slots that differ from the shadow as one WS_MSG_DIFF into wsMessage.
+// Returns its length, 0 if nothing changed, -1 if the full universe is
+// shorter.
+static int wsBuildDiff(const uint8_t* values, uint16_t slots) {
+    wsMessage[0] = WS_MSG_DIFF;
+    int n = dmxDiffEncode(values, wsShadow, slots, wsMessage + 1, slots + 1);
+    return n > 0 ? n + 1 : n;
+}
+
+// The shadow as one WS_MSG_SET into wsMessage
+static uint16_t wsBuildSnapshot(uint16_t slots) {
+    wsMessage[0] = WS_MSG_SET;
+    wsMessage[1] = 0;
+    wsMessage[2] = 1;
+    memcpy(wsMessage + 3, wsShadow, slots);
+    return 3 + slots;
+}
+
+static void wsBuildStatus(uint8_t status[4]) {
+    status[0] = WS_MSG_STATUS;
+    status[1] = (wsPlayer->running ? WS_STATUS_RUNNING : 0) | (wsPlayer->waiting ? WS_STATUS_WAITING : 0);
+    status[2] = wsPlayer->current;
+    status[3] = wsPlayer->list != nullptr ? wsPlayer->list->count : 0;
+}
+
+// Bring every client up to date with the output and the player. The output
+// only changes in the frame tick, so this sends at most once per frame.
+static void wsPush() {
+    const uint8_t* values = dmxUniverseValues(*wsOutput);
+    uint16_t slots = dmxUniverseSlotCount(*wsOutput);
+    int length = wsBuildDiff(values, slots);
+    if (length != 0) {
+        memcpy(wsShadow, values, slots);
+        if (length < 0) length = wsBuildSnapshot(slots);
+        wsBroadcast(wsMessage, length);
+    }
+
+    uint8_t status[4];
+    wsBuildStatus(status);
+    if (memcmp(status, wsStatus, sizeof(status)) != 0) {
+        memcpy(wsStatus, status, sizeof(status));
+        wsBroadcast(status, sizeof(status));
+    }
+}
+
+// Writes reach the other clients, and come back to the sender, with the next
+// push, merged with everything else on the wire
+static void wsHandleMessage(const uint8_t* payload, uint16_t length) {
+    if (length < 4 || payload[0] != WS_MSG_SET) return;
+
+    uint16_t start = (payload[1] << 8) | payload[2];
+    dmxUniverseWrite(*wsUniverse, start, payload + 3, length - 3);
+    dmxUniverseCommit(*wsUniverse);
+}
+
+// Parse one complete frame from the front of the buffer. Returns the number of
+// bytes consumed, 0 if the frame is incomplete, -1 if the client must go.
+static int wsParseFrame(WsClient& ws) {
+    uint8_t* rx = ws.rx;
+    if (ws.rxLength < 2) return 0;
+
+    bool fin = rx[0] & 0x80;
+    uint8_t opcode = rx[0] & 0x0F;
+    bool masked = rx[1] & 0x80;
+    uint32_t length = rx[1] & 0x7F;
+    size_t header = 2;
+
+    if (!masked || !fin || opcode == WS_OP_CONTINUATION) return -1; // Fragmentation is not supported
+    if (length == 126) {
+        if (ws.rxLength < 4) return 0;
+        length = (rx[2] << 8) | rx[3];
+        header = 4;
+    } else if (length == 127) {
+        return -1;
+    }
+    if (header + 4 + length > WS_RX_BUFFER) return -1;
+    if (ws.rxLength < header + 4 + length) return 0;
+
+    const uint8_t* mask = rx + header;
+    uint8_t* payload = rx + header + 4;
+    for (uint32_t i = 0; i < length; i++) {
+        payload[i] ^= mask[i & 3];
+    }
+
+    switch (opcode) {
+        case WS_OP_BINARY:
+            wsHandleMessage(payload, length);
+            break;
+        case WS_OP_PING:
+            wsSendFrame(ws, WS_OP_PONG, payload, length);
+            break;
+        case WS_OP_CLOSE:
+            wsSendFrame(ws, WS_OP_CLOSE, payload, length > 2 ? 2 : length);
+            return -1;
+        default: // Text and pong frames carry nothing for us
+            break;
+    }
+    return header + 4 + length;
+}
+
+void wsBegin(const DmxUniverse& output, DmxUniverse& layer, const CuePlayer& player) {
+    wsOutput = &output;
+    wsUniverse = &layer;
+    wsPlayer = &player;
+}
+
+bool wsAccept(WiFiClient& client, const char* key) {
+    WsClient* ws = nullptr;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (!wsClients[i].active) {
+            ws = &wsClients[i];
+            break;
+        }
+    }
+    if (ws == nullptr || wsUniverse == nullptr) return false;
+
+    char keyGuid[64 + sizeof(WS_GUID)];
+    uint8_t digest[20];
+    char accept[32];
+    snprintf(keyGuid, sizeof(keyGuid), "%s%s", key, WS_GUID);
+    sha1((const uint8_t*)keyGuid, strlen(keyGuid), digest);
+    base64Encode(digest, sizeof(digest), accept);
+
+    client.print("HTTP/1.1 101 Switching Protocols\r\n"
+                 "Upgrade: websocket\r\n"
+                 "Connection: Upgrade\r\n"
+                 "Sec-WebSocket-Accept: ");
+    client.print(accept);
+    client.print("\r\n\r\n");
+
+    // Catch the others up first, the newcomer starts from the same shadow
+    wsPush();
+    ws->client = client;
+    ws->active = true;
+    ws->rxLength = 0;
+    ws->lastReceive = millis();
+    ws->lastPing = ws->lastReceive;
+    wsSendFrame(*ws, WS_OP_BINARY, wsMessage, wsBuildSnapshot(dmxUniverseSlotCount(*wsOutput)));
+    wsSendFrame(*ws, WS_OP_BINARY, wsStatus, sizeof(wsStatus));
+    return true;
+}
+
+bool wsOwnsClient(WiFiClient& client) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (wsClients[i].active && wsClients[i].client == client) return true;
+    }
+    return false;
+}
+
+void wsLoop() {
+    unsigned long now = millis();
+    bool anyActive = false;
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WsClient& ws = wsClients[i];
+        if (!ws.active) continue;
+
+        if (!ws.client.connected() || now - ws.lastReceive > WS_IDLE_TIMEOUT) {
+            wsClose(ws);
+            continue;
+        }
+
+        int available = ws.client.available();
+        if (available > 0) {
+            size_t space = WS_RX_BUFFER - ws.rxLength;
+            int n = ws.client.read(ws.rx + ws.rxLength, min((size_t)available, space));
+            if (n > 0) {
+                ws.rxLength += n;
+                ws.lastReceive = now;
+            }
+        }
+
+        int consumed;
+        while ((consumed = wsParseFrame(ws)) > 0) {
+            ws.rxLength -= consumed;
+            memmove(ws.rx, ws.rx + consumed, ws.rxLength);
+        }
+        if (consumed < 0) {
+            wsClose(ws);
+            continue;
+        }
+
+        if (now - ws.lastPing > WS_PING_INTERVAL) {
+            wsSendFrame(ws, WS_OP_PING, nullptr, 0);
+            ws.lastPing = now;
+        }
+        anyActive = true;
+    }
+
+    if (anyActive && now - lastPush >= WS_PUSH_INTERVAL) {
+        wsPush();
+        lastPush = now;
+    }
+}
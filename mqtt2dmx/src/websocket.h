@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiS3.h>
+#include "dmx_universe.h"
+#include "dmx_cues.h"
+
+// WebSocket control channel for the web UI (RFC 6455, binary frames only).
+// The socket stays open, so a slider move costs one small frame instead of a
+// TCP connection plus an HTTP request.
+//
+// Messages:
+//   [WS_MSG_SET] [start channel hi] [start channel lo] [value] [value] ...
+//       both ways; from a client it goes to its layer
+//   [WS_MSG_DIFF] then runs of [start channel hi] [start channel lo] [count] [value] ...
+//       server to clients, the slots that changed on the wire (runs as in dmx_bridge.h)
+//   [WS_MSG_STATUS] [flags] [current cue] [cue count]
+//       server to clients, show playback; flags: 1 running, 2 held on a GO
+// On connect the server sends the universe output as one WS_MSG_SET and the
+// show status. After that every client gets the same pushes: changes on the
+// wire, whatever made them, are diffed against what was sent last and go out
+// as one WS_MSG_DIFF at most every WS_PUSH_INTERVAL (or the full universe,
+// if that is shorter); the status goes out when it changes. Watching costs
+// one write per client per push, and nothing while the output is still.
+
+#define WS_MAX_CLIENTS 2
+#define WS_RX_BUFFER 600         // One full-universe message plus frame header
+#define WS_PING_INTERVAL 20000   // ms
+#define WS_IDLE_TIMEOUT 60000    // Drop clients that stop answering pings
+#define WS_PUSH_INTERVAL 25      // ms, changes in between are coalesced
+
+#define WS_MSG_SET 0x01
+#define WS_MSG_DIFF 0x02
+#define WS_MSG_STATUS 0x03
+
+#define WS_STATUS_RUNNING 0x01
+#define WS_STATUS_WAITING 0x02
+
+// Clients see output and player, and write to layer
+void wsBegin(const DmxUniverse& output, DmxUniverse& layer, const CuePlayer& player);
+
+// Complete the upgrade handshake for a request to /ws and keep the socket.
+// Returns false if all slots are taken.
+bool wsAccept(WiFiClient& client, const char* key);
+
+// True if this socket already belongs to a WebSocket session
+bool wsOwnsClient(WiFiClient& client);
+
+// Read and dispatch incoming frames and push changes, call every loop()
+void wsLoop();